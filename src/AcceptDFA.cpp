@@ -3,7 +3,7 @@
 #include "AcceptDFA.h"
 
 AcceptDFA::AcceptDFA(const dfa_shape_t& shape_in)
-  : DFA(shape_in)
+  : DFA(shape_in, dfa_in_memory_t())
 {
   this->set_initial_state(1);
   this->set_name("accept");
@@ -4,7 +4,6 @@
 
 #include <cassert>
 #include <cstdlib>
-#include <format>
 #include <sstream>
 
 #include "DFAUtil.h"
@@ -120,38 +119,9 @@ MoveGraph AmazonsGame::build_move_graph(int side_to_move) const
 
 shared_dfa_ptr AmazonsGame::build_positions_reversed(shared_dfa_ptr positions_in) const
 {
-  MoveGraph reverse_graph(get_shape());
-
-  reverse_graph.add_node("begin");
-  std::string previous_join = "begin";
-
-  for(int layer = 0; layer < get_shape().size(); ++layer)
-    {
-      std::vector<std::string> current_changes;
-      for(int c_from = 0; c_from < 4; ++c_from)
-        {
-          int c_to = ((c_from == 1) || (c_from == 2)) ? (3 - c_from) : c_from;
-
-          std::string node_name = std::format("layer={:d},c={:d}", layer, c_from);
-          change_vector node_changes(width * height);
-          node_changes[layer] = change_type(c_from, c_to);
-
-          reverse_graph.add_node(node_name, node_changes);
-          current_changes.push_back(node_name);
-        }
-
-      std::string next_join = std::format("layers={:d} done", layer);
-      reverse_graph.add_node(next_join);
-      for(std::string node_name : current_changes)
-        {
-          reverse_graph.add_edge(previous_join, node_name);
-          reverse_graph.add_edge(node_name, next_join);
-        }
-      previous_join = next_join;
-    }
-
-  std::string name_prefix = std::format("{:s},reversed", get_name());
-  return reverse_graph.get_moves(name_prefix, positions_in);
+  // swap the queens, leaving empty squares and arrows
+  std::vector<std::vector<int>> swap_maps(width * height, std::vector<int>({0, 2, 1, 3}));
+  return DFAUtil::get_relabeled(positions_in, swap_maps);
 }
 
 DFAString AmazonsGame::get_position_initial() const
@@ -207,6 +177,14 @@ DFAString AmazonsGame::get_position_initial() const
   return DFAString(get_shape(), initial_characters);
 }
 
+std::vector<std::vector<int>> AmazonsGame::get_symmetries() const
+{
+  return GameUtil::get_board_symmetries(width, height, [=, this](int x, int y)
+  {
+    return x + width * y;
+  });
+}
+
 std::string AmazonsGame::position_to_string(const DFAString& string_in) const
 {
   std::ostringstream output;
@@ -4,6 +4,7 @@
 #define AMAZONS_GAME_H
 
 #include <string>
+#include <vector>
 
 #include "NormalPlayGame.h"
 
@@ -23,6 +24,7 @@ public:
   AmazonsGame(int, int);
 
   virtual DFAString get_position_initial() const;
+  virtual std::vector<std::vector<int>> get_symmetries() const;
 
   virtual std::string position_to_string(const DFAString&) const;
 
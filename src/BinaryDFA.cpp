@@ -3,6 +3,7 @@
 #include "BinaryDFA.h"
 
 #include <algorithm>
+#include <atomic>
 #include <bit>
 #include <cassert>
 #include <cstring>
@@ -12,20 +13,52 @@
 #include <numeric>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
-#include <queue>
 #include <ranges>
 #include <sstream>
 #include <string>
 #include <unistd.h>
 
+#include "BoundedTasks.h"
 #include "Flashsort.h"
 #include "MemoryMap.h"
 #include "Profile.h"
+#include "SortedRuns.h"
 #include "VectorBitSet.h"
 #include "parallel.h"
+#include "utils.h"
 
 static const size_t SYNC_THRESHOLD_BYTES = 1ULL << 25;
 
+static std::atomic<int> next_workspace_id = 0;
+
+#ifndef BINARY_DFA_RAM_BUDGET
+#define BINARY_DFA_RAM_BUDGET (size_t(1) << 30) // 1GB
+#endif
+
+// floor on the RAM taken when concurrent builds hold the rest of the
+// shared task memory budget.
+#ifndef BINARY_DFA_RAM_MINIMUM
+#define BINARY_DFA_RAM_MINIMUM (size_t(64) << 20) // 64MB
+#endif
+
+static std::atomic<size_t> ram_budget = BINARY_DFA_RAM_BUDGET;
+
+std::unique_ptr<MemoryReservation> BinaryDFA::reserve_ram()
+{
+  // each layer pass reserves its RAM budget from the task memory
+  // budget shared by all concurrent builds, or from the task it runs
+  // in, taking less when the budget is mostly held elsewhere.
+  size_t budget = ram_budget;
+  return BoundedTasks::reserve_memory(budget, std::min(budget, BINARY_DFA_RAM_MINIMUM));
+}
+
+template<class T>
+static size_t ram_budget_elements(const MemoryReservation& ram_reservation, size_t element_width)
+{
+  // number of elements each element_width wide fitting in the reserved RAM
+  return std::max(ram_reservation.get_memory() / (sizeof(T) * element_width), size_t(1));
+}
+
 template<class T>
 static void sync_if_big(MemoryMap<T>& memory_map)
 {
@@ -36,8 +69,16 @@ static void sync_if_big(MemoryMap<T>& memory_map)
 }
 
 BinaryDFA::BinaryDFA(const dfa_shape_t& shape_in, const BinaryFunction& leaf_func_in)
+  : BinaryDFA(shape_in,
+              leaf_func_in,
+              "scratch/binarydfa/" + get_process_name() + "-" + std::to_string(next_workspace_id++))
+{
+}
+
+BinaryDFA::BinaryDFA(const dfa_shape_t& shape_in, const BinaryFunction& leaf_func_in, std::string workspace_in)
   : DFA(shape_in),
-    leaf_func(leaf_func_in)
+    leaf_func(leaf_func_in),
+    workspace(workspace_in)
 {
 }
 
@@ -96,11 +137,57 @@ BinaryDFA::BinaryDFA(const DFA& left_in,
   build_quadratic(left_in, right_in);
 }
 
-static std::string binary_build_file_prefix(int layer)
+BinaryDFATransitionsHashPlusIndex BinaryDFATransitionsHashPlusIndex::from_transitions(const dfa_state_t *transitions_in, int layer_shape, size_t i)
+{
+  BinaryDFATransitionsHashPlusIndex output;
+  if(layer_shape + 1 <= binary_dfa_hash_width)
+    {
+      // copy transitions
+      for(int j = 0; j < layer_shape; ++j)
+        {
+          output.data[j] = transitions_in[j];
+        }
+      // and zero pad the rest of the hash space
+      for(int j = layer_shape; j < binary_dfa_hash_width - 1; ++j)
+        {
+          output.data[j] = 0;
+        }
+    }
+  else
+    {
+      // transitions don't fit, so hash them
+
+      unsigned char hash_output[SHA256_DIGEST_LENGTH];
+      static const EVP_MD *hash_implementation = EVP_sha256();
+      EVP_MD_CTX *hash_context = EVP_MD_CTX_create();
+
+      EVP_DigestInit_ex(hash_context, hash_implementation, NULL);
+      EVP_DigestUpdate(hash_context, transitions_in, layer_shape * sizeof(dfa_state_t));
+      EVP_DigestFinal_ex(hash_context, hash_output, 0);
+      EVP_MD_CTX_destroy(hash_context);
+
+      for(int j = 0; j < binary_dfa_hash_width - 1; ++j)
+        {
+          output.data[j] = reinterpret_cast<dfa_state_t *>(hash_output)[j];
+        }
+    }
+
+  assert(i <= DFA_STATE_MAX);
+  output.data[binary_dfa_hash_width - 1] = dfa_state_t(i);
+
+  return output;
+}
+
+std::string BinaryDFA::build_file_name(std::string suffix) const
+{
+  return workspace + "/" + suffix;
+}
+
+std::string BinaryDFA::build_file_name(int layer, std::string suffix) const
 {
   std::ostringstream filename_builder;
-  filename_builder << "scratch/binarydfa/layer=" << (layer < 10 ? "0" : "") << layer;
-  return filename_builder.str();
+  filename_builder << "layer=" << (layer < 10 ? "0" : "") << layer << "-" << suffix;
+  return build_file_name(filename_builder.str());
 }
 
 void BinaryDFA::build_linear(const DFA& left_in,
@@ -286,17 +373,6 @@ void BinaryDFA::build_linear(const DFA& left_in,
   this->set_initial_state(changed_states[0][0]);
 }
 
-static std::string memory_map_name(int layer, std::string suffix)
-{
-  return binary_build_file_prefix(layer) + "-" + suffix;
-}
-
-template<class T>
-static MemoryMap<T> memory_map_helper(int layer, std::string suffix, size_t size_in)
-{
-  return MemoryMap<T>(memory_map_name(layer, suffix), size_in);
-}
-
 void BinaryDFA::build_quadratic(const DFA& left_in,
                                 const DFA& right_in)
 {
@@ -316,6 +392,11 @@ void BinaryDFA::build_quadratic(const DFA& left_in,
       return;
     }
 
+  // intermediate files go in a workspace private to this build
+
+  create_directory(workspace);
+  std::cout << "binary workspace = " << workspace << std::endl;
+
   // forward pass
 
   profile.tic("forward");
@@ -361,6 +442,12 @@ void BinaryDFA::build_quadratic_backward(const DFA& left_in,
   assert(next_pair_rank_to_output.size() == 1);
   this->set_initial_state(next_pair_rank_to_output[0]);
   next_pair_rank_to_output.unlink();
+
+  // build finished, so layer pairs are no longer needed for restarts
+
+  profile.tic("workspace cleanup");
+
+  remove_directory(workspace);
 }
 
 MemoryMap<dfa_state_t> BinaryDFA::build_quadratic_backward_layer(const DFA& left_in,
@@ -394,7 +481,7 @@ MemoryMap<dfa_state_t> BinaryDFA::build_quadratic_backward_layer(const DFA& left
   next_pairs_index.reserve(3);
   auto add_next_pairs_index = [&](const MemoryMap<dfa_state_pair_t>& previous_pairs)
   {
-    std::string index_name = "scratch/binarydfa/next_pairs_index-" + std::to_string(next_pairs_index.size());
+    std::string index_name = build_file_name("next_pairs_index-" + std::to_string(next_pairs_index.size()));
     size_t index_length = (previous_pairs.size() + 511) / 512;
     next_pairs_index.emplace_back(index_name, index_length, [&](size_t i)
     {
@@ -432,19 +519,13 @@ MemoryMap<dfa_state_t> BinaryDFA::build_quadratic_backward_layer(const DFA& left
     return offset_min;
   };
 
-  profile.tic("transitions input");
-
-  MemoryMap<dfa_state_pair_t> curr_transition_pairs = build_quadratic_transition_pairs(left_in, right_in, layer);
-
   profile.tic("transitions populate");
 
   auto filter_func = get_filter_func();
   auto shortcircuit_func = get_shortcircuit_func();
 
-  MemoryMap<dfa_state_t> curr_transitions("scratch/binarydfa/transitions", curr_layer_count * curr_layer_shape, [&](size_t next_pair_index)
+  auto lookup_next_pair = [&](dfa_state_pair_t next_pair)
   {
-    dfa_state_pair_t next_pair = curr_transition_pairs[next_pair_index];
-
     dfa_state_t next_left_state = next_pair.get_left_state();
     assert(next_left_state < next_left_size);
     dfa_state_t next_right_state = next_pair.get_right_state();
@@ -486,103 +567,116 @@ MemoryMap<dfa_state_t> BinaryDFA::build_quadratic_backward_layer(const DFA& left
 
         return next_pair_rank_to_output[next_rank_min];
       }
-  });
-
-  profile.tic("unlink transition_pairs");
+  };
 
-  curr_transition_pairs.unlink();
+  size_t curr_left_size = left_in.get_layer_size(layer);
+  size_t curr_right_size = right_in.get_layer_size(layer);
+  curr_pairs[curr_layer_count - 1].check(curr_left_size, curr_right_size);
 
-  profile.tic("unlink next_pairs_index");
+  // make sure inputs are memory mapped before going parallel
+  curr_pairs.mmap();
+  left_in.get_transitions(layer, 0);
+  right_in.get_transitions(layer, 0);
 
-  while(next_pairs_index.size())
-    {
-      next_pairs_index.back().unlink();
-      next_pairs_index.pop_back();
-    }
+  std::unique_ptr<MemoryReservation> ram_reservation = reserve_ram();
 
-  profile.tic("transitions hash");
+  // transitions are populated in chunks of current pairs sized to
+  // the RAM budget, reading all the left transitions before the right
+  // transitions to keep one input hot at a time. each chunk is hashed,
+  // sorted and written as a run of hashes with a run of the matching
+  // transitions in the same order, so later passes read both
+  // sequentially.
 
-  MemoryMap<BinaryDFATransitionsHashPlusIndex> curr_transitions_hashed("scratch/binarydfa/transitions_hashed", curr_layer_count, [&](size_t i)
+  std::vector<MemoryMap<BinaryDFATransitionsHashPlusIndex>> hashed_runs;
+  std::vector<MemoryMap<dfa_state_t>> transitions_runs;
   {
-    BinaryDFATransitionsHashPlusIndex output;
-    if(curr_layer_shape + 1 <= binary_dfa_hash_width)
-      {
-        // copy transitions
-        for(int j = 0; j < curr_layer_shape; ++j)
-          {
-            output.data[j] = curr_transitions[i * curr_layer_shape + j];
-          }
-        // and zero pad the rest of the hash space
-        for(int j = curr_layer_shape; j < binary_dfa_hash_width - 1; ++j)
-          {
-            output.data[j] = 0;
-          }
-      }
-    else
-      {
-        // transitions don't fit, so hash them
-
-        unsigned char hash_output[SHA256_DIGEST_LENGTH];
-        static const EVP_MD *hash_implementation = EVP_sha256();
-        EVP_MD_CTX *hash_context = EVP_MD_CTX_create();
-
-        EVP_DigestInit_ex(hash_context, hash_implementation, NULL);
-        EVP_DigestUpdate(hash_context, &(curr_transitions[i * curr_layer_shape]), curr_layer_shape * sizeof(dfa_state_t));
-        EVP_DigestFinal_ex(hash_context, hash_output, 0);
-
-        for(int j = 0; j < binary_dfa_hash_width - 1; ++j)
-          {
-            output.data[j] = reinterpret_cast<dfa_state_t *>(hash_output)[j];
-          }
-      }
-
-    assert(i <= DFA_STATE_MAX);
-    output.data[binary_dfa_hash_width - 1] = dfa_state_t(i);
-
-    return output;
-  });
-
-  profile.tic("sort hash");
+    const size_t chunk_pairs = std::min(curr_layer_count, ram_budget_elements<dfa_state_t>(*ram_reservation, 2 * curr_layer_shape + binary_dfa_hash_width));
 
-  TRY_PARALLEL_2(std::sort, curr_transitions_hashed.begin(), curr_transitions_hashed.end());
+    std::vector<dfa_state_t> chunk_left(chunk_pairs * curr_layer_shape);
+    std::vector<dfa_state_t> chunk_transitions(chunk_pairs * curr_layer_shape);
+    std::vector<BinaryDFATransitionsHashPlusIndex> chunk_hashed(chunk_pairs);
+    std::vector<size_t> chunk_iota(chunk_pairs);
+    std::iota(chunk_iota.begin(), chunk_iota.end(), size_t(0));
 
-  profile.tic("sort hash check");
-
-  auto hash_collision = TRY_PARALLEL_3(std::adjacent_find, curr_transitions_hashed.begin(), curr_transitions_hashed.end(), [&](const BinaryDFATransitionsHashPlusIndex& a, const BinaryDFATransitionsHashPlusIndex& b)
-  {
-    // return true if hashes match but transitions do not
-
-    if(a < b)
+    for(size_t chunk_start = 0; chunk_start < curr_layer_count; chunk_start += chunk_pairs)
       {
-        return false;
+        size_t chunk_size = std::min(chunk_start + chunk_pairs, curr_layer_count) - chunk_start;
+
+        profile.tic("transitions populate chunk");
+
+        TRY_PARALLEL_3(std::for_each,
+                       chunk_iota.begin(),
+                       chunk_iota.begin() + chunk_size,
+                       [&](size_t i)
+                       {
+                         DFATransitionsReference left_transitions = left_in.get_transitions(layer, curr_pairs[chunk_start + i].get_left_state());
+                         for(int j = 0; j < curr_layer_shape; ++j)
+                           {
+                             chunk_left[i * curr_layer_shape + j] = left_transitions[j];
+                           }
+                       });
+
+        TRY_PARALLEL_3(std::for_each,
+                       chunk_iota.begin(),
+                       chunk_iota.begin() + chunk_size,
+                       [&](size_t i)
+                       {
+                         DFATransitionsReference right_transitions = right_in.get_transitions(layer, curr_pairs[chunk_start + i].get_right_state());
+                         for(int j = 0; j < curr_layer_shape; ++j)
+                           {
+                             chunk_transitions[i * curr_layer_shape + j] = lookup_next_pair(dfa_state_pair_t(chunk_left[i * curr_layer_shape + j], right_transitions[j]));
+                           }
+                       });
+
+        profile.tic("transitions hash chunk");
+
+        chunk_hashed.resize(chunk_size);
+        TRY_PARALLEL_4(std::transform,
+                       chunk_iota.begin(),
+                       chunk_iota.begin() + chunk_size,
+                       chunk_hashed.begin(),
+                       [&](size_t i)
+                       {
+                         return BinaryDFATransitionsHashPlusIndex::from_transitions(&(chunk_transitions[i * curr_layer_shape]), curr_layer_shape, chunk_start + i);
+                       });
+
+        profile.tic("transitions hash sort");
+
+        TRY_PARALLEL_2(std::sort, chunk_hashed.begin(), chunk_hashed.end());
+
+        profile.tic("transitions hash write");
+
+        std::string run_suffix = "-run=" + std::to_string(hashed_runs.size());
+        hashed_runs.emplace_back(build_file_name("transitions_hashed" + run_suffix), chunk_hashed);
+
+        MemoryMap<dfa_state_t>& transitions_run = transitions_runs.emplace_back(build_file_name("transitions" + run_suffix), chunk_size * curr_layer_shape);
+        TRY_PARALLEL_3(std::for_each,
+                       chunk_iota.begin(),
+                       chunk_iota.begin() + chunk_size,
+                       [&](size_t k)
+                       {
+                         size_t i = chunk_hashed[k].get_pair_rank() - chunk_start;
+                         std::copy_n(chunk_transitions.begin() + i * curr_layer_shape, curr_layer_shape, &(transitions_run[k * curr_layer_shape]));
+                       });
       }
+  }
 
-    size_t curr_pair_index_a = a.get_pair_rank();
-    size_t curr_pair_index_b = b.get_pair_rank();
-
-    return ::memcmp(&(curr_transitions[curr_pair_index_a * curr_layer_shape]),
-                    &(curr_transitions[curr_pair_index_b * curr_layer_shape]),
-                    sizeof(dfa_state_t) * curr_layer_shape) != 0;
-  });
-  // confirm no mismatch found
-  assert(hash_collision == curr_transitions_hashed.end());
-
-  // make permutation of pairs sorted by transitions
+  profile.tic("munmap pairs");
 
-  profile.tic("sort permutation");
-
-  MemoryMap<dfa_state_t> curr_pairs_permutation("scratch/binarydfa/pairs_permutation", curr_layer_count, [&](size_t i)
-  {
-    return curr_transitions_hashed[i].get_pair_rank();
-  });
+  curr_pairs.munmap();
+  next_pairs.munmap();
 
-  profile.tic("states identification");
+  profile.tic("unlink next_pairs_index");
 
-  MemoryMap<dfa_state_t> curr_pairs_permutation_to_output("scratch/binarydfa/pairs_permutation_to_output", curr_layer_count);
+  while(next_pairs_index.size())
+    {
+      next_pairs_index.back().unlink();
+      next_pairs_index.pop_back();
+    }
 
-  auto check_constant = [&](size_t curr_pair_rank)
+  auto check_constant = [&](const dfa_state_t *transitions_in)
   {
-    dfa_state_t possible_constant = curr_transitions[curr_pair_rank * curr_layer_shape];
+    dfa_state_t possible_constant = transitions_in[0];
     if(possible_constant >= 2)
       {
         return false;
@@ -590,7 +684,7 @@ MemoryMap<dfa_state_t> BinaryDFA::build_quadratic_backward_layer(const DFA& left
 
     for(int j = 1; j < curr_layer_shape; ++j)
       {
-        if(curr_transitions[curr_pair_rank * curr_layer_shape + j] != possible_constant)
+        if(transitions_in[j] != possible_constant)
           {
             return false;
           }
@@ -599,127 +693,122 @@ MemoryMap<dfa_state_t> BinaryDFA::build_quadratic_backward_layer(const DFA& left
     return true;
   };
 
-  auto curr_transitions_hashed_begin = curr_transitions_hashed.begin();
-  auto check_new = [&](const BinaryDFATransitionsHashPlusIndex& curr_pair_hashed)
-  {
-    dfa_state_t curr_pair_rank = curr_pair_hashed.get_pair_rank();
-    if(check_constant(curr_pair_rank))
-      {
-        return dfa_state_t(0);
-      }
-
-    if(&curr_pair_hashed <= curr_transitions_hashed_begin)
-      {
-        // first and non-constant is always a new state
-        // TODO : change range to not require this
-        return dfa_state_t(1);
-      }
+  // merge the runs in transitions order, numbering distinct
+  // transitions as new states. the transitions of each new state are
+  // appended in state order, and (pair rank, output) pairs are
+  // buffered into runs sorted by pair rank.
 
-    if((&curr_pair_hashed)[-1] < curr_pair_hashed)
-      {
-        // different transitions from predecessor
-        return dfa_state_t(1);
-      }
+  profile.tic("states identification");
 
-    return dfa_state_t(0);
-  };
+  MemoryMap<dfa_state_t> curr_states(build_file_name("states"), curr_layer_count * curr_layer_shape);
 
-  TRY_PARALLEL_6(std::transform_inclusive_scan,
-                 curr_transitions_hashed.begin(),
-                 curr_transitions_hashed.end(),
-                 curr_pairs_permutation_to_output.begin(),
-                 [](dfa_state_t previous, dfa_state_t delta) {
-                   dfa_state_t output = previous + delta;
-                   // check for overflow
-                   assert(output >= previous);
-                   return output;
-                 },
-                 check_new,
-                 1); // first new state will be 2
+  std::vector<MemoryMap<dfa_state_pair_t>> rank_to_output_runs;
+  std::vector<dfa_state_pair_t> rank_to_output_buffer;
+  rank_to_output_buffer.reserve(std::min(curr_layer_count, ram_budget_elements<dfa_state_pair_t>(*ram_reservation, 1)));
 
-  dfa_state_t layer_size = curr_pairs_permutation_to_output[curr_layer_count - 1] + 1;
+  auto write_rank_to_output_run = [&]()
+  {
+    TRY_PARALLEL_2(std::sort, rank_to_output_buffer.begin(), rank_to_output_buffer.end());
+    rank_to_output_runs.emplace_back(build_file_name("pair_rank_to_output-run=" + std::to_string(rank_to_output_runs.size())), rank_to_output_buffer);
+    rank_to_output_buffer.clear();
+  };
 
-  profile.tic("unlink transitions_hashed");
+  dfa_state_t previous_output = 1; // first new state will be 2
+  {
+    size_t merged_count = 0;
+    BinaryDFATransitionsHashPlusIndex previous_hashed = {};
+    std::vector<dfa_state_t> previous_transitions(curr_layer_shape);
 
-  curr_transitions_hashed.unlink();
+    merge_sorted_runs<BinaryDFATransitionsHashPlusIndex>(hashed_runs, [&](const BinaryDFATransitionsHashPlusIndex& curr_pair_hashed, size_t run_index, size_t run_offset)
+    {
+      const dfa_state_t *curr_pair_transitions = &(transitions_runs[run_index][run_offset * curr_layer_shape]);
 
-  profile.tic("states write");
+      dfa_state_t curr_output;
+      if(check_constant(curr_pair_transitions))
+        {
+          curr_output = curr_pair_transitions[0];
+        }
+      else
+        {
+          if((merged_count == 0) || (previous_hashed < curr_pair_hashed))
+            {
+              // first or different transitions from predecessor
 
-  auto curr_pairs_permutation_to_output_begin = curr_pairs_permutation_to_output.begin();
-  auto curr_pairs_permutation_to_output_end = curr_pairs_permutation_to_output.end();
-  auto curr_transitions_begin = curr_transitions.begin();
+              // check for overflow
+              assert(previous_output + 1 > previous_output);
+              ++previous_output;
 
-  auto populate_transitions = [&](dfa_state_t new_state_id, dfa_state_t *transitions_out)
-  {
-    assert(new_state_id < layer_size);
-    auto iter = std::lower_bound(curr_pairs_permutation_to_output_begin,
-                                 curr_pairs_permutation_to_output_end,
-                                 new_state_id);
-    assert(iter < curr_pairs_permutation_to_output_end);
-    assert(*iter == new_state_id);
-
-    size_t curr_pairs_permutation_index = iter - curr_pairs_permutation_to_output_begin;
-    dfa_state_t curr_pair_rank = curr_pairs_permutation[curr_pairs_permutation_index];
-    std::copy_n(curr_transitions_begin + size_t(curr_pair_rank) * curr_layer_shape, curr_layer_shape, transitions_out);
-  };
+              std::copy_n(curr_pair_transitions, curr_layer_shape, &(curr_states[size_t(previous_output - 2) * curr_layer_shape]));
+            }
+          else
+            {
+              // confirm hash match is not a collision
+              assert(::memcmp(previous_transitions.data(),
+                              curr_pair_transitions,
+                              sizeof(dfa_state_t) * curr_layer_shape) == 0);
+            }
 
-  build_layer(layer, layer_size, populate_transitions);
+          curr_output = previous_output;
+        }
 
-  profile.tic("invert");
+      rank_to_output_buffer.emplace_back(curr_pair_hashed.get_pair_rank(), curr_output);
+      if(rank_to_output_buffer.size() == rank_to_output_buffer.capacity())
+        {
+          write_rank_to_output_run();
+        }
 
-  // invert permutation so we can write pair_rank_to_output in order
+      std::copy_n(curr_pair_transitions, curr_layer_shape, previous_transitions.begin());
+      previous_hashed = curr_pair_hashed;
+      ++merged_count;
+    });
+    assert(merged_count == curr_layer_count);
+  }
 
-  MemoryMap<dfa_state_t> curr_pairs_permutation_inverse("scratch/binarydfa/pairs_permutation_inverse", curr_layer_count);
-  // contents are indexes into curr_pairs_permutation
-  std::iota(curr_pairs_permutation_inverse.begin(),
-            curr_pairs_permutation_inverse.end(),
-            0);
-  // sort so curr_pairs_permutation[curr_pairs_permutation_inverse[i]] = i
+  if(rank_to_output_buffer.size() > 0)
+    {
+      write_rank_to_output_run();
+    }
+  rank_to_output_buffer = std::vector<dfa_state_pair_t>();
 
-  TRY_PARALLEL_3(std::sort,
-                 curr_pairs_permutation_inverse.begin(),
-                 curr_pairs_permutation_inverse.end(),
-                 [&](dfa_state_t a, dfa_state_t b) {
-                   return curr_pairs_permutation[a] < curr_pairs_permutation[b];
-                 });
+  profile.tic("unlink transitions");
 
-  for(size_t i : {size_t(0), curr_layer_count - 1})
+  for(MemoryMap<dfa_state_t>& transitions_run : transitions_runs)
     {
-      assert(curr_pairs_permutation[curr_pairs_permutation_inverse[i]] == i);
+      transitions_run.unlink();
     }
+  transitions_runs.clear();
 
-  profile.tic("unlink pairs_permutation");
-
-  curr_pairs_permutation.unlink();
+  dfa_state_t layer_size = previous_output + 1;
 
-  profile.tic("output");
+  profile.tic("states write");
 
-  MemoryMap<dfa_state_t> curr_pair_rank_to_output(binary_build_file_prefix(layer) + "-pair_rank_to_output", curr_layer_count, [&](size_t curr_pair_rank)
+  auto populate_transitions = [&](dfa_state_t new_state_id, dfa_state_t *transitions_out)
   {
-    dfa_state_t curr_pairs_permutation_index = curr_pairs_permutation_inverse[curr_pair_rank];
-    if(check_constant(curr_pair_rank))
-      {
-        return curr_transitions[size_t(curr_pair_rank) * curr_layer_shape];
-      }
-
-    return curr_pairs_permutation_to_output[curr_pairs_permutation_index];
-  });
-
-  assert(curr_pair_rank_to_output.size() > 0);
+    assert(2 <= new_state_id);
+    assert(new_state_id < layer_size);
+    std::copy_n(curr_states.begin() + size_t(new_state_id - 2) * curr_layer_shape, curr_layer_shape, transitions_out);
+  };
 
-  // shrink state
+  build_layer(layer, layer_size, populate_transitions);
 
-  profile.tic("unlink transitions");
+  profile.tic("unlink states");
 
-  curr_transitions.unlink();
+  curr_states.unlink();
 
-  profile.tic("unlink pairs_permutation_inverse");
+  profile.tic("output");
 
-  curr_pairs_permutation_inverse.unlink();
+  // merge outputs back into pair rank order
 
-  profile.tic("unlink pairs_permutation_to_output");
+  MemoryMap<dfa_state_t> curr_pair_rank_to_output(build_file_name(layer, "pair_rank_to_output"), curr_layer_count);
+  size_t curr_pair_rank = 0;
+  merge_sorted_runs<dfa_state_pair_t>(rank_to_output_runs, [&](const dfa_state_pair_t& rank_and_output)
+  {
+    assert(rank_and_output.get_left_state() == curr_pair_rank);
+    curr_pair_rank_to_output[curr_pair_rank++] = rank_and_output.get_right_state();
+  });
+  assert(curr_pair_rank == curr_layer_count);
 
-  curr_pairs_permutation_to_output.unlink();
+  assert(curr_pair_rank_to_output.size() > 0);
 
   // cleanup in destructors
   profile.tic("cleanup");
@@ -739,7 +828,7 @@ int BinaryDFA::build_quadratic_forward(const DFA& left_in, const DFA& right_in)
   dfa_state_t initial_left = left_in.get_initial_state();
   dfa_state_t initial_right = right_in.get_initial_state();
 
-  MemoryMap<dfa_state_pair_t> initial_pairs = memory_map_helper<dfa_state_pair_t>(0, "pairs", 1);
+  MemoryMap<dfa_state_pair_t> initial_pairs(build_file_name(0, "pairs"), size_t(1));
   initial_pairs[0] = dfa_state_pair_t(initial_left, initial_right);
 
   return build_quadratic_forward(left_in, right_in, 0);
@@ -790,78 +879,143 @@ MemoryMap<dfa_state_pair_t> BinaryDFA::build_quadratic_forward_layer(const DFA&
 
   profile.tic("init");
 
-  // get size of current layer and next layer.
-  //
-  // using size_t for product calculations...
-
-  size_t next_left_size = left_in.get_layer_size(layer + 1);
-  size_t next_right_size = right_in.get_layer_size(layer + 1);
+  // streams successor pairs in chunks of current pairs sized to the
+  // RAM budget. each chunk is filtered, sorted and deduped in memory,
+  // then written as a sorted run. the runs are merged with a final
+  // unique into the next pairs, so scratch usage is proportional to
+  // the distinct pairs per chunk instead of the full pairs *
+  // layer_shape expansion.
 
-  profile.tic("transitions");
+  int curr_layer_shape = this->get_layer_shape(layer);
+  const MemoryMap<dfa_state_pair_t> curr_pairs = build_quadratic_read_pairs(layer);
+  size_t curr_pairs_count = curr_pairs.size();
+  assert(curr_pairs_count > 0);
 
-  MemoryMap<dfa_state_pair_t> curr_transition_pairs = build_quadratic_transition_pairs(left_in, right_in, layer);
+  size_t curr_left_size = left_in.get_layer_size(layer);
+  size_t curr_right_size = right_in.get_layer_size(layer);
+  curr_pairs[curr_pairs_count - 1].check(curr_left_size, curr_right_size);
 
-  std::cout << "pair count = " << curr_transition_pairs.size() << " (original)" << std::endl;
+  size_t next_left_size = left_in.get_layer_size(layer + 1);
+  size_t next_right_size = right_in.get_layer_size(layer + 1);
 
-  // helper functions
+  // make sure inputs are memory mapped before going parallel
+  curr_pairs.mmap();
+  left_in.get_transitions(layer, 0);
+  right_in.get_transitions(layer, 0);
 
-  profile.tic("filter");
+  std::unique_ptr<MemoryReservation> ram_reservation = reserve_ram();
+  const size_t chunk_pairs = std::min(curr_pairs_count, ram_budget_elements<dfa_state_pair_t>(*ram_reservation, curr_layer_shape));
 
   auto filter_func = get_filter_func();
 
-  auto remove_func = [&](dfa_state_pair_t next_pair)
-  {
-    dfa_state_t next_left_state = next_pair.get_left_state();
-    dfa_state_t next_right_state = next_pair.get_right_state();
-
-    return filter_func(next_left_state, next_right_state);
-  };
-
-  auto working_begin = curr_transition_pairs.begin();
-  auto working_end = curr_transition_pairs.end();
-
-  working_end = TRY_PARALLEL_3(std::remove_if,
-                               working_begin,
-                               working_end,
-                               remove_func);
+  std::vector<dfa_state_pair_t> chunk_buffer;
+  chunk_buffer.reserve(chunk_pairs * curr_layer_shape);
 
-  std::cout << "pair count = " << (working_end - working_begin) << " (filtered)" << std::endl;
+  std::vector<size_t> chunk_iota(chunk_pairs);
+  std::iota(chunk_iota.begin(), chunk_iota.end(), size_t(0));
 
-  profile.tic("pre-unique");
+  size_t pairs_original = 0;
+  size_t pairs_filtered = 0;
+  size_t pairs_runs = 0;
 
-  working_end = TRY_PARALLEL_2(std::unique,
-                               working_begin,
-                               working_end);
-
-  std::cout << "pair count = " << (working_end - working_begin) << " (pre sort unique)" << std::endl;
-
-  profile.tic("sort");
+  std::vector<MemoryMap<dfa_state_pair_t>> runs;
+  for(size_t chunk_start = 0; chunk_start < curr_pairs_count; chunk_start += chunk_pairs)
+    {
+      size_t chunk_end = std::min(chunk_start + chunk_pairs, curr_pairs_count);
+      size_t chunk_size = chunk_end - chunk_start;
+
+      profile.tic("chunk populate");
+
+      chunk_buffer.resize(chunk_size * curr_layer_shape);
+      TRY_PARALLEL_3(std::for_each,
+                     chunk_iota.begin(),
+                     chunk_iota.begin() + chunk_size,
+                     [&](size_t i)
+                     {
+                       dfa_state_pair_t curr_pair = curr_pairs[chunk_start + i];
+                       DFATransitionsReference left_transitions = left_in.get_transitions(layer, curr_pair.get_left_state());
+                       DFATransitionsReference right_transitions = right_in.get_transitions(layer, curr_pair.get_right_state());
+
+                       dfa_state_pair_t *pairs_out = chunk_buffer.data() + i * curr_layer_shape;
+                       for(int j = 0; j < curr_layer_shape; ++j)
+                         {
+                           pairs_out[j] = dfa_state_pair_t(left_transitions[j], right_transitions[j]);
+                         }
+                     });
+      pairs_original += chunk_buffer.size();
+
+      profile.tic("chunk filter");
+
+      auto chunk_end_iter = TRY_PARALLEL_3(std::remove_if,
+                                           chunk_buffer.begin(),
+                                           chunk_buffer.end(),
+                                           [&](const dfa_state_pair_t& next_pair)
+                                           {
+                                             return filter_func(next_pair.get_left_state(),
+                                                                next_pair.get_right_state());
+                                           });
+      pairs_filtered += chunk_end_iter - chunk_buffer.begin();
+
+      profile.tic("chunk pre-unique");
+
+      chunk_end_iter = TRY_PARALLEL_2(std::unique,
+                                      chunk_buffer.begin(),
+                                      chunk_end_iter);
+
+      profile.tic("chunk sort");
+
+      TRY_PARALLEL_2(std::sort,
+                     chunk_buffer.begin(),
+                     chunk_end_iter);
+
+      profile.tic("chunk post-unique");
+
+      chunk_end_iter = TRY_PARALLEL_2(std::unique,
+                                      chunk_buffer.begin(),
+                                      chunk_end_iter);
+      chunk_buffer.resize(chunk_end_iter - chunk_buffer.begin());
+      pairs_runs += chunk_buffer.size();
+
+      profile.tic("chunk write");
+
+      if(chunk_buffer.size() > 0)
+        {
+          runs.emplace_back(build_file_name(layer + 1, "run=" + std::to_string(runs.size())), chunk_buffer);
+        }
+    }
 
-  TRY_PARALLEL_2(std::sort,
-                 working_begin,
-                 working_end);
+  // release chunk memory before merging
+  chunk_buffer = std::vector<dfa_state_pair_t>();
 
-  profile.tic("post-unique");
+  profile.tic("curr pairs munmap");
 
-  working_end = TRY_PARALLEL_2(std::unique,
-                               working_begin,
-                               working_end);
+  curr_pairs.munmap();
 
-  std::cout << "pair count = " << (working_end - working_begin) << " (post sort unique)" << std::endl;
+  std::cout << "pair count = " << pairs_original << " (original)" << std::endl;
+  std::cout << "pair count = " << pairs_filtered << " (filtered)" << std::endl;
+  std::cout << "pair count = " << pairs_runs << " (" << runs.size() << " sorted runs)" << std::endl;
 
-  // the following truncate and rename to the next pairs file are to
-  // make the next pairs updates atomic and make restarts easier.
+  // merge sorted runs into the next pairs. the rename at the end is
+  // to make the next pairs updates atomic and make restarts easier.
 
-  profile.tic("munmap");
+  profile.tic("merge");
 
-  // this munmap is implied by the truncate, but separating to track
-  // the timing.
-  curr_transition_pairs.munmap();
+  MemoryMap<dfa_state_pair_t> next_pairs(build_file_name(layer + 1, "pairs_merged"), pairs_runs);
+  size_t next_pairs_count = 0;
+  merge_sorted_runs<dfa_state_pair_t>(runs, [&](const dfa_state_pair_t& next_pair)
+  {
+    if((next_pairs_count == 0) || !(next_pairs[next_pairs_count - 1] == next_pair))
+      {
+        next_pairs[next_pairs_count++] = next_pair;
+      }
+  });
 
   profile.tic("truncate");
 
-  size_t next_pairs_count = working_end - working_begin;
-  curr_transition_pairs.truncate(next_pairs_count);
+  next_pairs.munmap();
+  next_pairs.truncate(next_pairs_count);
+
+  std::cout << "pair count = " << next_pairs_count << " (post merge unique)" << std::endl;
 
   profile.tic("stats");
 
@@ -875,91 +1029,36 @@ MemoryMap<dfa_state_pair_t> BinaryDFA::build_quadratic_forward_layer(const DFA&
 
   profile.tic("rename");
 
-  std::string next_pairs_name = memory_map_name(layer + 1, "pairs");
+  std::string next_pairs_name = build_file_name(layer + 1, "pairs");
 
   // atomic swap into place
-  curr_transition_pairs.rename(next_pairs_name);
+  next_pairs.rename(next_pairs_name);
 
   profile.tic("done");
 
-  return curr_transition_pairs;
+  return next_pairs;
 }
 
 MemoryMap<dfa_state_pair_t> BinaryDFA::build_quadratic_read_pairs(int layer)
 {
-  return MemoryMap<dfa_state_pair_t>(memory_map_name(layer, "pairs"));
+  return MemoryMap<dfa_state_pair_t>(build_file_name(layer, "pairs"));
 }
 
-MemoryMap<dfa_state_pair_t> BinaryDFA::build_quadratic_transition_pairs(const DFA& left_in,
-                                                                        const DFA& right_in,
-                                                                        int layer)
+size_t BinaryDFA::get_ram_budget()
 {
-  Profile profile2("build_quadratic_transition_pairs");
-
-  profile2.tic("init");
-
-  int curr_layer_shape = this->get_layer_shape(layer);
-  const MemoryMap<dfa_state_pair_t> curr_pairs = build_quadratic_read_pairs(layer);
-  assert(curr_pairs.size() > 0);
-
-  size_t curr_left_size = left_in.get_layer_size(layer);
-  size_t curr_right_size = right_in.get_layer_size(layer);
-  curr_pairs[curr_pairs.size() - 1].check(curr_left_size, curr_right_size);
-
-  size_t transition_pairs_size = curr_pairs.size() * curr_layer_shape;
-
-  // make sure inputs are memory mapped before going parallel
-  curr_pairs.mmap();
-
-  // read left transitions
-  profile2.tic("left");
-
-  left_in.get_transitions(layer, 0);
-  MemoryMap<dfa_state_t> transition_pairs_left("scratch/binarydfa/transition_pairs_left", transition_pairs_size, [&](size_t transition_index)
-  {
-    size_t curr_i = transition_index / curr_layer_shape;
-    size_t curr_j = transition_index % curr_layer_shape;
-
-    dfa_state_pair_t curr_pair = curr_pairs[curr_i];
-    dfa_state_t curr_left_state = curr_pair.get_left_state();
-    assert(curr_left_state < curr_left_size);
-
-    DFATransitionsReference left_transitions = left_in.get_transitions(layer, curr_left_state);
-    return left_transitions.at(curr_j);
-  });
-
-  // read right transitions
-  profile2.tic("right");
-
-  right_in.get_transitions(layer, 0);
-
-  MemoryMap<dfa_state_pair_t> curr_transition_pairs("scratch/binarydfa/transition_pairs", transition_pairs_size, [&](size_t transition_index)
-  {
-    size_t curr_i = transition_index / curr_layer_shape;
-    size_t curr_j = transition_index % curr_layer_shape;
-
-    dfa_state_pair_t curr_pair = curr_pairs[curr_i];
-    dfa_state_t curr_right_state = curr_pair.get_right_state();
-    assert(curr_right_state < curr_right_size);
-
-    DFATransitionsReference right_transitions = right_in.get_transitions(layer, curr_right_state);
-    return dfa_state_pair_t(transition_pairs_left[transition_index], right_transitions.at(curr_j));
-  });
-
-  // cleanup
-
-  profile2.tic("left unlink");
-
-  transition_pairs_left.unlink();
-
-  profile2.tic("curr pairs munmap");
+  return ram_budget;
+}
 
-  curr_pairs.munmap();
+void BinaryDFA::set_ram_budget(size_t ram_budget_in)
+{
+  assert(ram_budget_in > 0);
+  ram_budget = ram_budget_in;
+}
 
-  // done
-  profile2.tic("done");
-  return curr_transition_pairs;
-};
+std::string BinaryDFA::get_workspace() const
+{
+  return workspace;
+}
 
 std::function<bool(dfa_state_t, dfa_state_t)> BinaryDFA::get_filter_func() const
 {
@@ -6,12 +6,16 @@
 #include <cstdint>
 #include <functional>
 #include <map>
+#include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include "BinaryFunction.h"
 #include "DFA.h"
 
+class MemoryReservation;
+
 class dfa_state_pair_t
 {
   dfa_state_t left;
@@ -97,10 +101,16 @@ class BinaryDFA : public DFA
 {
   BinaryFunction leaf_func;
 
+  // directory holding intermediate files for this build only, so
+  // multiple builds can share scratch/ concurrently.
+  std::string workspace;
+
+  std::string build_file_name(std::string) const;
+  std::string build_file_name(int, std::string) const;
+
   void build_linear(const DFA&, const DFA&);
 
   void build_quadratic(const DFA&, const DFA&);
-  MemoryMap<dfa_state_pair_t> build_quadratic_transition_pairs(const DFA&, const DFA&, int layer);
 
   std::function<bool(dfa_state_t, dfa_state_t)> get_filter_func() const;
   std::function<dfa_state_t(dfa_state_t, dfa_state_t)> get_shortcircuit_func() const;
@@ -108,6 +118,7 @@ class BinaryDFA : public DFA
 protected:
 
   BinaryDFA(const dfa_shape_t&, const BinaryFunction&);
+  BinaryDFA(const dfa_shape_t&, const BinaryFunction&, std::string);
 
   void build_quadratic_backward(const DFA&, const DFA&, int);
   MemoryMap<dfa_state_t> build_quadratic_backward_layer(const DFA&, const DFA&, int, const MemoryMap<dfa_state_t>&);
@@ -120,6 +131,17 @@ protected:
 public:
 
   BinaryDFA(const DFA&, const DFA&, const BinaryFunction&);
+
+  std::string get_workspace() const;
+
+  // RAM budget for in-memory chunks of quadratic builds, reserved
+  // from the shared task memory budget in BoundedTasks. larger layers
+  // are processed as sorted runs merged from scratch files.
+  static size_t get_ram_budget();
+  // reserves the RAM budget for one layer pass, taking less when the
+  // shared budget is mostly held elsewhere.
+  static std::unique_ptr<MemoryReservation> reserve_ram();
+  static void set_ram_budget(size_t);
 };
 
 const int binary_dfa_hash_bytes = 16;
@@ -162,6 +184,9 @@ struct BinaryDFATransitionsHashPlusIndex
   {
     return data[binary_dfa_hash_width - 1];
   }
+
+  // transitions copied if they fit, otherwise hashed, plus the index
+  static BinaryDFATransitionsHashPlusIndex from_transitions(const dfa_state_t *, int, size_t);
 };
 static_assert(sizeof(BinaryDFATransitionsHashPlusIndex) == binary_dfa_hash_bytes);
 
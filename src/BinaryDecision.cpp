@@ -0,0 +1,317 @@
+// BinaryDecision.cpp
+
+#include "BinaryDecision.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <numeric>
+
+#include "BoundedTasks.h"
+#include "MemoryMap.h"
+#include "Profile.h"
+#include "SortedRuns.h"
+#include "parallel.h"
+#include "utils.h"
+
+static std::atomic<int> next_workspace_id = 0;
+
+BinaryDecision::BinaryDecision(const DFA& left_in, const DFA& right_in, const BinaryFunction& leaf_func_in)
+  : left(left_in),
+    right(right_in),
+    leaf_func(leaf_func_in),
+    ndim(left_in.get_shape_size()),
+    characters(left_in.get_shape_size(), 0)
+{
+  Profile profile("BinaryDecision");
+
+  assert(left_in.get_shape() == right_in.get_shape());
+
+  dfa_state_t initial_left = left.get_initial_state();
+  dfa_state_t initial_right = right.get_initial_state();
+  int initial_value = classify(initial_left, initial_right);
+  if(initial_value >= 0)
+    {
+      if(initial_value)
+	{
+	  witness = DFAString(left.get_shape(), characters);
+	}
+      return;
+    }
+
+  left.mmap();
+  right.mmap();
+
+  // without a visited set the probe may repeat pairs, so it is cut
+  // off after as many expansions as the inputs have states.
+
+  profile.tic("probe");
+
+  size_t probe_expansions = left.states() + right.states();
+  if(probe(0, initial_left, initial_right, probe_expansions))
+    {
+      witness = DFAString(left.get_shape(), characters);
+      return;
+    }
+
+  // intermediate files go in a workspace private to this search
+
+  workspace = create_directory("scratch/temp/" + get_process_name() + "-decision-" + std::to_string(next_workspace_id++));
+
+  {
+    MemoryMap<dfa_state_pair_t> initial_pairs(build_file_name(0, "pairs"), size_t(1));
+    initial_pairs[0] = dfa_state_pair_t(initial_left, initial_right);
+  }
+
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      profile.tic("layer=" + std::to_string(layer));
+
+      if(!search_layer(layer))
+	{
+	  break;
+	}
+    }
+
+  profile.tic("cleanup");
+
+  remove_directory(workspace);
+
+  profile.tic("done");
+}
+
+bool BinaryDecision::accepts_any() const
+{
+  return bool(witness);
+}
+
+std::string BinaryDecision::build_file_name(int layer, std::string suffix) const
+{
+  return workspace + "/layer=" + (layer < 10 ? "0" : "") + std::to_string(layer) + "-" + suffix;
+}
+
+int BinaryDecision::classify(dfa_state_t left_state, dfa_state_t right_state) const
+{
+  // value of the product from this pair on when the same shortcircuit
+  // cases as the BinaryDFA forward pass decide it, otherwise -1.
+
+  if((left_state < 2) && (right_state < 2))
+    {
+      return int(leaf_func(left_state, right_state));
+    }
+
+  if(left_state == leaf_func.get_left_sink())
+    {
+      return int(left_state);
+    }
+
+  if(right_state == leaf_func.get_right_sink())
+    {
+      return int(right_state);
+    }
+
+  return -1;
+}
+
+const std::optional<DFAString>& BinaryDecision::get_witness() const
+{
+  return witness;
+}
+
+bool BinaryDecision::probe(int layer, dfa_state_t left_state, dfa_state_t right_state, size_t& expansions_left)
+{
+  // depth first search without a visited set, returning true as soon
+  // as an accepting pair is found with characters holding the witness
+  // prefix, and false once the expansions run out.
+
+  int value = classify(left_state, right_state);
+  if(value >= 0)
+    {
+      if(!value)
+	{
+	  return false;
+	}
+
+      // every suffix is accepted, so pad with the first character.
+      std::fill(characters.begin() + layer, characters.end(), 0);
+      return true;
+    }
+
+  if(expansions_left == 0)
+    {
+      return false;
+    }
+  --expansions_left;
+
+  DFATransitionsReference left_transitions = left.get_transitions(layer, left_state);
+  DFATransitionsReference right_transitions = right.get_transitions(layer, right_state);
+
+  int layer_shape = left.get_layer_shape(layer);
+  for(int c = 0; c < layer_shape; ++c)
+    {
+      characters[layer] = c;
+      if(probe(layer + 1, left_transitions[c], right_transitions[c], expansions_left))
+	{
+	  return true;
+	}
+    }
+
+  return false;
+}
+
+bool BinaryDecision::search_layer(int layer)
+{
+  // expands this layer's pairs in chunks sized to the RAM budget. if
+  // a successor is an accepting pair, the witness is traced back and
+  // the search stops. otherwise undecided successors are sorted and
+  // deduped per chunk, written as runs, and merged into the next
+  // layer's pairs. returns whether the next layer has pairs to
+  // expand.
+
+  Profile profile("search_layer");
+
+  int layer_shape = left.get_layer_shape(layer);
+  MemoryMap<dfa_state_pair_t> curr_pairs(build_file_name(layer, "pairs"));
+  size_t curr_pairs_count = curr_pairs.size();
+  assert(curr_pairs_count > 0);
+
+  // make sure inputs are memory mapped before going parallel
+  curr_pairs.mmap();
+  left.get_transitions(layer, 0);
+  right.get_transitions(layer, 0);
+
+  std::unique_ptr<MemoryReservation> ram_reservation = BinaryDFA::reserve_ram();
+  size_t chunk_pairs = std::min(curr_pairs_count, std::max(ram_reservation->get_memory() / (sizeof(dfa_state_pair_t) * layer_shape), size_t(1)));
+
+  std::vector<dfa_state_pair_t> chunk_buffer;
+  chunk_buffer.reserve(chunk_pairs * layer_shape);
+
+  std::vector<size_t> chunk_iota(chunk_pairs);
+  std::iota(chunk_iota.begin(), chunk_iota.end(), size_t(0));
+
+  size_t pairs_runs = 0;
+  std::vector<MemoryMap<dfa_state_pair_t>> runs;
+  for(size_t chunk_start = 0; chunk_start < curr_pairs_count; chunk_start += chunk_pairs)
+    {
+      size_t chunk_size = std::min(chunk_start + chunk_pairs, curr_pairs_count) - chunk_start;
+
+      profile.tic("chunk populate");
+
+      chunk_buffer.resize(chunk_size * layer_shape);
+      TRY_PARALLEL_3(std::for_each, chunk_iota.begin(), chunk_iota.begin() + chunk_size, [&](size_t i)
+      {
+	dfa_state_pair_t curr_pair = curr_pairs[chunk_start + i];
+	DFATransitionsReference left_transitions = left.get_transitions(layer, curr_pair.get_left_state());
+	DFATransitionsReference right_transitions = right.get_transitions(layer, curr_pair.get_right_state());
+
+	dfa_state_pair_t *pairs_out = chunk_buffer.data() + i * layer_shape;
+	for(int c = 0; c < layer_shape; ++c)
+	  {
+	    pairs_out[c] = dfa_state_pair_t(left_transitions[c], right_transitions[c]);
+	  }
+      });
+
+      profile.tic("chunk accept");
+
+      auto accept_iter = TRY_PARALLEL_3(std::find_if, chunk_buffer.begin(), chunk_buffer.end(), [&](const dfa_state_pair_t& next_pair)
+      {
+	return classify(next_pair.get_left_state(), next_pair.get_right_state()) == 1;
+      });
+      if(accept_iter != chunk_buffer.end())
+	{
+	  size_t accept_index = accept_iter - chunk_buffer.begin();
+
+	  // every suffix is accepted, so pad with the first character.
+	  characters[layer] = int(accept_index % layer_shape);
+	  std::fill(characters.begin() + layer + 1, characters.end(), 0);
+
+	  dfa_state_pair_t accept_parent = curr_pairs[chunk_start + accept_index / layer_shape];
+
+	  profile.tic("trace witness");
+
+	  trace_witness(layer, accept_parent);
+	  witness = DFAString(left.get_shape(), characters);
+	  return false;
+	}
+
+      profile.tic("chunk filter");
+
+      auto chunk_end_iter = TRY_PARALLEL_3(std::remove_if, chunk_buffer.begin(), chunk_buffer.end(), [&](const dfa_state_pair_t& next_pair)
+      {
+	return classify(next_pair.get_left_state(), next_pair.get_right_state()) >= 0;
+      });
+
+      profile.tic("chunk sort");
+
+      TRY_PARALLEL_2(std::sort, chunk_buffer.begin(), chunk_end_iter);
+      chunk_end_iter = TRY_PARALLEL_2(std::unique, chunk_buffer.begin(), chunk_end_iter);
+      chunk_buffer.resize(chunk_end_iter - chunk_buffer.begin());
+      pairs_runs += chunk_buffer.size();
+
+      profile.tic("chunk write");
+
+      if(chunk_buffer.size() > 0)
+	{
+	  runs.emplace_back(build_file_name(layer + 1, "run=" + std::to_string(runs.size())), chunk_buffer);
+	}
+    }
+
+  if(pairs_runs == 0)
+    {
+      return false;
+    }
+
+  // release chunk memory before merging
+  chunk_buffer = std::vector<dfa_state_pair_t>();
+  curr_pairs.munmap();
+
+  profile.tic("merge");
+
+  MemoryMap<dfa_state_pair_t> next_pairs(build_file_name(layer + 1, "pairs_merged"), pairs_runs);
+  size_t next_pairs_count = 0;
+  merge_sorted_runs<dfa_state_pair_t>(runs, [&](const dfa_state_pair_t& next_pair)
+  {
+    if((next_pairs_count == 0) || !(next_pairs[next_pairs_count - 1] == next_pair))
+      {
+	next_pairs[next_pairs_count++] = next_pair;
+      }
+  });
+
+  next_pairs.munmap();
+  next_pairs.truncate(next_pairs_count);
+  next_pairs.rename(build_file_name(layer + 1, "pairs"));
+
+  return true;
+}
+
+void BinaryDecision::trace_witness(int layer, dfa_state_pair_t target_pair)
+{
+  // walks back from the parent of the accepting pair, finding a pair
+  // and character reaching the current target in each earlier
+  // layer's pairs.
+
+  for(int previous_layer = layer - 1; previous_layer >= 0; --previous_layer)
+    {
+      MemoryMap<dfa_state_pair_t> previous_pairs(build_file_name(previous_layer, "pairs"));
+      int previous_shape = left.get_layer_shape(previous_layer);
+
+      bool found = false;
+      for(size_t i = 0; (i < previous_pairs.size()) && !found; ++i)
+	{
+	  dfa_state_pair_t previous_pair = previous_pairs[i];
+	  DFATransitionsReference left_transitions = left.get_transitions(previous_layer, previous_pair.get_left_state());
+	  DFATransitionsReference right_transitions = right.get_transitions(previous_layer, previous_pair.get_right_state());
+	  for(int c = 0; c < previous_shape; ++c)
+	    {
+	      if(dfa_state_pair_t(left_transitions[c], right_transitions[c]) == target_pair)
+		{
+		  characters[previous_layer] = c;
+		  target_pair = previous_pair;
+		  found = true;
+		  break;
+		}
+	    }
+	}
+      assert(found);
+    }
+}
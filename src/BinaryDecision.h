@@ -0,0 +1,49 @@
+// BinaryDecision.h
+
+#ifndef BINARY_DECISION_H
+#define BINARY_DECISION_H
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "BinaryDFA.h"
+#include "BinaryFunction.h"
+#include "DFA.h"
+
+// decides whether the product of two DFAs under a binary function
+// accepts anything, without building the product. a short depth
+// first probe catches easy witnesses. otherwise reachable pairs are
+// expanded a layer at a time like the BinaryDFA forward pass, and
+// the search stops at the first layer reaching an accepting pair.
+// the accepted string found is kept as a witness.
+
+class BinaryDecision
+{
+  const DFA& left;
+  const DFA& right;
+  BinaryFunction leaf_func;
+
+  int ndim;
+  std::vector<int> characters;
+
+  // directory holding each layer's pairs for this search only
+  std::string workspace;
+
+  std::optional<DFAString> witness;
+
+  std::string build_file_name(int, std::string) const;
+  int classify(dfa_state_t, dfa_state_t) const;
+  bool probe(int, dfa_state_t, dfa_state_t, size_t&);
+  bool search_layer(int);
+  void trace_witness(int, dfa_state_pair_t);
+
+public:
+
+  BinaryDecision(const DFA&, const DFA&, const BinaryFunction&);
+
+  bool accepts_any() const;
+  const std::optional<DFAString>& get_witness() const;
+};
+
+#endif
@@ -0,0 +1,109 @@
+// BinaryEstimate.cpp
+
+#include "BinaryEstimate.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+
+static uint64_t mix_pair_key(uint64_t pair_key)
+{
+  // splitmix64 finalizer so the sample is not biased by state order.
+
+  pair_key ^= pair_key >> 30;
+  pair_key *= 0xbf58476d1ce4e5b9ULL;
+  pair_key ^= pair_key >> 27;
+  pair_key *= 0x94d049bb133111ebULL;
+  pair_key ^= pair_key >> 31;
+  return pair_key;
+}
+
+BinaryEstimate::BinaryEstimate(const DFA& left_in, const DFA& right_in, const BinaryFunction& leaf_func, size_t sample_max)
+{
+  assert(left_in.get_shape() == right_in.get_shape());
+  assert(sample_max > 0);
+
+  int ndim = left_in.get_shape_size();
+
+  dfa_state_t left_sink = leaf_func.get_left_sink();
+  dfa_state_t right_sink = leaf_func.get_right_sink();
+  auto filter_func = [=](dfa_state_t left_state, dfa_state_t right_state)
+  {
+    // same shortcircuit cases as the BinaryDFA forward pass
+    return (((left_state < 2) && (right_state < 2)) ||
+	    (left_state == left_sink) ||
+	    (right_state == right_sink));
+  };
+
+  std::vector<uint64_t> curr_pairs;
+  double scale = 1.0;
+
+  dfa_state_t initial_left = left_in.get_initial_state();
+  dfa_state_t initial_right = right_in.get_initial_state();
+  if(!filter_func(initial_left, initial_right))
+    {
+      curr_pairs.push_back((uint64_t(initial_left) << 32) | uint64_t(initial_right));
+    }
+
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      double product_bound = double(left_in.get_layer_size(layer)) * double(right_in.get_layer_size(layer));
+      layer_pairs.push_back(std::min(double(curr_pairs.size()) * scale, product_bound));
+
+      if((layer + 1 >= ndim) || (curr_pairs.size() == 0))
+	{
+	  continue;
+	}
+
+      int layer_shape = left_in.get_layer_shape(layer);
+
+      std::unordered_set<uint64_t> next_pairs_set;
+      for(uint64_t pair_key : curr_pairs)
+	{
+	  DFATransitionsReference left_transitions = left_in.get_transitions(layer, dfa_state_t(pair_key >> 32));
+	  DFATransitionsReference right_transitions = right_in.get_transitions(layer, dfa_state_t(pair_key));
+	  for(int c = 0; c < layer_shape; ++c)
+	    {
+	      dfa_state_t left_next = left_transitions[c];
+	      dfa_state_t right_next = right_transitions[c];
+	      if(!filter_func(left_next, right_next))
+		{
+		  next_pairs_set.insert((uint64_t(left_next) << 32) | uint64_t(right_next));
+		}
+	    }
+	}
+
+      std::vector<uint64_t> next_pairs(next_pairs_set.begin(), next_pairs_set.end());
+      if(next_pairs.size() > sample_max)
+	{
+	  // keep the pairs with the smallest hashes
+	  std::nth_element(next_pairs.begin(), next_pairs.begin() + sample_max, next_pairs.end(), [](uint64_t a, uint64_t b)
+	  {
+	    return mix_pair_key(a) < mix_pair_key(b);
+	  });
+
+	  scale *= double(next_pairs.size()) / double(sample_max);
+	  next_pairs.resize(sample_max);
+	}
+
+      curr_pairs.swap(next_pairs);
+    }
+
+  assert(layer_pairs.size() == size_t(ndim));
+}
+
+double BinaryEstimate::get_layer_pairs(int layer) const
+{
+  return layer_pairs.at(layer);
+}
+
+double BinaryEstimate::get_total_pairs() const
+{
+  double total = 0.0;
+  for(double pairs : layer_pairs)
+    {
+      total += pairs;
+    }
+
+  return total;
+}
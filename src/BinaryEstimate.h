@@ -0,0 +1,31 @@
+// BinaryEstimate.h
+
+#ifndef BINARY_ESTIMATE_H
+#define BINARY_ESTIMATE_H
+
+#include <vector>
+
+#include "BinaryFunction.h"
+#include "DFA.h"
+
+// estimates the reachable pairs per layer of a binary product DFA
+// with a sampled forward pass. layers are expanded exactly until
+// they exceed the sample size, then only the sampled pairs with the
+// smallest hashes are expanded, scaled up by the sampling rate. the
+// scaling ignores successors shared with unsampled pairs, so the
+// estimates lean high, and each layer is capped by the product of
+// the input layer sizes.
+
+class BinaryEstimate
+{
+  std::vector<double> layer_pairs;
+
+public:
+
+  BinaryEstimate(const DFA&, const DFA&, const BinaryFunction&, size_t);
+
+  double get_layer_pairs(int) const;
+  double get_total_pairs() const;
+};
+
+#endif
@@ -9,10 +9,14 @@
 
 BinaryRestartDFA::BinaryRestartDFA(const DFA& left_in,
                                    const DFA& right_in,
-                                   const BinaryFunction& leaf_func_in)
-  : BinaryDFA(left_in.get_shape(), leaf_func_in)
+                                   const BinaryFunction& leaf_func_in,
+                                   std::string workspace_in)
+  : BinaryDFA(left_in.get_shape(), leaf_func_in, workspace_in)
 {
-  // assume binarydfa directory has pairs from other DFAs cleared.
+  // assume workspace has pairs from an interrupted build of the same
+  // inputs.
+
+  std::cout << "restart: workspace = " << workspace_in << std::endl;
 
   int ndim = get_shape_size();
 
@@ -3,6 +3,8 @@
 #ifndef BINARY_RESTART_DFA_H
 #define BINARY_RESTART_DFA_H
 
+#include <string>
+
 #include "BinaryDFA.h"
 #include "DFA.h"
 
@@ -10,7 +12,7 @@ class BinaryRestartDFA : public BinaryDFA
 {
  protected:
 
-  BinaryRestartDFA(const DFA&, const DFA&, const BinaryFunction&);
+  BinaryRestartDFA(const DFA&, const DFA&, const BinaryFunction&, std::string);
 };
 
 #endif
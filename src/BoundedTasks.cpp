@@ -0,0 +1,251 @@
+// BoundedTasks.cpp
+
+#include "BoundedTasks.h"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+#ifndef BOUNDED_TASKS_MEMORY_BUDGET
+#define BOUNDED_TASKS_MEMORY_BUDGET (size_t(4) << 30)
+#endif
+
+static size_t memory_budget = BOUNDED_TASKS_MEMORY_BUDGET;
+static size_t workers = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+// process-wide accounting. worker slots count tasks running on their
+// own threads. memory counts every top-level reservation.
+
+static std::mutex slots_mutex;
+static size_t slots_running = 0;
+static size_t slots_memory = 0;
+
+// reservation of the task running on this thread, if any
+static thread_local MemoryReservation *current_reservation = 0;
+
+MemoryReservation::MemoryReservation(size_t memory_in, MemoryReservation *parent_in, bool slot_in)
+  : memory(memory_in),
+    available(memory_in),
+    parent(parent_in),
+    slot(slot_in)
+{
+}
+
+MemoryReservation::~MemoryReservation()
+{
+  std::lock_guard<std::mutex> slots_lock(slots_mutex);
+
+  assert(available == memory);
+
+  if(parent)
+    {
+      parent->available += memory;
+      return;
+    }
+
+  slots_memory -= memory;
+  if(slot)
+    {
+      slots_running -= 1;
+    }
+}
+
+BoundedTasks::BoundedTasks(size_t max_running_in)
+  : max_running(max_running_in)
+{
+  assert(max_running >= 1);
+}
+
+BoundedTasks::~BoundedTasks()
+{
+  // tasks reference their scheduler, so let them finish
+  for(auto& [task_id, output] : running)
+    {
+      output.wait();
+    }
+}
+
+bool BoundedTasks::try_launch(size_t task_id, size_t memory_in, std::function<shared_dfa_ptr()> task_func)
+{
+  assert(!running.contains(task_id));
+
+  if(running.size() >= max_running)
+    {
+      return false;
+    }
+
+  std::unique_ptr<MemoryReservation> reservation;
+  {
+    std::lock_guard<std::mutex> slots_lock(slots_mutex);
+    if((slots_running < workers) && (slots_memory + memory_in <= memory_budget))
+      {
+	slots_running += 1;
+	slots_memory += memory_in;
+	reservation = std::unique_ptr<MemoryReservation>(new MemoryReservation(memory_in, 0, true));
+      }
+  }
+
+  if(!reservation && (running.size() > 0))
+    {
+      return false;
+    }
+
+  auto run_task = [this, task_id, task_func](std::unique_ptr<MemoryReservation> task_reservation)
+  {
+    MemoryReservation *previous_reservation = current_reservation;
+    current_reservation = task_reservation.get();
+
+    auto notify = [&]()
+    {
+      current_reservation = previous_reservation;
+      task_reservation.reset();
+
+      std::lock_guard<std::mutex> finished_lock(finished_mutex);
+      finished.push_back(task_id);
+      finished_cv.notify_one();
+    };
+
+    try
+      {
+	shared_dfa_ptr output = task_func();
+	notify();
+	return output;
+      }
+    catch(...)
+      {
+	notify();
+	throw;
+      }
+  };
+
+  if(reservation)
+    {
+      running[task_id] = std::async(std::launch::async, run_task, std::move(reservation));
+      return true;
+    }
+
+  // nothing of ours is running, so run it here without a slot
+  std::unique_ptr<MemoryReservation> inline_reservation = reserve_memory(memory_in, memory_in);
+  running[task_id] = std::async(std::launch::deferred, run_task, std::move(inline_reservation));
+  running[task_id].wait();
+  return true;
+}
+
+std::vector<std::pair<size_t, shared_dfa_ptr>> BoundedTasks::wait_any()
+{
+  assert(running.size() > 0);
+
+  std::vector<size_t> tasks_done;
+  {
+    std::unique_lock<std::mutex> finished_lock(finished_mutex);
+    finished_cv.wait(finished_lock, [&]() {return finished.size() > 0;});
+    std::swap(tasks_done, finished);
+  }
+
+  std::vector<std::pair<size_t, shared_dfa_ptr>> outputs;
+  for(size_t task_id : tasks_done)
+    {
+      std::future<shared_dfa_ptr> output = std::move(running.at(task_id));
+      running.erase(task_id);
+
+      try
+	{
+	  outputs.emplace_back(task_id, output.get());
+	}
+      catch(...)
+	{
+	  // let running tasks finish before passing on the error
+	  for(auto& [other_id, other_output] : running)
+	    {
+	      other_output.wait();
+	    }
+	  running.clear();
+	  throw;
+	}
+    }
+
+  return outputs;
+}
+
+std::vector<shared_dfa_ptr> BoundedTasks::map(const std::vector<size_t>& memory_in,
+					      std::function<shared_dfa_ptr(size_t)> task_func,
+					      size_t max_running_in)
+{
+  std::vector<shared_dfa_ptr> outputs(memory_in.size());
+
+  BoundedTasks tasks(max_running_in);
+  auto finish_some = [&]()
+  {
+    for(auto& [task_id, output] : tasks.wait_any())
+      {
+	outputs[task_id] = output;
+      }
+  };
+
+  for(size_t i = 0; i < memory_in.size(); ++i)
+    {
+      while(!tasks.try_launch(i, memory_in[i], [&task_func, i]() {return task_func(i);}))
+	{
+	  finish_some();
+	}
+    }
+
+  while(tasks.size() > 0)
+    {
+      finish_some();
+    }
+
+  return outputs;
+}
+
+std::unique_ptr<MemoryReservation> BoundedTasks::reserve_memory(size_t memory_max, size_t memory_min)
+{
+  assert(memory_min <= memory_max);
+
+  std::lock_guard<std::mutex> slots_lock(slots_mutex);
+
+  // sequential work inside a task shares the task's reservation
+  if(current_reservation && (current_reservation->available >= memory_min))
+    {
+      size_t memory = std::min(memory_max, current_reservation->available);
+      current_reservation->available -= memory;
+      return std::unique_ptr<MemoryReservation>(new MemoryReservation(memory, current_reservation, false));
+    }
+
+  size_t memory_free = (slots_memory < memory_budget) ? memory_budget - slots_memory : 0;
+  size_t memory = std::min(memory_max, std::max(memory_free, memory_min));
+  slots_memory += memory;
+  return std::unique_ptr<MemoryReservation>(new MemoryReservation(memory, 0, false));
+}
+
+size_t BoundedTasks::get_dfa_bytes(shared_dfa_ptr dfa_in)
+{
+  // ignoring the constant states
+  size_t output = 0;
+  for(int layer = 0; layer < dfa_in->get_shape_size(); ++layer)
+    {
+      output += dfa_in->get_layer_size(layer) * size_t(dfa_in->get_layer_shape(layer)) * sizeof(dfa_state_t);
+    }
+  return output;
+}
+
+size_t BoundedTasks::get_memory_budget()
+{
+  return memory_budget;
+}
+
+size_t BoundedTasks::get_workers()
+{
+  return workers;
+}
+
+void BoundedTasks::set_memory_budget(size_t memory_budget_in)
+{
+  memory_budget = memory_budget_in;
+}
+
+void BoundedTasks::set_workers(size_t workers_in)
+{
+  assert(workers_in >= 1);
+  workers = workers_in;
+}
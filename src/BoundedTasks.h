@@ -0,0 +1,95 @@
+// BoundedTasks.h
+
+#ifndef BOUNDED_TASKS_H
+#define BOUNDED_TASKS_H
+
+// DFA tasks run concurrently under one process-wide limit on worker
+// threads and on the sum of the tasks' estimated memory. every
+// scheduler (reductions, clause evaluation, move graph nodes, shard
+// maps) draws from the same slots, so nesting them does not multiply
+// the limits.
+//
+// a task that does not fit runs on the calling thread once none of
+// its scheduler's tasks are running. nested schedulers thus always
+// make progress without extra threads, and their memory is still
+// counted against the budget so other schedulers back off.
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "DFA.h"
+
+class MemoryReservation
+{
+  size_t memory;
+  // bytes not lent to reservations carved from this one
+  size_t available;
+  // reservation this one was carved from, if any
+  MemoryReservation *parent;
+  // whether this reservation also holds a worker slot
+  bool slot;
+
+  MemoryReservation(size_t, MemoryReservation *, bool);
+
+  friend class BoundedTasks;
+
+ public:
+
+  MemoryReservation(const MemoryReservation&) = delete;
+  MemoryReservation& operator=(const MemoryReservation&) = delete;
+  ~MemoryReservation();
+
+  size_t get_memory() const {return memory;}
+};
+
+class BoundedTasks
+{
+  size_t max_running;
+
+  std::mutex finished_mutex;
+  std::condition_variable finished_cv;
+  std::vector<size_t> finished;
+
+  std::map<size_t, std::future<shared_dfa_ptr>> running;
+
+ public:
+
+  explicit BoundedTasks(size_t max_running_in = SIZE_MAX);
+  BoundedTasks(const BoundedTasks&) = delete;
+  BoundedTasks& operator=(const BoundedTasks&) = delete;
+  ~BoundedTasks();
+
+  // starts the task if it fits, returning false if it has to wait
+  // for a running task of this scheduler.
+  bool try_launch(size_t, size_t, std::function<shared_dfa_ptr()>);
+  // waits for at least one task to finish, returning (id, output)
+  // pairs. if a task failed, waits for the rest and rethrows.
+  std::vector<std::pair<size_t, shared_dfa_ptr>> wait_any();
+  size_t size() const {return running.size();}
+
+  // runs task_func(i) for every i with the given memory estimates,
+  // starting tasks in index order.
+  static std::vector<shared_dfa_ptr> map(const std::vector<size_t>&, std::function<shared_dfa_ptr(size_t)>, size_t = SIZE_MAX);
+
+  // reserves up to the first argument bytes of memory without
+  // waiting, taking at least the second argument. a reservation taken
+  // while a task runs is carved from that task's reservation first.
+  static std::unique_ptr<MemoryReservation> reserve_memory(size_t, size_t);
+
+  // transition table bytes of a DFA, for estimating task memory
+  static size_t get_dfa_bytes(shared_dfa_ptr);
+
+  static size_t get_memory_budget();
+  static size_t get_workers();
+  static void set_memory_budget(size_t);
+  static void set_workers(size_t);
+};
+
+#endif
@@ -3,6 +3,9 @@
 #ifndef BREAKTHROUGH_GAME_H
 #define BREAKTHROUGH_GAME_H
 
+#include <string>
+#include <vector>
+
 #include "NormalPlayGame.h"
 
 class BreakthroughBase
@@ -13,15 +16,19 @@ protected:
   int width;
   int height;
 
-  BreakthroughBase(std::string, int, int);
+  // layer of each square, indexed by row * width + column
+  std::vector<int> square_layers;
+
+  BreakthroughBase(std::string, int, int, const std::vector<int>&);
 
   virtual shared_dfa_ptr build_positions_reversed(shared_dfa_ptr) const;
-  virtual int calculate_layer(int row, int column) const = 0;
+  int calculate_layer(int row, int column) const;
 
 public:
 
   virtual MoveGraph build_move_graph(int) const;
   virtual DFAString get_position_initial() const;
+  virtual std::vector<std::vector<int>> get_symmetries() const;
   virtual std::string position_to_string(const DFAString&) const;
 
   // validation
@@ -32,22 +39,25 @@ public:
 class BreakthroughColumnWiseGame
   : public BreakthroughBase
 {
-protected:
-
-  virtual int calculate_layer(int row, int column) const;
-
 public:
 
     BreakthroughColumnWiseGame(int, int);
 };
 
-class BreakthroughRowWiseGame
+// squares mapped to layers as given, for example to adopt an order
+// found by optimize_layers. named breakthrough_WxH,layers=L0_L1_...
+// listing the layer of each square in row-major order.
+class BreakthroughLayeredGame
   : public BreakthroughBase
 {
-protected:
+public:
 
-  virtual int calculate_layer(int row, int column) const;
+  BreakthroughLayeredGame(int, int, const std::vector<int>&);
+};
 
+class BreakthroughRowWiseGame
+  : public BreakthroughBase
+{
 public:
 
   BreakthroughRowWiseGame(int, int);
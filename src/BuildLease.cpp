@@ -0,0 +1,174 @@
+// BuildLease.cpp
+
+#include "BuildLease.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "utils.h"
+
+#ifndef BUILD_LEASE_HEARTBEAT_SECONDS
+#define BUILD_LEASE_HEARTBEAT_SECONDS 10
+#endif
+
+#ifndef BUILD_LEASE_TIMEOUT_SECONDS
+#define BUILD_LEASE_TIMEOUT_SECONDS 120
+#endif
+
+static std::atomic<int> heartbeat_seconds = BUILD_LEASE_HEARTBEAT_SECONDS;
+static std::atomic<int> timeout_seconds = BUILD_LEASE_TIMEOUT_SECONDS;
+
+BuildLease::BuildLease(std::string path_in)
+  : path(path_in),
+    released(false),
+    heartbeat_thread(&BuildLease::heartbeat, this)
+{
+}
+
+BuildLease::~BuildLease()
+{
+  {
+    std::lock_guard<std::mutex> heartbeat_lock(heartbeat_mutex);
+    released = true;
+  }
+  heartbeat_condition.notify_all();
+  heartbeat_thread.join();
+
+  if(unlink(path.c_str()) && (errno != ENOENT))
+    {
+      perror(("BuildLease unlink " + path).c_str());
+    }
+}
+
+int BuildLease::get_heartbeat_seconds()
+{
+  return heartbeat_seconds;
+}
+
+int BuildLease::get_timeout_seconds()
+{
+  return timeout_seconds;
+}
+
+void BuildLease::heartbeat()
+{
+  std::unique_lock<std::mutex> heartbeat_lock(heartbeat_mutex);
+  while(!heartbeat_condition.wait_for(heartbeat_lock,
+				      std::chrono::seconds(heartbeat_seconds),
+				      [&]() {return released;}))
+    {
+      if(utimensat(AT_FDCWD, path.c_str(), 0, 0))
+	{
+	  // another process took the lease over, so the build will be
+	  // duplicated but stays correct since saves are atomic.
+	  perror(("BuildLease heartbeat " + path).c_str());
+	}
+    }
+}
+
+bool BuildLease::is_stale(std::string path_in)
+{
+  struct stat lease_stat;
+  if(stat(path_in.c_str(), &lease_stat))
+    {
+      // already released
+      return errno == ENOENT;
+    }
+
+  std::ifstream lease_file(path_in);
+  std::string holder;
+  if((lease_file >> holder) && is_dead_process(holder))
+    {
+      return true;
+    }
+
+  // covers holders on other hosts, and holders that died between
+  // creating the lock file and writing their name into it.
+  return time(0) - lease_stat.st_mtime > timeout_seconds;
+}
+
+void BuildLease::set_heartbeat_seconds(int heartbeat_seconds_in)
+{
+  assert(heartbeat_seconds_in >= 1);
+  heartbeat_seconds = heartbeat_seconds_in;
+}
+
+void BuildLease::set_timeout_seconds(int timeout_seconds_in)
+{
+  assert(timeout_seconds_in >= 0);
+  timeout_seconds = timeout_seconds_in;
+}
+
+std::unique_ptr<BuildLease> BuildLease::try_acquire(std::string path_in)
+{
+  // returns the lease, or NULL if another live process holds it.
+
+  for(int attempt = 0; attempt < 2; ++attempt)
+    {
+      int fildes = open(path_in.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0600);
+      if(fildes >= 0)
+	{
+	  std::string holder = get_process_name() + "\n";
+	  if(write(fildes, holder.c_str(), holder.size()) != ssize_t(holder.size()))
+	    {
+	      perror("BuildLease write");
+	      close(fildes);
+	      unlink(path_in.c_str());
+	      throw std::runtime_error("BuildLease write failed");
+	    }
+	  close(fildes);
+
+	  return std::unique_ptr<BuildLease>(new BuildLease(path_in));
+	}
+
+      if(errno != EEXIST)
+	{
+	  perror(("BuildLease open " + path_in).c_str());
+	  throw std::runtime_error("BuildLease open failed");
+	}
+
+      struct stat stale_stat;
+      if(stat(path_in.c_str(), &stale_stat) == 0)
+	{
+	  if(!is_stale(path_in))
+	    {
+	      return std::unique_ptr<BuildLease>();
+	    }
+
+	  // move the stale lease aside before removing it. if a fresh
+	  // lease replaced it in the meantime, put that one back.
+
+	  std::string stale_path = path_in + "." + get_process_name() + ".stale";
+	  if(rename(path_in.c_str(), stale_path.c_str()) == 0)
+	    {
+	      struct stat moved_stat;
+	      if(stat(stale_path.c_str(), &moved_stat) == 0)
+		{
+		  if(moved_stat.st_ino != stale_stat.st_ino)
+		    {
+		      // fails if yet another lease was created
+		      link(stale_path.c_str(), path_in.c_str());
+		    }
+		  else
+		    {
+		      std::cout << "taking over stale lease " << path_in << std::endl;
+		    }
+		}
+	      unlink(stale_path.c_str());
+	    }
+	}
+    }
+
+  return std::unique_ptr<BuildLease>();
+}
@@ -0,0 +1,48 @@
+// BuildLease.h
+
+#ifndef BUILD_LEASE_H
+#define BUILD_LEASE_H
+
+// exclusive lease on building something under scratch/, shared by all
+// processes using it, including processes on other machines mounting
+// the same volume.
+//
+// the lease is a lock file holding the holder's process name (see
+// get_process_name). the holder touches it every heartbeat, so leases
+// of dead processes are recognized either directly on the same host,
+// or by a heartbeat older than the timeout from other hosts.
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class BuildLease
+{
+  std::string path;
+
+  std::mutex heartbeat_mutex;
+  std::condition_variable heartbeat_condition;
+  bool released;
+  std::thread heartbeat_thread;
+
+  BuildLease(std::string);
+
+  void heartbeat();
+
+ public:
+
+  BuildLease(const BuildLease&) = delete;
+  BuildLease& operator=(const BuildLease&) = delete;
+  ~BuildLease();
+
+  static int get_heartbeat_seconds();
+  static int get_timeout_seconds();
+  static bool is_stale(std::string);
+  static void set_heartbeat_seconds(int);
+  static void set_timeout_seconds(int);
+  static std::unique_ptr<BuildLease> try_acquire(std::string);
+};
+
+#endif
@@ -0,0 +1,193 @@
+// CanonicalDFA.cpp
+
+// logical states track, for each permutation, the comparisons of the
+// string with its image that are not settled yet. comparisons run in
+// layer order, so a permutation is settled by its first unequal
+// comparison once every earlier comparison is known to be equal.
+
+#include "CanonicalDFA.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "Profile.h"
+
+#ifndef CANONICAL_DFA_PENDING_MAX
+#define CANONICAL_DFA_PENDING_MAX 16
+#endif
+
+CanonicalDFA::CanonicalDFA(const dfa_shape_t& shape_in, const std::vector<std::vector<int>>& permutations_in)
+  : DedupedDFA(shape_in, dfa_in_memory_t())
+{
+  Profile profile("CanonicalDFA");
+
+  int ndim = get_shape_size();
+
+  // image[layer] = string[inverse[layer]]
+
+  std::vector<std::vector<int>> inverses;
+  for(const std::vector<int>& permutation : permutations_in)
+    {
+      assert(permutation.size() == ndim);
+
+      std::vector<int> inverse(ndim, -1);
+      for(int layer = 0; layer < ndim; ++layer)
+	{
+	  assert(inverse.at(permutation[layer]) == -1);
+	  assert(shape_in[permutation[layer]] == shape_in[layer]);
+	  inverse[permutation[layer]] = layer;
+	}
+      inverses.push_back(inverse);
+    }
+
+  // scans the comparisons of one permutation that are known after
+  // the first layer_max characters, appending the pending ones to
+  // key_out.
+
+  enum scan_result_t {scan_greater, scan_pending, scan_settled};
+
+  auto scan = [&](const std::vector<int>& inverse, const std::vector<int>& prefix, int layer_max, std::vector<int>& key_out)
+  {
+    int pending_known = 0;
+    bool blocked = false;
+
+    for(int j = 0; j < ndim; ++j)
+      {
+	int k = inverse[j];
+	if(k == j)
+	  {
+	    continue;
+	  }
+
+	bool j_known = j < layer_max;
+	bool k_known = k < layer_max;
+
+	if(j_known && k_known)
+	  {
+	    if(prefix[j] == prefix[k])
+	      {
+		continue;
+	      }
+
+	    if(!blocked)
+	      {
+		return (prefix[j] < prefix[k]) ? scan_settled : scan_greater;
+	      }
+
+	    // decides once the earlier comparisons are known equal
+	    key_out.push_back(j);
+	    key_out.push_back(prefix[j] < prefix[k]);
+	    return scan_pending;
+	  }
+
+	blocked = true;
+
+	if(j_known || k_known)
+	  {
+	    if(++pending_known > CANONICAL_DFA_PENDING_MAX)
+	      {
+		// give up on this permutation
+		return scan_settled;
+	      }
+
+	    key_out.push_back(j);
+	    key_out.push_back(j_known ? 2 + prefix[j] : -3 - prefix[k]);
+	  }
+      }
+
+    return blocked ? scan_pending : scan_settled;
+  };
+
+  // key summarizing the pending comparisons of each permutation after
+  // the given prefix. returns false if the prefix is already greater
+  // than an image. a permutation stays settled once it is, so giving
+  // up is consistent across the layers.
+
+  static const int key_separator = -1;
+  static const int key_settled = -2;
+
+  std::vector<int> scan_scratch;
+  auto get_key = [&](const std::vector<int>& prefix, std::vector<int>& key_out)
+  {
+    int layer = int(prefix.size());
+
+    key_out.clear();
+    for(const std::vector<int>& inverse : inverses)
+      {
+	scan_result_t result = scan_pending;
+	for(int layer_max = 1; (layer_max < layer) && (result == scan_pending); ++layer_max)
+	  {
+	    scan_scratch.clear();
+	    result = scan(inverse, prefix, layer_max, scan_scratch);
+	  }
+	if(result == scan_pending)
+	  {
+	    result = scan(inverse, prefix, layer, key_out);
+	  }
+
+	if(result == scan_greater)
+	  {
+	    return false;
+	  }
+	else if(result == scan_settled)
+	  {
+	    // drop any partial output of the last scan
+	    while(key_out.size() && (key_out.back() != key_separator))
+	      {
+		key_out.pop_back();
+	      }
+	    key_out.push_back(key_settled);
+	  }
+	key_out.push_back(key_separator);
+      }
+
+    return true;
+  };
+
+  std::vector<std::map<std::vector<int>, dfa_state_t>> states_by_key(ndim);
+  std::vector<int> prefix;
+
+  std::function<dfa_state_t()> build_state = [&]()
+  {
+    std::vector<int> key;
+    if(!get_key(prefix, key))
+      {
+	return dfa_state_t(0);
+      }
+
+    int layer = int(prefix.size());
+    if(layer == ndim)
+      {
+	return dfa_state_t(1);
+      }
+
+    if(size_t(std::count(key.begin(), key.end(), key_settled)) == inverses.size())
+      {
+	return dfa_state_t(1);
+      }
+
+    auto search = states_by_key[layer].find(key);
+    if(search != states_by_key[layer].end())
+      {
+	return search->second;
+      }
+
+    int layer_shape = get_layer_shape(layer);
+    DFATransitionsStaging next_states(layer_shape);
+    for(int c = 0; c < layer_shape; ++c)
+      {
+	prefix.push_back(c);
+	next_states[c] = build_state();
+	prefix.pop_back();
+      }
+
+    dfa_state_t new_state = add_state(layer, next_states);
+    states_by_key[layer][key] = new_state;
+    return new_state;
+  };
+
+  set_initial_state(build_state());
+}
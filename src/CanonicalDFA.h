@@ -0,0 +1,23 @@
+// CanonicalDFA.h
+
+#ifndef CANONICAL_DFA_H
+#define CANONICAL_DFA_H
+
+#include <vector>
+
+#include "DedupedDFA.h"
+
+// accepts the strings that are lexicographically no greater than their
+// images under every layer permutation given, so each orbit of the
+// group keeps its minimum. comparisons still pending after too many
+// known characters are given up, which can accept extra orbit members
+// but keeps the DFA small.
+
+class CanonicalDFA : public DedupedDFA
+{
+ public:
+
+  CanonicalDFA(const dfa_shape_t&, const std::vector<std::vector<int>>&);
+};
+
+#endif
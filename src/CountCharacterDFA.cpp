@@ -23,7 +23,7 @@ CountCharacterDFA::CountCharacterDFA(const dfa_shape_t& shape_in, int c_in, int
 }
 
 CountCharacterDFA::CountCharacterDFA(const dfa_shape_t& shape_in, int c_in, int count_min, int count_max, int layer_min, int layer_max)
-  : DedupedDFA(shape_in)
+  : DedupedDFA(shape_in, dfa_in_memory_t())
 {
   int ndim = get_shape_size();
 
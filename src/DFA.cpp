@@ -1,17 +1,18 @@
 // DFA.cpp
 
 #include <assert.h>
-#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
 #include <stdio.h>
-#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <iomanip>
+#include <mutex>
 #include <numeric>
 #include <ranges>
 #include <sstream>
@@ -22,67 +23,63 @@
 #include "parallel.h"
 #include "utils.h"
 
-static int next_dfa_id = 0;
+static std::atomic<int> next_dfa_id = 0;
+static std::atomic<int> next_link_id = 0;
 
-std::vector<std::string> get_layer_file_names(int ndim, std::string directory)
-{
-  std::vector<std::string> output;
+const std::string DFA::name_index_filename = "scratch/name_index";
 
-  for(int layer = 0; layer < ndim; ++layer)
+static std::string hash_to_string(const unsigned char *hash_output)
+{
+  std::stringstream ss;
+  for(int i = 0; i < SHA256_DIGEST_LENGTH; i++)
     {
-      output.push_back(directory + "/layer=" + std::to_string(layer));
+      ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash_output[i];
     }
 
-  return output;
+  return ss.str();
 }
 
-std::string create_directory(std::string directory)
+static std::string calculate_complement_hash(std::string base_hash)
 {
-  mkdir(directory.c_str(), 0700);
-  return directory;
+  // complement hashes are derived from the base hash so complements
+  // never need their layers hashed.
+
+  assert(base_hash.length() == 64);
+
+  std::string hash_input = "complement/" + base_hash;
+
+  unsigned char hash_output[SHA256_DIGEST_LENGTH];
+  EVP_Digest(hash_input.data(), hash_input.size(), hash_output, 0, EVP_sha256(), NULL);
+
+  return hash_to_string(hash_output);
 }
 
-void remove_directory(std::string directory)
+static bool is_complement_directory(std::string directory)
 {
-  DIR *dir = opendir(directory.c_str());
-  if(dir)
-    {
-      // DFA was previously saved with this name?
-
-      for(struct dirent *dirent = readdir(dir);
-	  dirent;
-	  dirent = readdir(dir))
-	{
-	  if(strncmp(dirent->d_name, ".", sizeof(dirent->d_name)) &&
-	     strncmp(dirent->d_name, "..", sizeof(dirent->d_name)))
-	    {
-	      std::string old_file_name = directory + "/" + dirent->d_name;
-	      int unlink_ret = unlink(old_file_name.c_str());
-	      if(unlink_ret)
-		{
-		  perror("DFA save unlink");
-		  throw std::runtime_error("DFA save unlink failed");
-		}
-	    }
-	}
+  struct stat stat_buffer;
+  return lstat((directory + "/base").c_str(), &stat_buffer) == 0;
+}
 
-      closedir(dir);
+std::vector<std::string> get_layer_file_names(int ndim, std::string directory)
+{
+  std::vector<std::string> output;
 
-      int rmdir_ret = rmdir(directory.c_str());
-      if(rmdir_ret)
-	{
-	  perror("DFA save rmdir");
-	  throw std::runtime_error("DFA save rmdir failed");
-	}
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      output.push_back(directory + "/layer=" + std::to_string(layer));
     }
+
+  return output;
 }
 
 DFATransitionsReference::DFATransitionsReference(const MemoryMap<dfa_state_t>& layer_transitions_in,
 						 size_t state_in,
-						 int layer_shape_in)
+						 int layer_shape_in,
+						 bool complement_in)
   : layer_transitions(layer_transitions_in),
     offset(state_in * size_t(layer_shape_in)),
-    layer_shape(layer_shape_in)
+    layer_shape(layer_shape_in),
+    complement_mask(complement_in)
 {
   assert(layer_shape > 0);
   size_t size_temp = layer_transitions.size();
@@ -93,7 +90,8 @@ DFATransitionsReference::DFATransitionsReference(const MemoryMap<dfa_state_t>& l
 DFATransitionsReference::DFATransitionsReference(const DFATransitionsReference& reference_in)
   : layer_transitions(reference_in.layer_transitions),
     offset(reference_in.offset),
-    layer_shape(reference_in.layer_shape)
+    layer_shape(reference_in.layer_shape),
+    complement_mask(reference_in.complement_mask)
 {
   size_t size_temp = layer_transitions.size();
   assert(offset < size_temp);
@@ -102,10 +100,15 @@ DFATransitionsReference::DFATransitionsReference(const DFATransitionsReference&
   assert(offset + layer_shape <= size_temp);
 }
 
+static std::string create_temp_directory()
+{
+  return create_directory("scratch/temp/" + get_process_name() + "-" + std::to_string(next_dfa_id++));
+}
+
 DFA::DFA(const dfa_shape_t& shape_in)
   : shape(shape_in),
     ndim(int(shape.size())),
-    directory(create_directory("scratch/temp/" + std::to_string(next_dfa_id++))),
+    directory(create_temp_directory()),
     layer_file_names(get_layer_file_names(int(shape_in.size()), directory)),
     layer_sizes(),
     layer_transitions(),
@@ -143,12 +146,45 @@ DFA::DFA(const dfa_shape_t& shape_in)
   size_cache[0] = 0.0;
 }
 
+DFA::DFA(const dfa_shape_t& shape_in, const dfa_in_memory_t&)
+  : shape(shape_in),
+    ndim(int(shape.size())),
+    directory(""),
+    layer_file_names(ndim, ""),
+    layer_sizes(),
+    layer_transitions(),
+    size_cache(size_t(1)),
+    temporary(true)
+{
+  assert(ndim > 0);
+
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      // initialize each layer with the two uniform states
+
+      layer_sizes.push_back(2);
+      int layer_shape = get_layer_shape(layer);
+      layer_transitions.emplace_back(size_t(2) * size_t(layer_shape));
+
+      for(dfa_state_t state = 0; state < 2; ++state)
+	{
+	  for(int c = 0; c < layer_shape; ++c)
+	    {
+	      layer_transitions[layer][state * layer_shape + c] = state;
+	    }
+	}
+    }
+
+  size_cache[0] = 0.0;
+}
+
 DFA::DFA(const dfa_shape_t& shape_in, std::string name_in)
   : shape(shape_in),
     ndim(int(shape.size())),
     directory("scratch/" + name_in),
+    complement(is_complement_directory(directory)),
     name(name_in),
-    layer_file_names(get_layer_file_names(ndim, directory)),
+    layer_file_names(get_layer_file_names(ndim, get_storage_directory())),
     layer_sizes(),
     layer_transitions(),
     size_cache(directory + "/size_cache", size_t(1)),
@@ -165,12 +201,17 @@ DFA::DFA(const dfa_shape_t& shape_in, std::string name_in)
       layer_sizes.push_back(layer_transitions[layer].size() / layer_shape);
     }
 
-  MemoryMap<dfa_state_t> initial_state_mmap(directory + "/initial_state");
+  MemoryMap<dfa_state_t> initial_state_mmap(get_storage_directory() + "/initial_state");
   if(initial_state_mmap.size() != 1)
     {
       throw std::runtime_error("initial_state file has an invalid size");
     }
-  set_initial_state(initial_state_mmap[0]);
+  dfa_state_t initial_state_in = initial_state_mmap[0];
+  if(complement && (initial_state_in < 2))
+    {
+      initial_state_in ^= 1;
+    }
+  set_initial_state(initial_state_in);
 
   hash = parse_hash(name_in);
   assert(hash);
@@ -179,7 +220,7 @@ DFA::DFA(const dfa_shape_t& shape_in, std::string name_in)
 
 DFA::~DFA() noexcept(false)
 {
-  if(temporary)
+  if(temporary && !is_in_memory())
     {
       remove_directory(directory);
     }
@@ -225,14 +266,14 @@ dfa_state_t DFA::add_state(int layer, const DFATransitionsStaging& transitions)
   size_t current_offset = size_t(layer_sizes[layer]) * size_t(layer_shape);
   size_t next_offset = current_offset + size_t(layer_shape);
 
-  MemoryMap<dfa_state_t>& current_transitions = layer_transitions[layer];
-  size_t current_size = current_transitions.size();
+  size_t current_size = layer_transitions[layer].size();
   if(next_offset > current_size)
     {
-      size_t next_size = current_size * 2;
+      size_t next_size = std::max(current_size * 2, next_offset);
       assert(next_size <= size_t(DFA_STATE_MAX));
-      current_transitions = MemoryMap<dfa_state_t>(layer_file_names[layer], next_size);
+      resize_layer(layer, next_size);
     }
+  MemoryMap<dfa_state_t>& current_transitions = layer_transitions[layer];
 
   size_t transition_bound = this->get_layer_size(layer + 1);
   for(int i = 0; i < layer_shape; ++i)
@@ -248,7 +289,7 @@ dfa_state_t DFA::add_state_by_function(int layer, std::function<dfa_state_t(int)
 {
   int layer_shape = this->get_layer_shape(layer);
 
-  static DFATransitionsStaging transitions;
+  static thread_local DFATransitionsStaging transitions;
   transitions.resize(layer_shape);
   for(int i = 0; i < layer_shape; ++i)
     {
@@ -263,7 +304,7 @@ dfa_state_t DFA::add_state_by_reference(int layer, const DFATransitionsReference
   int layer_shape = this->get_layer_shape(layer);
   assert(next_states.get_layer_shape() == layer_shape);
 
-  static DFATransitionsStaging temp_states;
+  static thread_local DFATransitionsStaging temp_states;
   temp_states.resize(layer_shape);
   for(int i = 0; i < layer_shape; ++i)
     {
@@ -275,6 +316,7 @@ dfa_state_t DFA::add_state_by_reference(int layer, const DFATransitionsReference
 
 void DFA::build_layer(int layer, size_t layer_size_in, std::function<void(dfa_state_t, dfa_state_t *)> populate_func)
 {
+  assert(!is_in_memory());
   assert(initial_state == ~dfa_state_t(0));
   assert(0 <= layer);
   assert(layer < ndim);
@@ -364,6 +406,7 @@ void DFA::build_layer(int layer, size_t layer_size_in, std::function<void(dfa_st
 
 void DFA::copy_layer(int layer, const DFA& dfa_in)
 {
+  assert(!is_in_memory());
   assert(dfa_in.ready());
 
   assert(initial_state == ~dfa_state_t(0));
@@ -374,16 +417,58 @@ void DFA::copy_layer(int layer, const DFA& dfa_in)
   assert(dfa_in.get_layer_size(layer) >= 2);
 
   layer_sizes[layer] = dfa_in.get_layer_size(layer);
+
+  if(!dfa_in.complement && !dfa_in.is_in_memory())
+    {
+      // layer files are never modified once built, so share the
+      // input's file instead of copying it.
+      std::string link_path_temp = layer_file_names[layer] + ".link";
+      if(link(dfa_in.layer_file_names[layer].c_str(), link_path_temp.c_str()) == 0)
+	{
+	  if(rename(link_path_temp.c_str(), layer_file_names[layer].c_str()))
+	    {
+	      perror(("DFA copy_layer rename " + layer_file_names[layer]).c_str());
+	      unlink(link_path_temp.c_str());
+	      throw std::runtime_error("DFA copy_layer rename failed");
+	    }
+
+	  layer_transitions[layer] = MemoryMap<dfa_state_t>(layer_file_names[layer], true);
+	  assert(layer_transitions[layer].size() == dfa_in.layer_transitions[layer].size());
+	  return;
+	}
+
+      // otherwise copy, e.g. across file systems
+    }
+
   layer_transitions[layer] = MemoryMap<dfa_state_t>(layer_file_names[layer], size_t(layer_sizes[layer]) * size_t(get_layer_shape(layer)));
   assert(layer_transitions[layer].size() == dfa_in.layer_transitions[layer].size());
 
   // make sure the source layer is mapped
   dfa_in.layer_transitions[layer].mmap();
 
-  TRY_PARALLEL_3(std::copy,
+  if(!dfa_in.complement)
+    {
+      TRY_PARALLEL_3(std::copy,
+                     dfa_in.layer_transitions[layer].begin(),
+                     dfa_in.layer_transitions[layer].end(),
+                     layer_transitions[layer].begin());
+      return;
+    }
+
+  // materialize complement with accept and reject swapped
+  TRY_PARALLEL_4(std::transform,
                  dfa_in.layer_transitions[layer].begin(),
                  dfa_in.layer_transitions[layer].end(),
-                 layer_transitions[layer].begin());
+                 layer_transitions[layer].begin(),
+                 [](dfa_state_t next_state)
+                 {
+                   return (next_state < 2) ? (next_state ^ 1) : next_state;
+                 });
+
+  // except for the constant states themselves
+  int layer_shape = get_layer_shape(layer);
+  std::fill_n(layer_transitions[layer].begin(), layer_shape, 0);
+  std::fill_n(layer_transitions[layer].begin() + layer_shape, layer_shape, 1);
 }
 
 void DFA::set_initial_state(dfa_state_t initial_state_in)
@@ -399,7 +484,7 @@ void DFA::set_initial_state(dfa_state_t initial_state_in)
       size_t expected_transitions_size = size_t(layer_sizes[layer]) * size_t(layer_shape);
       if(layer_transitions[layer].size() != expected_transitions_size)
 	{
-	  layer_transitions[layer] = MemoryMap<dfa_state_t>(layer_file_names[layer], expected_transitions_size);
+	  resize_layer(layer, expected_transitions_size);
 	}
     }
 
@@ -411,12 +496,14 @@ std::string DFA::calculate_hash() const
   Profile profile("calculate_hash");
 
   assert(ready());
+  // complement hashes are derived when loaded
+  assert(!complement);
 
   mmap();
 
   unsigned char hash_output[SHA256_DIGEST_LENGTH];
   static const EVP_MD *hash_implementation = EVP_sha256();
-  static EVP_MD_CTX *hash_context = EVP_MD_CTX_create();
+  static thread_local EVP_MD_CTX *hash_context = EVP_MD_CTX_create();
 
   EVP_DigestInit_ex(hash_context, hash_implementation, NULL);
   EVP_DigestUpdate(hash_context, &initial_state, sizeof(initial_state));
@@ -428,13 +515,7 @@ std::string DFA::calculate_hash() const
     }
   EVP_DigestFinal_ex(hash_context, hash_output, 0);
 
-  std::stringstream ss;
-  for(int i = 0; i < SHA256_DIGEST_LENGTH; i++)
-    {
-      ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash_output[i];
-    }
-
-  return ss.str();
+  return hash_to_string(hash_output);
 }
 
 DFAIterator DFA::cbegin() const
@@ -498,6 +579,8 @@ std::string DFA::get_hash() const
 {
   assert(ready());
 
+  std::lock_guard<std::recursive_mutex> save_lock(save_mutex);
+
   if(!hash)
     {
       hash = calculate_hash();
@@ -560,6 +643,8 @@ const DFALinearBound& DFA::get_linear_bound() const
 
 	  std::vector<bool>& curr_bounds = bounds[layer];
 	  const MemoryMap<dfa_state_t>& curr_transitions = layer_transitions[layer];
+	  // non-constant states only, so just need to flip transitions
+	  dfa_state_t complement_mask = complement;
 
 	  // narrow shape case
 
@@ -573,11 +658,16 @@ const DFALinearBound& DFA::get_linear_bound() const
 		  size_t offset = state_id * layer_shape;
 		  for(size_t i = 0; i < layer_shape; ++i)
 		    {
-		      if(curr_transitions[offset + i] == 1)
+		      dfa_state_t t = curr_transitions[offset + i];
+		      if(t < 2)
+			{
+			  t ^= complement_mask;
+			}
+		      if(t == 1)
 			{
 			  local_accept_all = true;
 			}
-		      if(curr_transitions[offset + i])
+		      if(t)
 			{
 			  local_bounds |= 1 << i;
 			}
@@ -623,6 +713,10 @@ const DFALinearBound& DFA::get_linear_bound() const
 	  for(size_t i = 2 * layer_shape; i < num_transitions; ++i)
 	    {
 	      dfa_state_t t = curr_transitions[i];
+	      if(t < 2)
+		{
+		  t ^= complement_mask;
+		}
 	      if(t == 1)
 		{
 		  reached_accept_all = true;
@@ -642,6 +736,8 @@ const DFALinearBound& DFA::get_linear_bound() const
 
 std::string DFA::get_name() const
 {
+  std::lock_guard<std::recursive_mutex> save_lock(save_mutex);
+
   if(name != "")
     {
       return name;
@@ -662,11 +758,26 @@ int DFA::get_shape_size() const
   return int(shape.size());
 }
 
+std::string DFA::get_storage_directory() const
+{
+  return complement ? directory + "/base" : directory;
+}
+
+bool DFA::is_in_memory() const
+{
+  return directory == "";
+}
+
 DFATransitionsReference DFA::get_transitions(int layer, size_t state_index) const
 {
   assert(layer < ndim);
   assert(state_index < layer_sizes[layer]);
-  return DFATransitionsReference(layer_transitions[layer], state_index, get_layer_shape(layer));
+  if(complement && (state_index < 2))
+    {
+      // constant states swap rows along with their values
+      state_index ^= 1;
+    }
+  return DFATransitionsReference(layer_transitions[layer], state_index, get_layer_shape(layer), complement);
 }
 
 bool DFA::is_constant(bool constant_in) const
@@ -741,6 +852,22 @@ void DFA::munmap() const
     }
 }
 
+void DFA::resize_layer(int layer, size_t transitions_size)
+{
+  if(!is_in_memory())
+    {
+      // file is resized in place
+      layer_transitions[layer] = MemoryMap<dfa_state_t>(layer_file_names[layer], transitions_size);
+      return;
+    }
+
+  MemoryMap<dfa_state_t> resized(transitions_size);
+  std::copy_n(layer_transitions[layer].begin(),
+              std::min(layer_transitions[layer].size(), transitions_size),
+              resized.begin());
+  layer_transitions[layer] = std::move(resized);
+}
+
 std::optional<std::string> DFA::parse_hash(std::string name_in)
 {
   std::string hash_prefix = "dfas_by_hash/";
@@ -790,6 +917,8 @@ void DFA::save(std::string name_in) const
 {
   assert(!name_in.starts_with("dfas_by_hash/"));
 
+  std::lock_guard<std::recursive_mutex> save_lock(save_mutex);
+
   save_by_hash();
 
   std::string symlink_path = std::string("scratch/") + name_in;
@@ -804,28 +933,84 @@ void DFA::save(std::string name_in) const
 	}
     }
 
-  unlink(symlink_path.c_str());
+  // link under a temporary name and rename over the old link, since
+  // other processes sharing scratch/ may save the same name.
+
+  std::string symlink_path_temp = symlink_path + "." + get_process_name() + "-" + std::to_string(next_link_id++);
 
-  int ret = symlink(symlink_target.c_str(), symlink_path.c_str());
+  int ret = symlink(symlink_target.c_str(), symlink_path_temp.c_str());
   if(ret)
     {
-      perror(("DFA save symlink " + symlink_path).c_str());
+      perror(("DFA save symlink " + symlink_path_temp).c_str());
       throw std::runtime_error("DFA save symlink failed");
     }
 
+  if(rename(symlink_path_temp.c_str(), symlink_path.c_str()))
+    {
+      perror(("DFA save rename " + symlink_path).c_str());
+      unlink(symlink_path_temp.c_str());
+      throw std::runtime_error("DFA save rename failed");
+    }
+
+  // record the name in the index, as one write so concurrent saves do
+  // not interleave. scratch directories without an index are left
+  // without one.
+
+  int index_fd = open(name_index_filename.c_str(), O_WRONLY | O_APPEND);
+  if(index_fd >= 0)
+    {
+      std::string index_line = get_hash() + " " + name_in + "\n";
+      ssize_t written = write(index_fd, index_line.data(), index_line.size());
+      close(index_fd);
+      if(written != ssize_t(index_line.size()))
+	{
+	  perror(("DFA save name index " + name_in).c_str());
+	  throw std::runtime_error("DFA save name index failed");
+	}
+    }
+
   name = name_in;
 }
 
 void DFA::save_by_hash() const
 {
   assert(ready());
+
+  std::lock_guard<std::recursive_mutex> save_lock(save_mutex);
+
   if(!temporary)
     {
       return;
     }
 
   std::string directory_new = std::string("scratch/dfas_by_hash/") + get_hash();
-  // TODO: check if hash directory already exists and share carefully
+
+  // saves of the same hash within this process are serialized so
+  // concurrent builds of identical DFAs share one directory.
+  static std::mutex hash_mutexes[64];
+  std::lock_guard<std::mutex> hash_lock(hash_mutexes[std::stoul(get_hash().substr(0, 2), nullptr, 16) % 64]);
+
+  // DFAs built in memory keep reading their heap copy once saved,
+  // since singletons live for the whole process and would otherwise
+  // hold a mapping per layer.
+  bool keep_in_memory = is_in_memory();
+  if(keep_in_memory)
+    {
+      // write out memory contents to a temporary directory first
+      directory = create_temp_directory();
+      layer_file_names = get_layer_file_names(ndim, directory);
+
+      for(int layer = 0; layer < ndim; ++layer)
+	{
+	  MemoryMap<dfa_state_t> layer_file(layer_file_names[layer], layer_transitions[layer].size());
+	  std::copy(layer_transitions[layer].begin(), layer_transitions[layer].end(), layer_file.begin());
+	  layer_file.msync();
+	}
+
+      MemoryMap<double> size_cache_file(directory + "/size_cache", size_t(1));
+      size_cache_file[0] = size_cache[0];
+      size_cache_file.msync();
+    }
 
   // flush state to disk
 
@@ -841,13 +1026,39 @@ void DFA::save_by_hash() const
   initial_state_mmap[0] = initial_state;
   initial_state_mmap.msync();
 
-  remove_directory(directory_new);
-
-  int ret = rename(directory.c_str(), directory_new.c_str());
-  if(ret)
+  struct stat existing_stat;
+  if(stat((directory_new + "/initial_state").c_str(), &existing_stat) == 0)
     {
-      perror("DFA save rename");
-      throw std::runtime_error("DFA save rename failed");
+      // identical DFA already saved and possibly in use elsewhere, so
+      // share it instead of replacing it.
+      remove_directory(directory);
+    }
+  else if(rename(directory.c_str(), directory_new.c_str()))
+    {
+      // another process sharing scratch/ may have saved it since the
+      // check above. otherwise this is a leftover without a DFA.
+
+      if((errno != ENOTEMPTY) && (errno != EEXIST))
+	{
+	  perror("DFA save rename");
+	  throw std::runtime_error("DFA save rename failed");
+	}
+
+      if(stat((directory_new + "/initial_state").c_str(), &existing_stat) == 0)
+	{
+	  remove_directory(directory);
+	}
+      else
+	{
+	  remove_directory(directory_new);
+
+	  int ret = rename(directory.c_str(), directory_new.c_str());
+	  if(ret)
+	    {
+	      perror("DFA save rename");
+	      throw std::runtime_error("DFA save rename failed");
+	    }
+	}
     }
 
   // repoint internal state at new directory
@@ -855,7 +1066,7 @@ void DFA::save_by_hash() const
   directory = directory_new;
   layer_file_names = get_layer_file_names(int(shape.size()), directory_new);
 
-  for(int layer = 0; layer < ndim; ++layer)
+  for(int layer = 0; (layer < ndim) && !keep_in_memory; ++layer)
     {
       // switch layer memory maps to the new file names so they do not
       // break on munmap. has an implied flush.
@@ -866,8 +1077,53 @@ void DFA::save_by_hash() const
   temporary = false;
 }
 
+std::string DFA::save_complement() const
+{
+  // returns name of this DFA's complement, creating the complement
+  // directory if needed. the complement only links to this DFA's
+  // directory, so no layers are written.
+
+  std::lock_guard<std::recursive_mutex> save_lock(save_mutex);
+
+  save_by_hash();
+
+  if(complement)
+    {
+      // complement of a complement is the base
+      char link_target[1024] = {0};
+      ssize_t ret = readlink((directory + "/base").c_str(), link_target, sizeof(link_target) - 1);
+      if(ret < 0)
+	{
+	  perror("DFA save_complement readlink");
+	  throw std::runtime_error("DFA save_complement readlink failed");
+	}
+
+      std::string link_target_string(link_target);
+      assert(link_target_string.length() >= 64);
+      return "dfas_by_hash/" + link_target_string.substr(link_target_string.length() - 64);
+    }
+
+  std::string complement_hash = calculate_complement_hash(get_hash());
+  std::string complement_directory = "scratch/dfas_by_hash/" + complement_hash;
+
+  if(mkdir(complement_directory.c_str(), 0700) && (errno != EEXIST))
+    {
+      perror("DFA save_complement mkdir");
+      throw std::runtime_error("DFA save_complement mkdir failed");
+    }
+
+  if(symlink(("../" + get_hash()).c_str(), (complement_directory + "/base").c_str()) && (errno != EEXIST))
+    {
+      perror("DFA save_complement symlink");
+      throw std::runtime_error("DFA save_complement symlink failed");
+    }
+
+  return "dfas_by_hash/" + complement_hash;
+}
+
 void DFA::set_name(std::string name_in) const
 {
+  std::lock_guard<std::recursive_mutex> save_lock(save_mutex);
   name = name_in;
 }
 
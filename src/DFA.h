@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <vector>
@@ -20,6 +21,10 @@ typedef std::vector<dfa_state_t> DFATransitionsStaging;
 
 typedef std::vector<int> dfa_shape_t;
 
+// tag for small DFAs kept in anonymous memory until saved, so using
+// them never touches scratch.
+struct dfa_in_memory_t {};
+
 class DFAString
 {
   dfa_shape_t shape;
@@ -40,14 +45,21 @@ class DFATransitionsReference
   const MemoryMap<dfa_state_t>& layer_transitions;
   size_t offset;
   int layer_shape;
+  // xored into the constant states 0/1 for complement DFAs
+  dfa_state_t complement_mask;
 
 public:
 
-  DFATransitionsReference(const MemoryMap<dfa_state_t>&, size_t, int);
+  DFATransitionsReference(const MemoryMap<dfa_state_t>&, size_t, int, bool);
   DFATransitionsReference(const DFATransitionsReference&);
   dfa_state_t operator[](int c) const {return at(c);}
 
-  dfa_state_t at(size_t c) const {assert(c < layer_shape); return layer_transitions[offset + c];}
+  dfa_state_t at(size_t c) const
+  {
+    assert(c < layer_shape);
+    dfa_state_t next_state = layer_transitions[offset + c];
+    return (next_state < 2) ? (next_state ^ complement_mask) : next_state;
+  }
   int get_layer_shape() const {return layer_shape;}
 };
 
@@ -76,6 +88,9 @@ class DFA
   int ndim;
 
   mutable std::string directory;
+  // complement DFAs share the layer files of their base DFA (linked
+  // as base/ in their directory) with accept and reject swapped.
+  bool complement = false;
   dfa_state_t initial_state = ~dfa_state_t(0);
   mutable std::string name;
 
@@ -91,9 +106,18 @@ class DFA
 
   mutable DFALinearBound *linear_bound = 0;
 
+  // guards name, hash and the storage switch in save() so threads
+  // sharing this DFA can save it without a global lock.
+  mutable std::recursive_mutex save_mutex;
+
+  std::string get_storage_directory() const;
+  bool is_in_memory() const;
+  void resize_layer(int, size_t);
+
  protected:
 
   DFA(const dfa_shape_t&);
+  DFA(const dfa_shape_t&, const dfa_in_memory_t&);
 
   virtual dfa_state_t add_state(int, const DFATransitionsStaging&);
   dfa_state_t add_state_by_function(int, std::function<dfa_state_t(int)>);
@@ -131,10 +155,13 @@ class DFA
   void mmap() const;
   void munmap() const;
 
+  // "<hash> <name>" line per save, kept when scratch/ has one
+  static const std::string name_index_filename;
   static std::optional<std::string> parse_hash(std::string);
   bool ready() const;
   void save(std::string) const;
   void save_by_hash() const;
+  std::string save_complement() const;
   void set_name(std::string) const;
   double size() const;
   size_t states() const;
@@ -2,17 +2,39 @@
 
 #include "DFAUtil.h"
 
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <queue>
 #include <set>
 #include <sstream>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "AcceptDFA.h"
+#include "BinaryDFA.h"
+#include "BinaryDecision.h"
+#include "BinaryEstimate.h"
+#include "BoundedTasks.h"
+#include "BuildLease.h"
+#include "CanonicalDFA.h"
 #include "ChangeDFA.h"
 #include "CountCharacterDFA.h"
 #include "DFA.h"
@@ -22,8 +44,13 @@
 #include "InverseDFA.h"
 #include "Profile.h"
 #include "RejectDFA.h"
+#include "RelabelDFA.h"
+#include "ScratchGC.h"
 #include "StringDFA.h"
+#include "SwapDFA.h"
 #include "UnionDFA.h"
+#include "parallel.h"
+#include "utils.h"
 
 double _binary_score(shared_dfa_ptr dfa_a, shared_dfa_ptr dfa_b)
 {
@@ -91,10 +118,66 @@ double _binary_score(shared_dfa_ptr dfa_a, shared_dfa_ptr dfa_b)
   return total_max;
 }
 
+// pairs whose layer bound is at least BINARY_PLAN_SAMPLE_MIN states
+// are also scored by a sampled forward pass, since the bound can be
+// far above the reachable pairs.
+
+#ifndef BINARY_PLAN_SAMPLE_MIN
+#define BINARY_PLAN_SAMPLE_MIN 65536.0
+#endif
+
+#ifndef BINARY_PLAN_SAMPLE_SIZE
+#define BINARY_PLAN_SAMPLE_SIZE 4096
+#endif
+
+static const std::string planner_log_filename = "scratch/planner_log";
+
+double _binary_plan_score(shared_dfa_ptr dfa_a, bool linear_a,
+			  shared_dfa_ptr dfa_b, bool linear_b,
+			  const BinaryFunction& leaf_func)
+{
+  // estimated cost of building the pair with the algorithm BinaryDFA
+  // will pick. inputs must already be mapped.
+
+  if(linear_a && leaf_func.has_left_sink(0))
+    {
+      // linear build only rewrites the other DFA's states
+      return double(dfa_b->states());
+    }
+  if(linear_b && leaf_func.is_commutative() && leaf_func.has_right_sink(0))
+    {
+      return double(dfa_a->states());
+    }
+
+  double bound = _binary_score(dfa_a, dfa_b);
+  if(bound < BINARY_PLAN_SAMPLE_MIN)
+    {
+      return bound;
+    }
+
+  // pairs become states, plus the two constant states per layer
+  BinaryEstimate estimate(*dfa_a, *dfa_b, leaf_func, BINARY_PLAN_SAMPLE_SIZE);
+  return std::min(bound, estimate.get_total_pairs() + 2.0 * dfa_a->get_shape_size());
+}
+
+// concurrent merges in _reduce_aci draw from the process-wide task
+// slots and memory budget in BoundedTasks.
+
+static size_t _reduce_memory_estimate(double score)
+{
+  // binary builds stream through their RAM budget, carved from this
+  // reservation, so the state bound only matters for smaller merges.
+
+  double pair_bytes = score * double(sizeof(dfa_state_pair_t));
+  return size_t(std::min(pair_bytes, double(BinaryDFA::get_ram_budget())));
+}
+
 shared_dfa_ptr _reduce_aci(std::function<shared_dfa_ptr(shared_dfa_ptr, shared_dfa_ptr)> reduce_func,
+			   const BinaryFunction& leaf_func,
 			   const std::vector<shared_dfa_ptr>& dfas_in)
 {
-  // reduce DFAs assuming reduce function is associative, commutative, and idempotent.
+  // reduce DFAs assuming reduce function is associative, commutative,
+  // and idempotent. independent pairs are merged concurrently.
 
   Profile profile("_reduce_aci");
 
@@ -110,21 +193,77 @@ shared_dfa_ptr _reduce_aci(std::function<shared_dfa_ptr(shared_dfa_ptr, shared_d
 
   // build priority queue to optimize reduce costs
 
+  // pairs only hold their DFAs weakly, so a DFA consumed by a merge
+  // is released as soon as the reduction is done with it instead of
+  // staying mapped until its stale pairs are popped.
+
+  struct scored_pair_t
+  {
+    double score;
+    std::string hash_a;
+    std::string hash_b;
+    std::weak_ptr<const DFA> dfa_a;
+    std::weak_ptr<const DFA> dfa_b;
+
+    bool operator<(const scored_pair_t& other) const
+    {
+      return std::tie(score, hash_a, hash_b) < std::tie(other.score, other.hash_a, other.hash_b);
+    }
+  };
+
   std::set<shared_dfa_ptr> dfas_todo;
-  std::priority_queue<std::tuple<double, std::string, std::string, shared_dfa_ptr, shared_dfa_ptr>> scored_pairs;
+  std::map<shared_dfa_ptr, bool> dfas_linear;
+  std::priority_queue<scored_pair_t> scored_pairs;
 
-  auto enqueue_pair = [&](shared_dfa_ptr dfa_a, shared_dfa_ptr dfa_b)
+  auto enqueue_pairs = [&](shared_dfa_ptr dfa_new)
   {
-    if(dfa_a->get_hash() > dfa_b->get_hash())
+    // each pair is scored once, when its second DFA arrives. lazy
+    // per-DFA state is filled in here so the scores can be computed
+    // in parallel.
+
+    std::vector<shared_dfa_ptr> dfas_old(dfas_todo.begin(), dfas_todo.end());
+
+    dfa_new->get_hash();
+    dfas_linear[dfa_new] = dfa_new->is_linear();
+#ifdef BINARY_SCORE_LINEAR_BOUND
+    dfa_new->get_linear_bound();
+#endif
+
+    dfa_new->mmap();
+    for(shared_dfa_ptr dfa_old : dfas_old)
       {
-	std::swap(dfa_a, dfa_b);
+	dfa_old->mmap();
       }
 
-    scored_pairs.emplace(-_binary_score(dfa_a, dfa_b), dfa_a->get_hash(), dfa_b->get_hash(), dfa_a, dfa_b);
+    std::vector<double> scores(dfas_old.size());
+    TRY_PARALLEL_4(std::transform, dfas_old.begin(), dfas_old.end(), scores.begin(), [&](shared_dfa_ptr dfa_old)
+    {
+      shared_dfa_ptr dfa_a = dfa_new;
+      shared_dfa_ptr dfa_b = dfa_old;
+      if(dfa_a->get_hash() > dfa_b->get_hash())
+	{
+	  std::swap(dfa_a, dfa_b);
+	}
+
+      return _binary_plan_score(dfa_a, dfas_linear.at(dfa_a), dfa_b, dfas_linear.at(dfa_b), leaf_func);
+    });
+
+    for(size_t i = 0; i < dfas_old.size(); ++i)
+      {
+	shared_dfa_ptr dfa_a = dfa_new;
+	shared_dfa_ptr dfa_b = dfas_old[i];
+	if(dfa_a->get_hash() > dfa_b->get_hash())
+	  {
+	    std::swap(dfa_a, dfa_b);
+	  }
+
+	scored_pairs.push(scored_pair_t{-scores[i], dfa_a->get_hash(), dfa_b->get_hash(), dfa_a, dfa_b});
+      }
   };
 
   // add distinct DFAs and queue up pairs
 
+  profile.tic("score");
   for(shared_dfa_ptr dfa_i : dfas_in)
     {
       if(dfas_todo.contains(dfa_i))
@@ -132,70 +271,112 @@ shared_dfa_ptr _reduce_aci(std::function<shared_dfa_ptr(shared_dfa_ptr, shared_d
 	  continue;
 	}
 
-      for(shared_dfa_ptr dfa_j : dfas_todo)
-	{
-	  enqueue_pair(dfa_i, dfa_j);
-	}
-
+      enqueue_pairs(dfa_i);
       dfas_todo.insert(dfa_i);
     }
 
-  // unmap DFAs to reduce open files
+  // work through the priority queue, launching the best pair whose
+  // inputs are both available whenever a worker and enough memory
+  // are free. with one worker this is the sequential greedy order.
 
-  for(shared_dfa_ptr dfa : dfas_todo)
-    {
-      dfa->munmap();
-    }
+  profile.tic("merge");
+
+  struct merge_t
+  {
+    shared_dfa_ptr dfa_i;
+    shared_dfa_ptr dfa_j;
+    double score;
+  };
 
-  // work through the priority queue
+  BoundedTasks tasks;
+  std::map<size_t, merge_t> merges;
+  std::set<shared_dfa_ptr> dfas_busy;
+  size_t next_merge_id = 0;
 
-  while(dfas_todo.size() > 1)
+  // a result already pending is dropped, so running merges must
+  // finish even when they leave nothing else to merge with.
+
+  while((merges.size() > 0) || (dfas_todo.size() > 1))
     {
-      size_t start_size = dfas_todo.size();
+      while(scored_pairs.size() > 0)
+	{
+	  const scored_pair_t& scored_pair = scored_pairs.top();
 
-      std::tuple<double, std::string, std::string, shared_dfa_ptr, shared_dfa_ptr> scored_pair = scored_pairs.top();
-      scored_pairs.pop();
+	  // check if both DFAs are still around because we lazy cleaning up scored pairs.
 
-      // check if both DFAs are still around because we lazy cleaning up scored pairs.
+	  shared_dfa_ptr dfa_i = scored_pair.dfa_a.lock();
+	  shared_dfa_ptr dfa_j = scored_pair.dfa_b.lock();
+	  if(!dfa_i || !dfa_j || !dfas_todo.contains(dfa_i) || !dfas_todo.contains(dfa_j))
+	    {
+	      scored_pairs.pop();
+	      continue;
+	    }
+	  assert(dfa_i != dfa_j);
 
-      shared_dfa_ptr dfa_i = std::get<3>(scored_pair);
-      shared_dfa_ptr dfa_j = std::get<4>(scored_pair);
-      assert(dfa_i != dfa_j);
-      if(!dfas_todo.contains(dfa_i) || !dfas_todo.contains(dfa_j))
-	{
-	  continue;
-	}
+	  double score = -scored_pair.score;
+	  size_t merge_id = next_merge_id;
+	  merges[merge_id] = merge_t{dfa_i, dfa_j, score};
 
-      // remove both DFAs from remaining set
+	  if(!tasks.try_launch(merge_id, _reduce_memory_estimate(score), [&reduce_func, dfa_i, dfa_j]()
+	  {
+	    return reduce_func(dfa_i, dfa_j);
+	  }))
+	    {
+	      merges.erase(merge_id);
+	      break;
+	    }
 
-      dfas_todo.erase(dfa_i);
-      dfas_todo.erase(dfa_j);
+	  ++next_merge_id;
+	  scored_pairs.pop();
 
-      assert(dfas_todo.size() == start_size - 2);
+	  // remove both DFAs from remaining set
 
-      // combine these DFAs and add to remaining set and score pairs
+	  dfas_todo.erase(dfa_i);
+	  dfas_todo.erase(dfa_j);
+	  dfas_linear.erase(dfa_i);
+	  dfas_linear.erase(dfa_j);
+	  dfas_busy.insert(dfa_i);
+	  dfas_busy.insert(dfa_j);
 
-      if((dfa_i->states() >= 1024) || (dfa_j->states() >= 1024))
-	{
-	  std::cout << "  merging DFAs with " << dfa_i->states() << " states and " << dfa_j->states() << " states (" << dfas_todo.size() << " remaining)" << std::endl;
+	  if((dfa_i->states() >= 1024) || (dfa_j->states() >= 1024))
+	    {
+	      std::cout << "  merging DFAs with " << dfa_i->states() << " states and " << dfa_j->states() << " states (" << dfas_todo.size() << " remaining, " << merges.size() - 1 << " merging)" << std::endl;
+	    }
 	}
 
-      shared_dfa_ptr dfa_reduced = reduce_func(dfa_i, dfa_j);
-      if(!dfas_todo.contains(dfa_reduced))
+      assert(tasks.size() > 0);
+
+      // wait for at least one merge to finish
+
+      for(auto& [merge_id, dfa_reduced] : tasks.wait_any())
 	{
-	  for(shared_dfa_ptr dfa_k : dfas_todo)
+	  merge_t& merge = merges.at(merge_id);
+
+	  dfas_busy.erase(merge.dfa_i);
+	  dfas_busy.erase(merge.dfa_j);
+
+	  // log predicted against actual so the planner can be calibrated
+
+	  double bound = _binary_score(merge.dfa_i, merge.dfa_j);
+	  if(bound >= BINARY_PLAN_SAMPLE_MIN)
 	    {
-	      enqueue_pair(dfa_reduced, dfa_k);
+	      std::cout << "  merge planned " << merge.score << " states (bound " << bound << "), built " << dfa_reduced->states() << " states" << std::endl;
+
+	      std::ofstream planner_log(planner_log_filename, std::ios::app);
+	      planner_log << bound << " " << merge.score << " " << dfa_reduced->states() << " " << merge.dfa_i->get_hash() << " " << merge.dfa_j->get_hash() << std::endl;
 	    }
 
-	  dfas_todo.insert(dfa_reduced);
-	  assert(dfas_todo.size() == start_size - 1);
-	}
+	  merges.erase(merge_id);
+
+	  // combine with remaining set and score pairs. a result that is
+	  // already pending is covered by idempotence.
 
-      // unmap the DFAs just accessed
-      dfa_i->munmap();
-      dfa_j->munmap();
-      dfa_reduced->munmap();
+	  if(!dfas_todo.contains(dfa_reduced) && !dfas_busy.contains(dfa_reduced))
+	    {
+	      enqueue_pairs(dfa_reduced);
+	      dfas_todo.insert(dfa_reduced);
+	    }
+	}
     }
 
   // done
@@ -215,6 +396,33 @@ shared_dfa_ptr _reduce_aci(std::function<shared_dfa_ptr(shared_dfa_ptr, shared_d
   assert(0);
 }
 
+static std::string _cache_name(std::string prefix_in, std::string parameters_in)
+{
+  // cache names must fit in one file name with room for lock and
+  // temporary link suffixes, so long parameters are replaced by their
+  // hash.
+
+  if(parameters_in.size() <= 128)
+    {
+      return prefix_in + parameters_in;
+    }
+
+  unsigned char hash_output[SHA256_DIGEST_LENGTH];
+  EVP_Digest(parameters_in.data(), parameters_in.size(), hash_output, 0, EVP_sha256(), NULL);
+
+  std::ostringstream oss;
+  oss << prefix_in << ",sha256=" << std::hex << std::setfill('0');
+  for(int i = 0; i < SHA256_DIGEST_LENGTH; ++i)
+    {
+      oss << std::setw(2) << int(hash_output[i]);
+    }
+  return oss.str();
+}
+
+// guards the per-shape singleton maps below
+
+static std::mutex singletons_mutex;
+
 std::string _shape_string(const dfa_shape_t& shape_in)
 {
   std::ostringstream oss;
@@ -244,6 +452,292 @@ shared_dfa_ptr _singleton_if_constant(shared_dfa_ptr dfa_in)
   return dfa_in;
 }
 
+// name index of saved names, read from the "<hash> <name>" lines
+// DFA::save appends to DFA::name_index_filename. every save of a
+// scratch/ directory with an index is listed, so names missing from
+// it are misses without touching the file system. names in the index
+// may since have been rebound or collected, so hits are confirmed by
+// reading the link. scratch/ directories without an index read the
+// link on every lookup.
+
+static std::unordered_map<std::string, std::string> name_index;
+static bool name_index_loaded = false;
+static bool name_index_filter = false;
+static ino_t name_index_inode = 0;
+static off_t name_index_offset = 0;
+static size_t name_index_lines = 0;
+static std::recursive_mutex name_index_mutex;
+
+static void _name_index_read()
+{
+  // read lines appended since the last read, starting over if the
+  // index was replaced by a compaction.
+
+  std::lock_guard<std::recursive_mutex> name_index_lock(name_index_mutex);
+
+  // stat the open file so a concurrent compaction cannot swap it
+  // between the check and the read.
+
+  int index_fd = open(DFA::name_index_filename.c_str(), O_RDONLY);
+  if(index_fd < 0)
+    {
+      return;
+    }
+
+  struct stat index_stat;
+  if(fstat(index_fd, &index_stat))
+    {
+      close(index_fd);
+      return;
+    }
+
+  if(index_stat.st_ino != name_index_inode)
+    {
+      name_index.clear();
+      name_index_inode = index_stat.st_ino;
+      name_index_offset = 0;
+      name_index_lines = 0;
+    }
+
+  std::string index_data(std::max(index_stat.st_size - name_index_offset, off_t(0)), '\0');
+  ssize_t index_read = pread(index_fd, index_data.data(), index_data.size(), name_index_offset);
+  close(index_fd);
+  if(index_read < 0)
+    {
+      return;
+    }
+  index_data.resize(index_read);
+
+  // only complete lines
+  for(size_t line_start = 0, line_end; (line_end = index_data.find('\n', line_start)) != std::string::npos; line_start = line_end + 1)
+    {
+      name_index_offset += line_end + 1 - line_start;
+
+      std::string line = index_data.substr(line_start, line_end - line_start);
+      size_t space = line.find(' ');
+      if(space != 64)
+	{
+	  continue;
+	}
+
+      // later lines win
+      name_index[line.substr(space + 1)] = line.substr(0, space);
+      ++name_index_lines;
+    }
+}
+
+static void _name_index_compact()
+{
+  std::lock_guard<std::recursive_mutex> name_index_lock(name_index_mutex);
+
+  // one process compacts at a time. saves appending to the old index
+  // during the swap are copied to the new one afterwards.
+
+  std::unique_ptr<BuildLease> lease = BuildLease::try_acquire(DFA::name_index_filename + ".lock");
+  if(!lease)
+    {
+      return;
+    }
+
+  _name_index_read();
+  std::ifstream old_file(DFA::name_index_filename);
+
+  std::string compact_filename = DFA::name_index_filename + "." + get_process_name();
+  std::ofstream compact_file(compact_filename);
+  for(const auto& [index_name, index_hash] : name_index)
+    {
+      compact_file << index_hash << " " << index_name << "\n";
+    }
+  compact_file.close();
+
+  if(std::rename(compact_filename.c_str(), DFA::name_index_filename.c_str()))
+    {
+      perror("name index rename");
+      return;
+    }
+
+  old_file.seekg(name_index_offset);
+  std::ofstream new_file(DFA::name_index_filename, std::ios::app);
+  std::string line;
+  while(std::getline(old_file, line))
+    {
+      new_file << line << std::endl;
+    }
+  new_file.close();
+
+  _name_index_read();
+}
+
+static void _name_index_load()
+{
+  std::lock_guard<std::recursive_mutex> name_index_lock(name_index_mutex);
+
+  if(name_index_loaded)
+    {
+      return;
+    }
+
+  Profile profile("name_index_load");
+
+  name_index_loaded = true;
+
+  struct stat index_stat;
+  name_index_filter = (stat(DFA::name_index_filename.c_str(), &index_stat) == 0);
+  if(!name_index_filter)
+    {
+      return;
+    }
+
+  _name_index_read();
+  if(name_index_lines > 2 * name_index.size() + 1024)
+    {
+      profile.tic("compact");
+      _name_index_compact();
+    }
+}
+
+static std::optional<std::string> _name_index_lookup(std::string name_in)
+{
+  std::unique_lock<std::recursive_mutex> name_index_lock(name_index_mutex);
+
+  _name_index_load();
+
+  if(name_index_filter && !name_index.contains(name_in))
+    {
+      // pick up saves by other processes since the last read
+      _name_index_read();
+      if(!name_index.contains(name_in))
+	{
+	  return std::optional<std::string>();
+	}
+    }
+
+  name_index_lock.unlock();
+
+  std::optional<std::string> hash = DFA::parse_hash(name_in);
+  if(!hash && name_index_filter)
+    {
+      // link removed since it was indexed
+      name_index_lock.lock();
+      name_index.erase(name_in);
+    }
+
+  return hash;
+}
+
+// DFAs loaded or built by this process, so repeated loads share one
+// object and garbage collection leaves them alone.
+
+static std::unordered_map<std::string, std::weak_ptr<const DFA>> dfas_by_hash;
+static std::mutex dfas_by_hash_mutex;
+
+// builds in progress in this process, so concurrent requests for the
+// same name wait for one build instead of racing to save it.
+
+static std::mutex building_mutex;
+static std::map<std::string, std::shared_future<shared_dfa_ptr>> building;
+
+static shared_dfa_ptr _publish(shared_dfa_ptr dfa_in)
+{
+  // share a DFA with later loads of its hash and pin it against
+  // garbage collection by any process sharing scratch/. returns the
+  // DFA already published for the hash if it is still around.
+
+  std::string hash = dfa_in->get_hash();
+  {
+    std::lock_guard<std::mutex> dfas_by_hash_lock(dfas_by_hash_mutex);
+    auto search = dfas_by_hash.find(hash);
+    if(search != dfas_by_hash.end())
+      {
+	if(shared_dfa_ptr dfa_first = search->second.lock())
+	  {
+	    return dfa_first;
+	  }
+      }
+
+    dfas_by_hash[hash] = dfa_in;
+  }
+
+  ScratchGC::pin(hash);
+  return dfa_in;
+}
+
+static void _collect_garbage(std::function<void(ScratchGC&)> collect_func)
+{
+  // refresh this process's pins so other processes collecting
+  // concurrently can release what it no longer holds.
+
+  std::unordered_set<std::string> pinned_hashes;
+  ScratchGC::write_pins([&]()
+  {
+    std::lock_guard<std::mutex> dfas_by_hash_lock(dfas_by_hash_mutex);
+    for(const auto& [hash, weak_dfa] : dfas_by_hash)
+      {
+	if(!weak_dfa.expired())
+	  {
+	    pinned_hashes.insert(hash);
+	  }
+      }
+    return pinned_hashes;
+  });
+
+  ScratchGC gc(pinned_hashes);
+  collect_func(gc);
+
+  // drop index entries for evicted DFAs
+
+  const std::vector<std::string>& evicted_hashes = gc.get_evicted_hashes();
+  if(evicted_hashes.size())
+    {
+      std::lock_guard<std::recursive_mutex> name_index_lock(name_index_mutex);
+      _name_index_load();
+      if(name_index_filter)
+	{
+	  _name_index_read();
+
+	  std::unordered_set<std::string> evicted(evicted_hashes.begin(), evicted_hashes.end());
+	  std::erase_if(name_index, [&](const auto& index_entry)
+	  {
+	    return evicted.contains(index_entry.second);
+	  });
+
+	  _name_index_compact();
+	}
+    }
+}
+
+static void _collect_garbage_if_low()
+{
+  // called before builds so long runs free space before they fill
+  // the scratch file system.
+
+  size_t free_threshold = ScratchGC::get_free_threshold();
+  if(free_threshold == 0)
+    {
+      return;
+    }
+
+  size_t free_bytes = ScratchGC::get_free_bytes();
+  if(free_bytes >= free_threshold)
+    {
+      return;
+    }
+
+  // one collection at a time. other threads just keep building.
+  static std::mutex collect_mutex;
+  std::unique_lock<std::mutex> collect_lock(collect_mutex, std::try_to_lock);
+  if(!collect_lock.owns_lock())
+    {
+      return;
+    }
+
+  std::cout << "scratch free space " << free_bytes << " bytes below threshold " << free_threshold << " bytes" << std::endl;
+  _collect_garbage([&](ScratchGC& gc)
+  {
+    gc.reclaim(2 * free_threshold - free_bytes);
+  });
+}
+
 shared_dfa_ptr _try_load(const dfa_shape_t& shape_in, std::string name_in)
 {
   try
@@ -256,6 +750,39 @@ shared_dfa_ptr _try_load(const dfa_shape_t& shape_in, std::string name_in)
     }
 }
 
+void DFAUtil::collect_garbage(size_t budget_bytes)
+{
+  _collect_garbage([&](ScratchGC& gc)
+  {
+    gc.collect(budget_bytes);
+  });
+}
+
+std::optional<DFAString> DFAUtil::find_difference(shared_dfa_ptr left_in, shared_dfa_ptr right_in)
+{
+  // find a string accepted by left and rejected by right, without
+  // building or caching the difference.
+
+  Profile profile("find_difference");
+
+  if((left_in == right_in) || (left_in->get_hash() == right_in->get_hash()))
+    {
+      return std::optional<DFAString>();
+    }
+
+  return BinaryDecision(*left_in, *right_in, difference_function).get_witness();
+}
+
+std::optional<DFAString> DFAUtil::find_intersection(shared_dfa_ptr left_in, shared_dfa_ptr right_in)
+{
+  // find a string accepted by both left and right, without building
+  // or caching the intersection.
+
+  Profile profile("find_intersection");
+
+  return BinaryDecision(*left_in, *right_in, intersection_function).get_witness();
+}
+
 shared_dfa_ptr DFAUtil::from_string(const DFAString& string_in)
 {
   std::vector<DFAString> strings = {string_in};
@@ -281,6 +808,7 @@ shared_dfa_ptr DFAUtil::get_accept(const dfa_shape_t& shape_in)
   // returns a singleton per shape
 
   static std::map<std::string, shared_dfa_ptr> singletons;
+  std::lock_guard<std::mutex> singletons_lock(singletons_mutex);
 
   std::string singleton_key = _shape_string(shape_in);
   auto search = singletons.find(singleton_key);
@@ -294,6 +822,102 @@ shared_dfa_ptr DFAUtil::get_accept(const dfa_shape_t& shape_in)
   return output;
 }
 
+static std::vector<std::vector<int>> _get_symmetry_group(int ndim, const std::vector<std::vector<int>>& generators_in)
+{
+  // closes the generators under composition, returning the group
+  // elements besides the identity in sorted order.
+
+  std::vector<int> identity(ndim);
+  std::iota(identity.begin(), identity.end(), 0);
+
+  std::set<std::vector<int>> group = {identity};
+  std::vector<std::vector<int>> queue = {identity};
+  while(queue.size())
+    {
+      std::vector<int> element = queue.back();
+      queue.pop_back();
+
+      for(const std::vector<int>& generator : generators_in)
+	{
+	  assert(generator.size() == ndim);
+
+	  std::vector<int> composed(ndim);
+	  for(int layer = 0; layer < ndim; ++layer)
+	    {
+	      composed[layer] = generator.at(element[layer]);
+	    }
+
+	  if(group.insert(composed).second)
+	    {
+	      queue.push_back(composed);
+	    }
+	}
+    }
+
+  group.erase(identity);
+  return std::vector<std::vector<int>>(group.begin(), group.end());
+}
+
+shared_dfa_ptr DFAUtil::get_canonical(shared_dfa_ptr dfa_in, const std::vector<std::vector<int>>& generators_in)
+{
+  // symmetric closure of the input, limited to the canonical filter.
+
+  Profile profile("get_canonical");
+
+  const dfa_shape_t& shape = dfa_in->get_shape();
+  std::vector<std::vector<int>> group = _get_symmetry_group(int(shape.size()), generators_in);
+  if((group.size() == 0) || dfa_in->is_constant(false))
+    {
+      return dfa_in;
+    }
+
+  // symmetric inputs have identical images, which are left out so
+  // the union only merges distinct DFAs.
+
+  std::vector<shared_dfa_ptr> images = {dfa_in};
+  std::unordered_set<std::string> image_hashes = {dfa_in->get_hash()};
+  for(const std::vector<int>& permutation : group)
+    {
+      shared_dfa_ptr image = get_permuted(dfa_in, permutation);
+      if(image_hashes.insert(image->get_hash()).second)
+	{
+	  images.push_back(image);
+	}
+    }
+
+  return get_intersection(get_union_vector(shape, images),
+			  get_canonical_filter(shape, generators_in));
+}
+
+shared_dfa_ptr DFAUtil::get_canonical_filter(const dfa_shape_t& shape_in, const std::vector<std::vector<int>>& generators_in)
+{
+  std::vector<std::vector<int>> group = _get_symmetry_group(int(shape_in.size()), generators_in);
+
+  static std::map<std::string, shared_dfa_ptr> singletons;
+  std::lock_guard<std::mutex> singletons_lock(singletons_mutex);
+
+  std::ostringstream parameters;
+  for(const std::vector<int>& permutation : group)
+    {
+      for(int layer = 0; layer < permutation.size(); ++layer)
+	{
+	  parameters << ((layer > 0) ? "_" : " ") << permutation[layer];
+	}
+    }
+
+  std::string singleton_key = _shape_string(shape_in) + parameters.str();
+  auto search = singletons.find(singleton_key);
+  if(search != singletons.end())
+    {
+      return search->second;
+    }
+
+  shared_dfa_ptr output(new CanonicalDFA(shape_in, group));
+  output->set_name("get_canonical_filter(group_size=" + std::to_string(group.size() + 1) + ")");
+  singletons[singleton_key] = output;
+  return output;
+}
+
 shared_dfa_ptr DFAUtil::get_change(shared_dfa_ptr dfa_in, const change_vector& changes_in)
 {
   Profile profile("get_change");
@@ -343,29 +967,36 @@ shared_dfa_ptr DFAUtil::get_change(shared_dfa_ptr dfa_in, const change_vector& c
 
 shared_dfa_ptr DFAUtil::get_count_character(const dfa_shape_t& shape_in, int c_in, int count_in)
 {
-  shared_dfa_ptr output(new CountCharacterDFA(shape_in, c_in, count_in));
-  output->set_name("get_count_character(" + std::to_string(c_in) + ", " + std::to_string(count_in) + ")");
-  return output;
+  return get_count_character(shape_in, c_in, count_in, count_in);
 }
 
 shared_dfa_ptr DFAUtil::get_count_character(const dfa_shape_t& shape_in, int c_in, int count_min, int count_max)
 {
-  shared_dfa_ptr output(new CountCharacterDFA(shape_in, c_in, count_min, count_max));
-  output->set_name("get_count_character(" + std::to_string(c_in) + ", " + std::to_string(count_min) + ", " + std::to_string(count_max) + ")");
-  return output;
+  return get_count_character(shape_in, c_in, count_min, count_max, 0);
 }
 
 shared_dfa_ptr DFAUtil::get_count_character(const dfa_shape_t& shape_in, int c_in, int count_min, int count_max, int layer_min)
 {
-  shared_dfa_ptr output(new CountCharacterDFA(shape_in, c_in, count_min, count_max, layer_min));
-  output->set_name("get_count_character(" + std::to_string(c_in) + ", " + std::to_string(count_min) + ", " + std::to_string(count_max) + ", " + std::to_string(layer_min) + ")");
-  return output;
+  return get_count_character(shape_in, c_in, count_min, count_max, layer_min, int(shape_in.size()) - 1);
 }
 
 shared_dfa_ptr DFAUtil::get_count_character(const dfa_shape_t& shape_in, int c_in, int count_min, int count_max, int layer_min, int layer_max)
 {
+  static std::map<std::string, shared_dfa_ptr> singletons;
+  std::lock_guard<std::mutex> singletons_lock(singletons_mutex);
+
+  std::string parameters = std::to_string(c_in) + ", " + std::to_string(count_min) + ", " + std::to_string(count_max) + ", " + std::to_string(layer_min) + ", " + std::to_string(layer_max);
+
+  std::string singleton_key = _shape_string(shape_in) + " " + parameters;
+  auto search = singletons.find(singleton_key);
+  if(search != singletons.end())
+    {
+      return search->second;
+    }
+
   shared_dfa_ptr output(new CountCharacterDFA(shape_in, c_in, count_min, count_max, layer_min, layer_max));
-  output->set_name("get_count_character(" + std::to_string(c_in) + ", " + std::to_string(count_min) + ", " + std::to_string(count_max) + ", " + std::to_string(layer_min) + ", " + std::to_string(layer_max) + ")");
+  output->set_name("get_count_character(" + parameters + ")");
+  singletons[singleton_key] = output;
   return output;
 }
 
@@ -407,6 +1038,7 @@ shared_dfa_ptr DFAUtil::get_difference(shared_dfa_ptr left_in, shared_dfa_ptr ri
 shared_dfa_ptr DFAUtil::get_fixed(const dfa_shape_t& shape_in, int fixed_layer, int fixed_character)
 {
   static std::map<std::string, shared_dfa_ptr> singletons;
+  std::lock_guard<std::mutex> singletons_lock(singletons_mutex);
 
   std::string singleton_key = _shape_string(shape_in) + (" " + std::to_string(fixed_layer) + "/" + std::to_string(fixed_character));
   auto search = singletons.find(singleton_key);
@@ -547,26 +1179,113 @@ shared_dfa_ptr DFAUtil::get_intersection_vector(const dfa_shape_t& shape_in, con
       nonlinear_staging[i] = get_intersection(nonlinear_staging[i], linear_staging);
     }
 
-  return _reduce_aci(get_intersection, nonlinear_staging);
+  return _reduce_aci(get_intersection, intersection_function, nonlinear_staging);
 }
 
 shared_dfa_ptr DFAUtil::get_inverse(shared_dfa_ptr dfa_in)
 {
   Profile profile("get_inverse");
 
-  std::string inverse_name = "inverse_cache/" + dfa_in->get_hash();
+  if(dfa_in->is_constant(false))
+    {
+      return get_accept(dfa_in->get_shape());
+    }
+  else if(dfa_in->is_constant(true))
+    {
+      return get_reject(dfa_in->get_shape());
+    }
+
+  // complement views are constant time, so skip the inverse cache.
+  // the view reads its base's layers, so both stay pinned.
+  shared_dfa_ptr output(new InverseDFA(*dfa_in));
+  _publish(dfa_in);
+  return _publish(output);
+}
+
+shared_dfa_ptr DFAUtil::get_permuted(shared_dfa_ptr dfa_in, const std::vector<int>& permutation_in)
+{
+  // output layer permutation_in[layer] reads input layer layer. built
+  // with the fewest adjacent layer swaps, each rebuilding just the two
+  // swapped layers and sharing the files of the rest.
+
+  Profile profile("get_permuted");
+
+  const dfa_shape_t& shape_in = dfa_in->get_shape();
+  int ndim = int(shape_in.size());
+  assert(permutation_in.size() == ndim);
+
+  dfa_shape_t shape_out(ndim, 0);
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      assert(0 <= permutation_in[layer]);
+      assert(permutation_in[layer] < ndim);
+      assert(shape_out[permutation_in[layer]] == 0);
+      shape_out[permutation_in[layer]] = shape_in[layer];
+    }
+
+  if(std::is_sorted(permutation_in.begin(), permutation_in.end()))
+    {
+      return dfa_in;
+    }
+  else if(dfa_in->is_constant(false))
+    {
+      return get_reject(shape_out);
+    }
+  else if(dfa_in->is_constant(true))
+    {
+      return get_accept(shape_out);
+    }
+
+  std::ostringstream oss;
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      oss << ((layer > 0) ? "_" : ",layers=") << permutation_in[layer];
+    }
+  std::string permute_name = _cache_name("permute_cache/" + dfa_in->get_hash(), oss.str());
 
-  return load_or_build(dfa_in->get_shape(), inverse_name, [&]()
+  return load_or_build(shape_out, permute_name, [&]()
   {
-    return shared_dfa_ptr(new InverseDFA(*dfa_in));
+    // bubble sort the layers into place. carrying one layer at a time
+    // keeps the intermediate DFAs near the input's size, where rounds
+    // of many disjoint swaps (odd-even transposition) pass through
+    // orders with far more states.
+    std::vector<int> targets(permutation_in);
+    shared_dfa_ptr output = dfa_in;
+    for(bool swapped = true; swapped; )
+      {
+	swapped = false;
+	for(int layer = 0; layer + 1 < ndim; ++layer)
+	  {
+	    if(targets[layer] > targets[layer + 1])
+	      {
+		output = shared_dfa_ptr(new SwapDFA(*output, layer));
+		std::swap(targets[layer], targets[layer + 1]);
+		swapped = true;
+	      }
+	  }
+      }
+
+    assert(output->get_shape() == shape_out);
+    return output;
   });
 }
 
+size_t DFAUtil::get_reduce_memory_budget()
+{
+  return BoundedTasks::get_memory_budget();
+}
+
+size_t DFAUtil::get_reduce_workers()
+{
+  return BoundedTasks::get_workers();
+}
+
 shared_dfa_ptr DFAUtil::get_reject(const dfa_shape_t& shape_in)
 {
   // returns a singleton per shape
 
   static std::map<std::string, shared_dfa_ptr> singletons;
+  std::lock_guard<std::mutex> singletons_lock(singletons_mutex);
 
   std::string singleton_key = _shape_string(shape_in);
   auto search = singletons.find(singleton_key);
@@ -580,6 +1299,83 @@ shared_dfa_ptr DFAUtil::get_reject(const dfa_shape_t& shape_in)
   return output;
 }
 
+shared_dfa_ptr DFAUtil::get_relabeled(shared_dfa_ptr dfa_in, const std::vector<std::vector<int>>& maps_in)
+{
+  // maps_in[layer][c] is the new character replacing c in layer.
+
+  Profile profile("get_relabeled");
+
+  const dfa_shape_t& shape_in = dfa_in->get_shape();
+  int ndim = int(shape_in.size());
+  assert(maps_in.size() == ndim);
+
+  dfa_shape_t shape_out(ndim);
+  bool changes_found = false;
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      const std::vector<int>& layer_map = maps_in[layer];
+      assert(layer_map.size() == shape_in[layer]);
+
+      shape_out[layer] = *std::max_element(layer_map.begin(), layer_map.end()) + 1;
+      for(int c = 0; c < layer_map.size(); ++c)
+	{
+	  changes_found = changes_found || (layer_map[c] != c);
+	}
+    }
+
+  if(!changes_found)
+    {
+      return dfa_in;
+    }
+  else if(dfa_in->is_constant(false))
+    {
+      return get_reject(shape_out);
+    }
+  else if(dfa_in->is_constant(true))
+    {
+      return get_accept(shape_out);
+    }
+
+  // cached relabel. a map shared by every layer is only listed once.
+
+  auto get_map_string = [](const std::vector<int>& layer_map)
+  {
+    std::ostringstream oss;
+    for(int c = 0; c < layer_map.size(); ++c)
+      {
+	oss << ((c > 0) ? "," : "") << layer_map[c];
+      }
+    return oss.str();
+  };
+
+  std::ostringstream oss;
+  if(std::all_of(maps_in.begin(), maps_in.end(), [&](const std::vector<int>& layer_map) {return layer_map == maps_in[0];}))
+    {
+      oss << "_all=" << get_map_string(maps_in[0]);
+    }
+  else
+    {
+      for(int layer = 0; layer < ndim; ++layer)
+	{
+	  const std::vector<int>& layer_map = maps_in[layer];
+	  for(int c = 0; c < layer_map.size(); ++c)
+	    {
+	      if(layer_map[c] != c)
+		{
+		  oss << "_" << layer << "=" << get_map_string(layer_map);
+		  break;
+		}
+	    }
+	}
+    }
+  std::string relabel_name = _cache_name("relabel_cache/" + dfa_in->get_hash(), oss.str());
+
+  return load_or_build(shape_out, relabel_name, [&]()
+  {
+    return shared_dfa_ptr(new RelabelDFA(*dfa_in, maps_in));
+  });
+}
+
 shared_dfa_ptr DFAUtil::get_union(shared_dfa_ptr left_in, shared_dfa_ptr right_in)
 {
   Profile profile("get_union");
@@ -664,29 +1460,50 @@ shared_dfa_ptr DFAUtil::get_union_vector(const dfa_shape_t& shape_in, const std:
       std::cout << std::endl;
     }
 
-  return _reduce_aci(get_union, dfas_in);
+  return _reduce_aci(get_union, union_function, dfas_in);
+}
+
+bool DFAUtil::is_disjoint(shared_dfa_ptr left_in, shared_dfa_ptr right_in)
+{
+  return !find_intersection(left_in, right_in);
+}
+
+bool DFAUtil::is_equal(shared_dfa_ptr left_in, shared_dfa_ptr right_in)
+{
+  return is_subset(left_in, right_in) && is_subset(right_in, left_in);
+}
+
+bool DFAUtil::is_subset(shared_dfa_ptr left_in, shared_dfa_ptr right_in)
+{
+  return !find_difference(left_in, right_in);
 }
 
 shared_dfa_ptr DFAUtil::load_by_hash(const dfa_shape_t& shape_in, std::string hash_in)
 {
 #if 1
-  static std::unordered_map<std::string, std::weak_ptr<const DFA>> _dfas_by_hash;
+  {
+    std::lock_guard<std::mutex> dfas_by_hash_lock(dfas_by_hash_mutex);
+    auto search = dfas_by_hash.find(hash_in);
+    if(search != dfas_by_hash.end())
+      {
+	std::weak_ptr<const DFA> weak_dfa = search->second;
+	if(shared_dfa_ptr dfa = weak_dfa.lock())
+	  {
+	    return dfa;
+	  }
+      }
+  }
 
-  auto search = _dfas_by_hash.find(hash_in);
-  if(search != _dfas_by_hash.end())
-    {
-      std::weak_ptr<const DFA> weak_dfa = search->second;
-      if(shared_dfa_ptr dfa = weak_dfa.lock())
-	{
-	  return dfa;
-	}
-    }
+  // touched first so concurrent collections leave it alone until the
+  // pin below is written.
+  ScratchGC::touch(hash_in);
 
   std::string name = "dfas_by_hash/" + hash_in;
   shared_dfa_ptr dfa = _try_load(shape_in, name);
   if(dfa)
     {
-      _dfas_by_hash[hash_in] = dfa;
+      // another thread may have loaded it first
+      dfa = _publish(dfa);
     }
   return dfa;
 #else
@@ -697,48 +1514,160 @@ shared_dfa_ptr DFAUtil::load_by_hash(const dfa_shape_t& shape_in, std::string ha
 
 shared_dfa_ptr DFAUtil::load_by_name(const dfa_shape_t& shape_in, std::string name_in)
 {
-  Profile profile("load " + name_in);
-
-  std::optional<std::string> hash = DFA::parse_hash(name_in);
-  if(hash)
+  shared_dfa_ptr output = try_load_by_name(shape_in, name_in);
+  if(!output)
     {
-      return load_by_hash(shape_in, *hash);
+      throw std::runtime_error("DFA not found: " + name_in);
     }
 
-  return shared_dfa_ptr(new DFA(shape_in, name_in));
+  return output;
 }
 
 shared_dfa_ptr DFAUtil::load_or_build(const dfa_shape_t& shape_in, std::string name_in, std::function<shared_dfa_ptr()> build_func)
 {
-  Profile profile("load_or_build " + name_in);
+  // names go in the prefix, since profile totals are kept per label
+  // for the whole process.
+  Profile profile("load_or_build");
+  profile.set_prefix(name_in);
+
+  auto load_func = [&]()
+  {
+    shared_dfa_ptr loaded = try_load_by_name(shape_in, name_in);
+    if(loaded)
+      {
+	loaded->set_name("saved(\"" + name_in + "\")");
+	std::cout << "loaded " << name_in << " => " << DFAUtil::quick_stats(loaded) << std::endl;
+      }
+
+    return loaded;
+  };
 
   profile.tic("load");
+  shared_dfa_ptr loaded = load_func();
+  if(loaded)
+    {
+      return loaded;
+    }
+
+  // claim the build, or wait for another thread already building it
+
+  std::promise<shared_dfa_ptr> build_promise;
+  {
+    std::unique_lock<std::mutex> building_lock(building_mutex);
+    auto search = building.find(name_in);
+    if(search != building.end())
+      {
+	std::shared_future<shared_dfa_ptr> pending = search->second;
+	building_lock.unlock();
+
+	profile.tic("wait");
+	std::cout << "waiting for " << name_in << std::endl;
+	return pending.get();
+      }
+
+    building[name_in] = build_promise.get_future().share();
+  }
+
+  auto release_build = [&]()
+  {
+    std::lock_guard<std::mutex> building_lock(building_mutex);
+    building.erase(name_in);
+  };
+
   try
     {
-      shared_dfa_ptr output = load_by_name(shape_in, name_in);
-      if(output)
+      // claim the build across processes sharing scratch/, or wait for
+      // another process building it.
+
+      profile.tic("lease");
+      std::unique_ptr<BuildLease> lease = BuildLease::try_acquire("scratch/" + name_in + ".lock");
+      auto poll_delay = std::chrono::milliseconds(10);
+      while(!lease)
 	{
-	  output->set_name("saved(\"" + name_in + "\")");
-	  std::cout << "loaded " << name_in << " => " << DFAUtil::quick_stats(output) << std::endl;
+	  if(poll_delay == std::chrono::milliseconds(10))
+	    {
+	      std::cout << "waiting for other process building " << name_in << std::endl;
+	    }
+	  std::this_thread::sleep_for(poll_delay);
+	  poll_delay = std::min(poll_delay * 2, std::chrono::milliseconds(1000));
+
+	  loaded = load_func();
+	  if(loaded)
+	    {
+	      build_promise.set_value(loaded);
+	      release_build();
+	      return loaded;
+	    }
+
+	  lease = BuildLease::try_acquire("scratch/" + name_in + ".lock");
+	}
 
-	  return output;
+      // another thread or process may have finished between the load
+      // and the claim.
+      loaded = load_func();
+      if(loaded)
+	{
+	  build_promise.set_value(loaded);
+	  release_build();
+	  return loaded;
 	}
+
+      profile.tic("gc");
+      _collect_garbage_if_low();
+
+      profile.tic("build");
+      std::cout << "building " << name_in << std::endl;
+      shared_dfa_ptr output = build_func();
+
+      profile.tic("stats");
+      std::cout << "built " << name_in << " => " << output->states() << " states" << std::endl;
+
+      profile.tic("save");
+      // build functions may return DFAs shared with other threads, so
+      // the DFA serializes its own save and the map lock only covers
+      // publishing it.
+      output->set_name("saved(\"" + name_in + "\")");
+      output->save(name_in);
+      _publish(output);
+
+      build_promise.set_value(output);
+      release_build();
+      return output;
     }
-  catch(const std::runtime_error& e)
+  catch(...)
     {
+      build_promise.set_exception(std::current_exception());
+      release_build();
+      throw;
     }
+}
 
-  profile.tic("build");
-  std::cout << "building " << name_in << std::endl;
-  shared_dfa_ptr output = build_func();
-  output->set_name("saved(\"" + name_in + "\")");
+void DFAUtil::set_reduce_memory_budget(size_t memory_budget_in)
+{
+  BoundedTasks::set_memory_budget(memory_budget_in);
+}
 
-  profile.tic("stats");
-  std::cout << "built " << name_in << " => " << output->states() << " states" << std::endl;
+void DFAUtil::set_reduce_workers(size_t workers_in)
+{
+  BoundedTasks::set_workers(workers_in);
+}
 
-  profile.tic("save");
-  output->save(name_in);
-  return output;
+shared_dfa_ptr DFAUtil::try_load_by_name(const dfa_shape_t& shape_in, std::string name_in)
+{
+  // load by name, returning NULL if the name has not been saved.
+
+  Profile profile("load");
+  profile.set_prefix(name_in);
+
+  std::optional<std::string> hash = (name_in.starts_with("dfas_by_hash/")
+                                     ? DFA::parse_hash(name_in)
+                                     : _name_index_lookup(name_in));
+  if(!hash)
+    {
+      return shared_dfa_ptr();
+    }
+
+  return load_by_hash(shape_in, *hash);
 }
 
 std::string DFAUtil::quick_stats(shared_dfa_ptr dfa_in)
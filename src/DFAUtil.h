@@ -5,6 +5,7 @@
 
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -15,9 +16,14 @@ class DFAUtil
 {
 public:
 
+  static void collect_garbage(size_t);
+  static std::optional<DFAString> find_difference(shared_dfa_ptr, shared_dfa_ptr);
+  static std::optional<DFAString> find_intersection(shared_dfa_ptr, shared_dfa_ptr);
   static shared_dfa_ptr from_string(const DFAString&);
   static shared_dfa_ptr from_strings(const dfa_shape_t&, const std::vector<DFAString>&);
   static shared_dfa_ptr get_accept(const dfa_shape_t&);
+  static shared_dfa_ptr get_canonical(shared_dfa_ptr, const std::vector<std::vector<int>>&); // symmetric closure limited to canonical filter
+  static shared_dfa_ptr get_canonical_filter(const dfa_shape_t&, const std::vector<std::vector<int>>&); // at least the lexicographic minimum of each orbit
   static shared_dfa_ptr get_change(shared_dfa_ptr, const change_vector&);
   static shared_dfa_ptr get_count_character(const dfa_shape_t&, int, int);
   static shared_dfa_ptr get_count_character(const dfa_shape_t&, int, int, int);
@@ -28,13 +34,23 @@ public:
   static shared_dfa_ptr get_intersection(shared_dfa_ptr, shared_dfa_ptr);
   static shared_dfa_ptr get_intersection_vector(const dfa_shape_t&, const std::vector<shared_dfa_ptr>&);
   static shared_dfa_ptr get_inverse(shared_dfa_ptr);
+  static shared_dfa_ptr get_permuted(shared_dfa_ptr, const std::vector<int>&); // output layer permutation[layer] reads input layer layer
+  static size_t get_reduce_memory_budget();
+  static size_t get_reduce_workers();
   static shared_dfa_ptr get_reject(const dfa_shape_t&);
+  static shared_dfa_ptr get_relabeled(shared_dfa_ptr, const std::vector<std::vector<int>>&); // layer characters replaced by per-layer maps onto new shapes
   static shared_dfa_ptr get_union(shared_dfa_ptr, shared_dfa_ptr);
   static shared_dfa_ptr get_union_vector(const dfa_shape_t&, const std::vector<shared_dfa_ptr>&);
+  static bool is_disjoint(shared_dfa_ptr, shared_dfa_ptr);
+  static bool is_equal(shared_dfa_ptr, shared_dfa_ptr);
+  static bool is_subset(shared_dfa_ptr, shared_dfa_ptr);
   static shared_dfa_ptr load_by_hash(const dfa_shape_t&, std::string);
   static shared_dfa_ptr load_by_name(const dfa_shape_t&, std::string);
   static shared_dfa_ptr load_or_build(const dfa_shape_t&, std::string, std::function<shared_dfa_ptr()>);
   static std::string quick_stats(shared_dfa_ptr);
+  static void set_reduce_memory_budget(size_t);
+  static void set_reduce_workers(size_t);
+  static shared_dfa_ptr try_load_by_name(const dfa_shape_t&, std::string);
 };
 
 #endif
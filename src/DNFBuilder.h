@@ -3,6 +3,10 @@
 // Builds DFA representing union of intersections of DFAs.
 //
 // Like https://en.wikipedia.org/wiki/Disjunctive_normal_form but with DFAs instead of literals.
+//
+// All clauses are collected before evaluation, so independent clause
+// intersections can run concurrently and the final union is one
+// balanced reduction instead of a sequence of incremental merges.
 
 #ifndef DNF_BUILDER_H
 #define DNF_BUILDER_H
@@ -23,15 +27,14 @@ class DNFBuilder
   dfa_shape_t shape;
   std::vector<clause_type> clauses;
 
-  void compact(size_t);
-  void compact_last(size_t);
-  void compact_longest();
+  shared_dfa_ptr evaluate_clause(const clause_type&) const;
 
  public:
 
   DNFBuilder(const dfa_shape_t& shape_in);
 
   void add_clause(const clause_type&);
+  void add_clauses(const std::vector<clause_type>&);
   shared_dfa_ptr to_dfa();
 };
 
@@ -10,6 +10,12 @@ DedupedDFA::DedupedDFA(const dfa_shape_t& shape_in)
 {
 }
 
+DedupedDFA::DedupedDFA(const dfa_shape_t& shape_in, const dfa_in_memory_t& in_memory_in)
+  : DFA(shape_in, in_memory_in),
+    state_lookup(new DFATransitionsMap[this->get_shape_size()])
+{
+}
+
 DedupedDFA::~DedupedDFA()
 {
   if(this->state_lookup)
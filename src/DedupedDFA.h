@@ -52,6 +52,7 @@ class DedupedDFA
  protected:
 
   DedupedDFA(const dfa_shape_t&);
+  DedupedDFA(const dfa_shape_t&, const dfa_in_memory_t&);
 
   virtual dfa_state_t add_state(int, const DFATransitionsStaging&);
   virtual void set_initial_state(dfa_state_t);
@@ -3,7 +3,8 @@
 #include "DifferenceRestartDFA.h"
 
 DifferenceRestartDFA::DifferenceRestartDFA(const DFA& left_in,
-                                 const DFA& right_in)
-  : BinaryRestartDFA(left_in, right_in, difference_function)
+                                 const DFA& right_in,
+                                           std::string workspace_in)
+  : BinaryRestartDFA(left_in, right_in, difference_function, workspace_in)
 {
 }
@@ -10,7 +10,7 @@ class DifferenceRestartDFA : public BinaryRestartDFA
 {
  public:
 
-  DifferenceRestartDFA(const DFA&, const DFA&);
+  DifferenceRestartDFA(const DFA&, const DFA&, std::string);
 };
 
 #endif
@@ -3,7 +3,7 @@
 #include "FixedDFA.h"
 
 FixedDFA::FixedDFA(const dfa_shape_t& shape_in, int fixed_square, int fixed_character)
-  : DedupedDFA(shape_in)
+  : DedupedDFA(shape_in, dfa_in_memory_t())
 {
   // 1 state until the fixed square, then a reject state and accept
   // state until the penultimate (mask) layer.
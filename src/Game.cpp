@@ -16,6 +16,12 @@
 #include "DNFBuilder.h"
 #include "Profile.h"
 
+#ifndef GAME_INCREMENTAL_BACKWARD
+#define GAME_INCREMENTAL_BACKWARD true
+#endif
+
+static bool incremental_backward = GAME_INCREMENTAL_BACKWARD;
+
 Game::Game(std::string name_in, const dfa_shape_t& shape_in)
   : name(name_in),
     shape(shape_in)
@@ -39,8 +45,32 @@ void Game::build_move_graphs(int side_to_move) const
       return;
     }
 
+  // compiled graphs are saved per game and side, so later processes
+  // skip rebuilding the condition DFAs. remove scratch/<game>/move_graph*
+  // after changing a game's move generation.
+
+  std::string name_forward = get_move_graph_name("forward", side_to_move);
+  std::string name_backward = get_move_graph_name("backward", side_to_move);
+
+  profile.tic("load");
+  std::optional<MoveGraph> loaded_forward = MoveGraph::load(shape, name_forward);
+  std::optional<MoveGraph> loaded_backward = MoveGraph::load(shape, name_backward);
+  if(loaded_forward && loaded_backward)
+    {
+      move_graphs_forward[side_to_move] = *loaded_forward;
+      move_graphs_backward[side_to_move] = *loaded_backward;
+      move_graphs_ready[side_to_move] = true;
+      return;
+    }
+
+  profile.tic("build");
   move_graphs_forward[side_to_move] = build_move_graph(side_to_move).optimize();
   move_graphs_backward[side_to_move] = move_graphs_forward[side_to_move].reverse().optimize();
+
+  profile.tic("save");
+  move_graphs_forward[side_to_move].save(name_forward);
+  move_graphs_backward[side_to_move].save(name_backward);
+
   move_graphs_ready[side_to_move] = true;
 }
 
@@ -63,15 +93,50 @@ shared_dfa_ptr Game::build_positions_losing(int side_to_move, int ply_max) const
 	}
     }
 
+  // incremental case
+
+  if(incremental_backward && (ply_max >= 3))
+    {
+      return build_positions_losing_incremental(side_to_move, ply_max);
+    }
+
   // recursive case
 
   shared_dfa_ptr opponent_winning_sooner = get_positions_winning(1 - side_to_move, ply_max - 1);
-  shared_dfa_ptr opponent_not_winning_sooner = DFAUtil::get_inverse(opponent_winning_sooner);
-  shared_dfa_ptr not_losing_soon = get_moves_backward(side_to_move, opponent_not_winning_sooner);
-  shared_dfa_ptr losing_soon = DFAUtil::get_difference(get_has_moves(side_to_move), not_losing_soon);
+  shared_dfa_ptr only_losing_soon = get_moves_backward_universal(side_to_move, opponent_winning_sooner);
+  shared_dfa_ptr losing_soon = DFAUtil::get_intersection(get_has_moves(side_to_move), only_losing_soon);
   return DFAUtil::get_union(losing_soon, lost);
 }
 
+shared_dfa_ptr Game::build_positions_losing_incremental(int side_to_move, int ply_max) const
+{
+  // positions newly losing must have a move into the opponent's new
+  // wins, and only lose if none of their moves escape them.
+
+  assert(ply_max >= 3);
+
+  shared_dfa_ptr losing_before = get_positions_losing(side_to_move, ply_max - 2);
+  shared_dfa_ptr opponent_winning_sooner = get_positions_winning(1 - side_to_move, ply_max - 1);
+  shared_dfa_ptr opponent_winning_new = DFAUtil::get_difference(opponent_winning_sooner,
+								get_positions_winning(1 - side_to_move, ply_max - 3));
+  if(opponent_winning_new->is_constant(0))
+    {
+      return losing_before;
+    }
+
+  shared_dfa_ptr candidates = DFAUtil::get_difference(get_moves_backward(side_to_move, opponent_winning_new),
+						      losing_before);
+  if(candidates->is_constant(0))
+    {
+      return losing_before;
+    }
+
+  shared_dfa_ptr escapes = DFAUtil::get_difference(get_moves_forward(side_to_move, candidates),
+						   opponent_winning_sooner);
+  shared_dfa_ptr escaping = DFAUtil::get_intersection(get_moves_backward(side_to_move, escapes), candidates);
+  return DFAUtil::get_union(losing_before, DFAUtil::get_difference(candidates, escaping));
+}
+
 shared_dfa_ptr Game::build_positions_lost(int /* side_to_move */) const
 {
   // default implementation. build_positions_lost or
@@ -105,6 +170,13 @@ shared_dfa_ptr Game::build_positions_winning(int side_to_move, int ply_max) cons
 	}
     }
 
+  // incremental case
+
+  if(incremental_backward && (ply_max >= 3))
+    {
+      return build_positions_winning_incremental(side_to_move, ply_max);
+    }
+
   // recursive case
 
   shared_dfa_ptr losing_sooner = this->get_positions_losing(1 - side_to_move, ply_max - 1);
@@ -113,6 +185,24 @@ shared_dfa_ptr Game::build_positions_winning(int side_to_move, int ply_max) cons
   return DFAUtil::get_union(won, winning_soon);
 }
 
+shared_dfa_ptr Game::build_positions_winning_incremental(int side_to_move, int ply_max) const
+{
+  // moves distribute over unions, so only the opponent's new losses
+  // need to be moved backward.
+
+  assert(ply_max >= 3);
+
+  shared_dfa_ptr winning_before = get_positions_winning(side_to_move, ply_max - 2);
+  shared_dfa_ptr losing_new = DFAUtil::get_difference(get_positions_losing(1 - side_to_move, ply_max - 1),
+						      get_positions_losing(1 - side_to_move, ply_max - 3));
+  if(losing_new->is_constant(0))
+    {
+      return winning_before;
+    }
+
+  return DFAUtil::get_union(winning_before, get_moves_backward(side_to_move, losing_new));
+}
+
 shared_dfa_ptr Game::build_positions_won(int /* side_to_move */) const
 {
   // default implementation. build_positions_lost or
@@ -138,6 +228,11 @@ bool Game::can_reverse() const
   return *reverse_implemented;
 }
 
+bool Game::get_incremental_backward()
+{
+  return incremental_backward;
+}
+
 shared_dfa_ptr Game::get_has_moves(int side_to_move) const
 {
   Profile profile("get_has_moves");
@@ -162,6 +257,28 @@ const MoveGraph& Game::get_move_graph_forward(int side_to_move) const
   return move_graphs_forward[side_to_move];
 }
 
+MoveGraph Game::get_move_graph_unoptimized(int side_to_move) const
+{
+  assert((0 <= side_to_move) && (side_to_move < 2));
+
+  return build_move_graph(side_to_move);
+}
+
+std::string Game::get_move_graph_name(std::string direction_in, int side_to_move) const
+{
+  return std::format("{:s}/move_graph,{:s},side_to_move={:d}", name, direction_in, side_to_move);
+}
+
+shared_dfa_ptr Game::get_moves(const MoveGraph& move_graph_in, std::string move_graph_name, std::string name_prefix, shared_dfa_ptr positions_in) const
+{
+  if(moves_handler)
+    {
+      return moves_handler(move_graph_in, move_graph_name, name_prefix, positions_in);
+    }
+
+  return move_graph_in.get_moves(name_prefix, positions_in);
+}
+
 shared_dfa_ptr Game::get_moves_backward(int side_to_move, shared_dfa_ptr positions_in) const
 {
   Profile profile("get_moves_backward");
@@ -173,7 +290,27 @@ shared_dfa_ptr Game::get_moves_backward(int side_to_move, shared_dfa_ptr positio
   build_move_graphs(side_to_move);
 
   std::string name_prefix = std::format("{:s},backward,side_to_move={:d}", name, side_to_move);
-  return move_graphs_backward[side_to_move].get_moves(name_prefix, positions_in);
+  return get_moves(move_graphs_backward[side_to_move], get_move_graph_name("backward", side_to_move), name_prefix, positions_in);
+}
+
+shared_dfa_ptr Game::get_moves_backward_universal(int side_to_move, shared_dfa_ptr positions_in) const
+{
+  Profile profile("get_moves_backward_universal");
+
+  assert(0 <= side_to_move);
+  assert(side_to_move < 2);
+  assert(positions_in);
+
+  if(moves_handler)
+    {
+      // handlers apply plain moves, so take the complements here
+      return DFAUtil::get_inverse(get_moves_backward(side_to_move, DFAUtil::get_inverse(positions_in)));
+    }
+
+  build_move_graphs(side_to_move);
+
+  std::string name_prefix = std::format("{:s},backward,side_to_move={:d}", name, side_to_move);
+  return move_graphs_backward[side_to_move].get_moves_universal(name_prefix, positions_in);
 }
 
 shared_dfa_ptr Game::get_moves_forward(int side_to_move, shared_dfa_ptr positions_in) const
@@ -187,7 +324,7 @@ shared_dfa_ptr Game::get_moves_forward(int side_to_move, shared_dfa_ptr position
   build_move_graphs(side_to_move);
 
   std::string name_prefix = std::format("{:s},forward,side_to_move={:d}", name, side_to_move);
-  return move_graphs_forward[side_to_move].get_moves(name_prefix, positions_in);
+  return get_moves(move_graphs_forward[side_to_move], get_move_graph_name("forward", side_to_move), name_prefix, positions_in);
 }
 
 std::string Game::get_name() const
@@ -223,6 +360,11 @@ std::string Game::get_name_won(int side_to_move) const
   return "won,side_to_move=" + std::to_string(side_to_move);
 }
 
+shared_dfa_ptr Game::get_positions_canonical(shared_dfa_ptr positions_in) const
+{
+  return DFAUtil::get_canonical(positions_in, get_symmetries());
+}
+
 shared_dfa_ptr Game::get_positions_forward(int ply) const
 {
   assert(ply >= 0);
@@ -242,6 +384,87 @@ shared_dfa_ptr Game::get_positions_forward(int ply) const
 		       });
 }
 
+shared_dfa_ptr Game::get_positions_forward_canonical(int ply) const
+{
+  // canonical representatives of the symmetric closure of the forward
+  // positions, since moves commute with the symmetries.
+
+  assert(ply >= 0);
+
+  return load_or_build(std::format("forward,canonical,ply={:03d}", ply), [&]()
+  {
+    if(ply == 0)
+      {
+	return get_positions_canonical(get_positions_initial());
+      }
+
+    shared_dfa_ptr previous = get_positions_forward_canonical(ply - 1);
+    return get_positions_canonical(get_moves_forward((ply - 1) % 2, previous));
+  });
+}
+
+shared_dfa_ptr Game::get_positions_forward_closure(int side_to_move) const
+{
+  // all positions reachable with the given side to move, found by
+  // expanding frontiers until no new positions turn up.
+
+  assert((0 <= side_to_move) && (side_to_move < 2));
+
+  return load_or_build("forward_closure,side_to_move=" + std::to_string(side_to_move), [&]()
+  {
+    int ply = 0;
+    while(!get_positions_forward_frontier(ply)->is_constant(0))
+      {
+	++ply;
+      }
+
+    // later frontiers are all empty, so the seen sets are final
+    assert(ply > 0);
+    return get_positions_forward_seen((ply % 2 == side_to_move) ? ply : ply - 1);
+  });
+}
+
+shared_dfa_ptr Game::get_positions_forward_frontier(int ply) const
+{
+  // positions first reached after the given ply. only the previous
+  // frontier is expanded, since the successors of positions seen
+  // earlier were already found.
+
+  assert(ply >= 0);
+
+  std::ostringstream name_builder;
+  name_builder << "forward_frontier,ply=" << std::setfill('0') << std::setw(3) << ply;
+  return load_or_build(name_builder.str(), [&]()
+  {
+    if(ply == 0)
+      {
+	return get_positions_initial();
+      }
+
+    shared_dfa_ptr previous = get_positions_forward_frontier(ply - 1);
+    shared_dfa_ptr reached = get_moves_forward((ply - 1) % 2, previous);
+    return DFAUtil::get_difference(reached, get_positions_forward_seen(ply - 2));
+  });
+}
+
+shared_dfa_ptr Game::get_positions_forward_seen(int ply) const
+{
+  // positions reached within the given ply with the same side to move
+
+  if(ply < 0)
+    {
+      return DFAUtil::get_reject(shape);
+    }
+
+  std::ostringstream name_builder;
+  name_builder << "forward_seen,ply=" << std::setfill('0') << std::setw(3) << ply;
+  return load_or_build(name_builder.str(), [&]()
+  {
+    return DFAUtil::get_union(get_positions_forward_seen(ply - 2),
+			      get_positions_forward_frontier(ply));
+  });
+}
+
 shared_dfa_ptr Game::get_positions_initial() const
 {
   return DFAUtil::from_string(get_position_initial());
@@ -266,6 +489,38 @@ shared_dfa_ptr Game::get_positions_losing(int side_to_move, int ply_max) const
   });
 }
 
+shared_dfa_ptr Game::get_positions_losing_canonical(int side_to_move, int ply_max) const
+{
+  // same recursion as build_positions_losing, run on canonical
+  // representatives. the escapes are the canonical positions the
+  // opponent is not winning, so their symmetric closure is everything
+  // the opponent is not winning.
+
+  assert(ply_max >= 0);
+
+  return load_or_build(std::format("backward,canonical,ply_max={:03d},side={:d},losing", ply_max, side_to_move), [&]()
+  {
+    shared_dfa_ptr lost = get_positions_lost(side_to_move);
+    shared_dfa_ptr lost_canonical = get_positions_canonical(lost);
+    if(ply_max <= 0)
+      {
+	return lost_canonical;
+      }
+
+    if(lost->is_constant(0) && (ply_max % 2 == 0))
+      {
+	// all losses will be in an odd number of ply
+	return get_positions_losing_canonical(side_to_move, ply_max - 1);
+      }
+
+    shared_dfa_ptr canonical = DFAUtil::get_canonical_filter(shape, get_symmetries());
+    shared_dfa_ptr escapes = DFAUtil::get_difference(canonical, get_positions_winning_canonical(1 - side_to_move, ply_max - 1));
+    shared_dfa_ptr escaping = get_positions_canonical(get_moves_backward(side_to_move, escapes));
+    shared_dfa_ptr losing_soon = DFAUtil::get_difference(DFAUtil::get_intersection(canonical, get_has_moves(side_to_move)), escaping);
+    return DFAUtil::get_union(losing_soon, lost_canonical);
+  });
+}
+
 shared_dfa_ptr Game::get_positions_lost(int side_to_move) const
 {
   return this->load_or_build(get_name_lost(side_to_move),
@@ -310,17 +565,10 @@ shared_dfa_ptr Game::get_positions_unknown(int side_to_move, int ply_max) const
     shared_dfa_ptr output = DFAUtil::get_inverse(decided);
 
 #ifdef PARANOIA
-    shared_dfa_ptr check_decided = DFAUtil::get_intersection(decided, output);
-    assert(check_decided->is_constant(0));
-
-    shared_dfa_ptr check_winning_subset = DFAUtil::get_difference(winning, decided);
-    assert(check_winning_subset->is_constant(0));
-
-    shared_dfa_ptr check_winning = DFAUtil::get_intersection(winning, output);
-    assert(check_winning->is_constant(0));
-
-    shared_dfa_ptr check_losing = DFAUtil::get_intersection(losing, output);
-    assert(check_losing->is_constant(0));
+    assert(DFAUtil::is_disjoint(decided, output));
+    assert(DFAUtil::is_subset(winning, decided));
+    assert(DFAUtil::is_disjoint(winning, output));
+    assert(DFAUtil::is_disjoint(losing, output));
 #endif
 
     return output;
@@ -346,6 +594,34 @@ shared_dfa_ptr Game::get_positions_winning(int side_to_move, int ply_max) const
   });
 }
 
+shared_dfa_ptr Game::get_positions_winning_canonical(int side_to_move, int ply_max) const
+{
+  // same recursion as build_positions_winning, run on canonical
+  // representatives.
+
+  assert(ply_max >= 0);
+
+  return load_or_build(std::format("backward,canonical,ply_max={:03d},side={:d},winning", ply_max, side_to_move), [&]()
+  {
+    shared_dfa_ptr won = get_positions_won(side_to_move);
+    shared_dfa_ptr won_canonical = get_positions_canonical(won);
+    if(ply_max <= 0)
+      {
+	return won_canonical;
+      }
+
+    if(won->is_constant(0) && (ply_max % 2 == 0))
+      {
+	// all wins will be in an odd number of ply
+	return get_positions_winning_canonical(side_to_move, ply_max - 1);
+      }
+
+    shared_dfa_ptr losing_sooner = get_positions_losing_canonical(1 - side_to_move, ply_max - 1);
+    shared_dfa_ptr winning_soon = get_positions_canonical(get_moves_backward(side_to_move, losing_sooner));
+    return DFAUtil::get_union(won_canonical, winning_soon);
+  });
+}
+
 shared_dfa_ptr Game::get_positions_won(int side_to_move) const
 {
   return this->load_or_build(get_name_won(side_to_move),
@@ -360,6 +636,12 @@ const dfa_shape_t& Game::get_shape() const
   return shape;
 }
 
+std::vector<std::vector<int>> Game::get_symmetries() const
+{
+  // default no symmetries
+  return std::vector<std::vector<int>>();
+}
+
 shared_dfa_ptr Game::load(std::string dfa_name_in) const
 {
   std::string dfa_name = name + "/" + dfa_name_in;
@@ -374,25 +656,29 @@ shared_dfa_ptr Game::load_by_hash(std::string hash_in) const
 shared_dfa_ptr Game::load_by_name(std::string dfa_name_in) const
 {
   // load by name, but return NULL when there's an issue
-  try
-    {
-      std::string dfa_name = name + "/" + dfa_name_in;
-      return DFAUtil::load_by_name(shape, dfa_name);
-    }
-  catch(const std::runtime_error& e)
-    {
-      return shared_dfa_ptr(0);
-    }
+  std::string dfa_name = name + "/" + dfa_name_in;
+  return DFAUtil::try_load_by_name(shape, dfa_name);
 }
 
 shared_dfa_ptr Game::load_or_build(std::string dfa_name_in, std::function<shared_dfa_ptr ()> build_func) const
 {
-  Profile profile("load_or_build " + dfa_name_in);
+  Profile profile("load_or_build");
+  profile.set_prefix(dfa_name_in);
 
   std::string dfa_name = name + "/" + dfa_name_in;
   return DFAUtil::load_or_build(shape, dfa_name, build_func);
 }
 
+void Game::set_incremental_backward(bool incremental_backward_in)
+{
+  incremental_backward = incremental_backward_in;
+}
+
+void Game::set_moves_handler(moves_handler_t moves_handler_in)
+{
+  moves_handler = moves_handler_in;
+}
+
 std::vector<DFAString> Game::validate_moves(int, DFAString) const
 {
   throw std::logic_error(name + " did not implement validate_moves()");
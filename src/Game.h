@@ -3,6 +3,7 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
@@ -28,9 +29,22 @@ private:
 
   virtual MoveGraph build_move_graph(int) const = 0;
   void build_move_graphs(int) const;
+  std::string get_move_graph_name(std::string, int) const;
 
   mutable shared_dfa_ptr singleton_has_moves[2] = {0, 0};
 
+public:
+
+  // applies a move graph to positions, given the graph, its saved
+  // name and the node name prefix.
+  typedef std::function<shared_dfa_ptr(const MoveGraph&, std::string, std::string, shared_dfa_ptr)> moves_handler_t;
+
+private:
+
+  moves_handler_t moves_handler;
+
+  shared_dfa_ptr get_moves(const MoveGraph&, std::string, std::string, shared_dfa_ptr) const;
+
 protected:
 
   Game(std::string, const dfa_shape_t&);
@@ -46,6 +60,12 @@ protected:
   virtual shared_dfa_ptr build_positions_winning(int, int) const;
   virtual shared_dfa_ptr build_positions_won(int) const;
 
+  // extend the same side's results from ply_max - 2 by the positions
+  // decided since, for ply_max >= 3. used by the build functions when
+  // incremental backward plies are on.
+  shared_dfa_ptr build_positions_losing_incremental(int, int) const;
+  shared_dfa_ptr build_positions_winning_incremental(int, int) const;
+
 public:
 
   virtual ~Game();
@@ -56,9 +76,20 @@ public:
 
   shared_dfa_ptr get_has_moves(int) const;
 
+  // backward plies only expand positions decided since the previous
+  // ply of the same side.
+  static bool get_incremental_backward();
+  static void set_incremental_backward(bool);
+
+  // moves can be handed off, for example to spread them over
+  // processes sharing scratch/.
+  void set_moves_handler(moves_handler_t);
+
   const MoveGraph& get_move_graph_forward(int) const;
+  MoveGraph get_move_graph_unoptimized(int) const; // as built by the game, for checking optimize()
 
   shared_dfa_ptr get_moves_backward(int, shared_dfa_ptr) const;
+  shared_dfa_ptr get_moves_backward_universal(int, shared_dfa_ptr) const; // all moves lead into given positions, including no moves
   shared_dfa_ptr get_moves_forward(int, shared_dfa_ptr) const;
 
   std::string get_name() const;
@@ -70,17 +101,30 @@ public:
 
   virtual DFAString get_position_initial() const = 0;
 
+  shared_dfa_ptr get_positions_canonical(shared_dfa_ptr) const; // symmetric closure limited to canonical representatives
   shared_dfa_ptr get_positions_forward(int) const;
+  shared_dfa_ptr get_positions_forward_canonical(int) const;
+  shared_dfa_ptr get_positions_forward_closure(int) const; // all positions reachable with given side to move
+  shared_dfa_ptr get_positions_forward_frontier(int) const; // positions first reached after given ply
+  shared_dfa_ptr get_positions_forward_seen(int) const; // positions reached within given ply, same side to move
   shared_dfa_ptr get_positions_initial() const;
   shared_dfa_ptr get_positions_losing(int, int) const; // side to move loses in at most given ply
+  shared_dfa_ptr get_positions_losing_canonical(int, int) const;
   shared_dfa_ptr get_positions_lost(int) const; // side to move has lost, no moves available
   shared_dfa_ptr get_positions_reachable(int, int) const;
   shared_dfa_ptr get_positions_unknown(int, int) const; // side to move does not have win or loss within given ply
   shared_dfa_ptr get_positions_winning(int, int) const; // side to move wins in at most given ply
+  shared_dfa_ptr get_positions_winning_canonical(int, int) const;
   shared_dfa_ptr get_positions_won(int) const; // side to move has won, no moves available
 
   const dfa_shape_t& get_shape() const;
 
+  // symmetry reduction. games declare generators of layer permutations
+  // that commute with the moves of both sides, and the canonical
+  // variants keep just the canonical representatives of each set.
+
+  virtual std::vector<std::vector<int>> get_symmetries() const;
+
   // saved position access
 
   shared_dfa_ptr load(std::string dfa_name_in) const;
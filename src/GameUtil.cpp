@@ -41,6 +41,48 @@ std::vector<std::pair<int, int>> GameUtil::get_between(int x_begin, int y_begin,
   return output;
 }
 
+std::vector<int> GameUtil::get_board_permutation(int width, int height, std::function<int(int, int)> layer_func, std::function<std::pair<int, int>(int, int)> square_func)
+{
+  std::vector<int> output(width * height, -1);
+  for(int y = 0; y < height; ++y)
+    {
+      for(int x = 0; x < width; ++x)
+	{
+	  auto [x_to, y_to] = square_func(x, y);
+	  assert((0 <= x_to) && (x_to < width));
+	  assert((0 <= y_to) && (y_to < height));
+
+	  output.at(layer_func(x, y)) = layer_func(x_to, y_to);
+	}
+    }
+
+  return output;
+}
+
+std::vector<std::vector<int>> GameUtil::get_board_symmetries(int width, int height, std::function<int(int, int)> layer_func)
+{
+  std::vector<std::vector<int>> output;
+
+  output.push_back(get_board_permutation(width, height, layer_func, [=](int x, int y)
+  {
+    return std::pair<int, int>(width - 1 - x, y);
+  }));
+  output.push_back(get_board_permutation(width, height, layer_func, [=](int x, int y)
+  {
+    return std::pair<int, int>(x, height - 1 - y);
+  }));
+
+  if(width == height)
+    {
+      output.push_back(get_board_permutation(width, height, layer_func, [=](int x, int y)
+      {
+	return std::pair<int, int>(y, x);
+      }));
+    }
+
+  return output;
+}
+
 const std::vector<std::tuple<int, int, std::vector<int>>>& GameUtil::get_queen_moves(int offset, int width, int height)
 {
   static std::vector<std::tuple<int, int, std::vector<int>>> output;
@@ -3,6 +3,7 @@
 #ifndef GAME_UTIL_H
 #define GAME_UTIL_H
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -17,6 +18,8 @@ class GameUtil
 public:
 
   static std::vector<std::pair<int, int>> get_between(int, int, int, int);
+  static std::vector<int> get_board_permutation(int, int, std::function<int(int, int)>, std::function<std::pair<int, int>(int, int)>); // layer permutation moving each square's piece to the given square
+  static std::vector<std::vector<int>> get_board_symmetries(int, int, std::function<int(int, int)>); // mirrors, plus transpose if square
   static const std::vector<std::tuple<int, int, std::vector<int>>>& get_queen_moves(int, int, int);
 };
 
@@ -2,7 +2,7 @@
 
 #include "IntersectionDFA.h"
 
-static const BinaryFunction intersection_function([](bool l, bool r) {return l && r;});
+const BinaryFunction intersection_function([](bool l, bool r) {return l && r;});
 
 IntersectionDFA::IntersectionDFA(const DFA& left_in,
 				 const DFA& right_in)
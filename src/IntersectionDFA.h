@@ -5,6 +5,8 @@
 
 #include "BinaryDFA.h"
 
+extern const BinaryFunction intersection_function;
+
 class IntersectionDFA : public BinaryDFA
 {
  public:
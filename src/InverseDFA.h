@@ -5,6 +5,9 @@
 
 #include "DFA.h"
 
+// complement view sharing the input DFA's layers, so construction is
+// constant time after the input is saved by hash.
+
 class InverseDFA : public DFA
 {
  public:
@@ -7,8 +7,12 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cassert>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <new>
 #include <numeric>
 
 #include "Profile.h"
@@ -197,7 +201,7 @@ MemoryMap<T>::~MemoryMap()
 {
   if(_mapped)
     {
-      this->munmap();
+      this->unmap();
     }
 }
 
@@ -211,7 +215,7 @@ MemoryMap<T>& MemoryMap<T>::operator=(MemoryMap<T>&& other) noexcept
 
   if(_mapped)
     {
-      this->munmap();
+      this->unmap();
     }
 
   _filename = other._filename;
@@ -283,6 +287,14 @@ void MemoryMap<T>::ftruncate(int fildes)
 template<class T>
 void MemoryMap<T>::mmap() const
 {
+  // mapped maps return without locking
+  if(std::atomic_ref<void *>(_mapped).load(std::memory_order_acquire))
+    {
+      return;
+    }
+
+  std::lock_guard<std::mutex> map_lock(*_map_mutex);
+
   if(_mapped)
     {
       return;
@@ -335,26 +347,41 @@ void MemoryMap<T>::mmap(int fildes) const
       return;
     }
 
+  if(_flags & MAP_ANONYMOUS)
+    {
+      // anonymous maps live on the heap, so many small ones do not
+      // each cost a mapping against the process limit.
+      void *allocated = std::calloc(_size, sizeof(T));
+      if(!allocated)
+	{
+	  throw std::bad_alloc();
+	}
+
+      std::atomic_ref<void *>(_mapped).store(allocated, std::memory_order_release);
+      return;
+    }
+
   int prot = PROT_READ;
   if(!_readonly)
     {
       prot |= PROT_WRITE;
     }
 
-  _mapped = ::mmap(0, _length, prot, MAP_SHARED | _flags, fildes, 0);
-  if(_mapped == MAP_FAILED)
+  void *mapped = ::mmap(0, _length, prot, MAP_SHARED | _flags, fildes, 0);
+  if(mapped == MAP_FAILED)
     {
-      _mapped = 0;
       perror("mmap");
       throw std::runtime_error("mmap failed");
     }
-  assert(_mapped);
+  assert(mapped);
+
+  std::atomic_ref<void *>(_mapped).store(mapped, std::memory_order_release);
 }
 
 template<class T>
 void MemoryMap<T>::msync()
 {
-  if(!_mapped)
+  if(!_mapped || (_flags & MAP_ANONYMOUS))
     {
       return;
     }
@@ -369,18 +396,36 @@ void MemoryMap<T>::msync()
 
 template<class T>
 void MemoryMap<T>::munmap() const
+{
+  if(_flags & MAP_ANONYMOUS)
+    {
+      // nothing to reload anonymous maps from, so keep them until
+      // destruction.
+      return;
+    }
+
+  std::lock_guard<std::mutex> map_lock(*_map_mutex);
+  unmap();
+}
+
+template<class T>
+void MemoryMap<T>::unmap() const
 {
   if(!_mapped)
     {
       return;
     }
 
-  if(::munmap(_mapped, _length))
+  if(_flags & MAP_ANONYMOUS)
+    {
+      std::free(_mapped);
+    }
+  else if(::munmap(_mapped, _length))
     {
       throw std::runtime_error("munmap failed");
     }
 
-  _mapped = 0;
+  std::atomic_ref<void *>(_mapped).store(0, std::memory_order_release);
 }
 
 template<class T>
@@ -453,7 +498,7 @@ void MemoryMap<T>::truncate(size_t size_in)
 template <class T>
 void MemoryMap<T>::unlink()
 {
-  munmap();
+  unmap();
 
   if(_flags & MAP_ANONYMOUS)
     {
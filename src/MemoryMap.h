@@ -5,6 +5,8 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 
 template<class T>
@@ -18,10 +20,14 @@ class MemoryMap
   mutable size_t _length;
 
   mutable void *_mapped;
+  // lazy mapping may be triggered by several threads sharing a DFA.
+  // held by pointer so maps stay movable.
+  mutable std::unique_ptr<std::mutex> _map_mutex = std::make_unique<std::mutex>();
 
   void ftruncate(int);
   void mmap(int) const;
   int open(int, int) const;
+  void unmap() const;
 
 public:
 
@@ -2,18 +2,38 @@
 
 #include "MoveGraph.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <unistd.h>
 #include <utility>
 #include <vector>
 
+#include "BoundedTasks.h"
 #include "DFAUtil.h"
 #include "DNFBuilder.h"
 #include "Profile.h"
+#include "utils.h"
+
+// get_moves builds independent nodes concurrently under the shared
+// task limits in BoundedTasks, with at most this many nodes at once.
+
+static size_t workers = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+// guards the size ratios remembered by get_moves
+static std::mutex node_bytes_ratios_mutex;
+
+// bump when the saved graph format changes
+#define MOVE_GRAPH_FORMAT_VERSION 2
 
 static change_vector reverse_changes(const change_vector& changes_in);
 
@@ -85,6 +105,25 @@ void MoveGraph::add_edge(std::string edge_name_in,
 	   move_edge_condition_vector({condition_in}));
 }
 
+void MoveGraph::add_edge_raw(std::string edge_name_in,
+			     int from_node_index,
+			     int to_node_index,
+			     const move_edge_condition_vector& conditions_in)
+{
+  // adds the edge with exactly the given conditions
+
+  if(edge_names.contains(edge_name_in))
+    {
+      throw std::logic_error("add_edge_raw() duplicate edge name");
+    }
+  edge_names.insert(edge_name_in);
+
+  assert(from_node_index < to_node_index);
+
+  node_edges.at(from_node_index).emplace_back(edge_name_in, conditions_in, to_node_index);
+  node_inputs.at(to_node_index).emplace_back(from_node_index, node_edges.at(from_node_index).back());
+}
+
 void MoveGraph::add_node(std::string node_name_in)
 {
   change_vector changes_nop(shape.size());
@@ -143,6 +182,29 @@ void MoveGraph::add_node(std::string node_name_in,
   assert(node_edges.size() == node_names_to_indexes.size());
 }
 
+void MoveGraph::add_node_raw(std::string node_name_in,
+			     const change_vector& changes_in,
+			     const move_edge_condition_vector& pre_conditions_in,
+			     const move_edge_condition_vector& post_conditions_in)
+{
+  // adds the node with exactly the given conditions
+
+  if(node_names_to_indexes.contains(node_name_in))
+    {
+      throw std::logic_error("add_node_raw() duplicate node name");
+    }
+
+  assert(changes_in.size() == shape.size());
+
+  node_names_to_indexes[node_name_in] = int(node_names.size());
+  node_names.push_back(node_name_in);
+  node_changes.push_back(changes_in);
+  node_pre_conditions.push_back(pre_conditions_in);
+  node_post_conditions.push_back(post_conditions_in);
+  node_edges.emplace_back();
+  node_inputs.emplace_back();
+}
+
 void MoveGraph::add_node(std::string node_name_in, int layer_in, int before_character_in, int after_character_in)
 {
   change_vector changes(shape.size());
@@ -158,8 +220,10 @@ shared_dfa_ptr MoveGraph::get_moves(std::string name_prefix, shared_dfa_ptr posi
   assert(node_names.size() >= 2);
   assert(positions_in);
 
+  int num_nodes = int(node_names.size());
+
   std::vector<std::string> output_names;
-  for(int node_index = 0; node_index < node_names.size(); ++node_index)
+  for(int node_index = 0; node_index < num_nodes; ++node_index)
     {
       std::ostringstream output_name_builder;
       output_name_builder << "move_nodes/" << name_prefix << "," << positions_in->get_hash();
@@ -168,17 +232,46 @@ shared_dfa_ptr MoveGraph::get_moves(std::string name_prefix, shared_dfa_ptr posi
       output_names.push_back(output_name_builder.str());
     }
 
+  // condition DFAs are shared by nodes built concurrently, so fill in
+  // their lazy hashes first.
+
+  profile.tic("hashes");
+  for(const std::vector<move_edge>& edges : node_edges)
+    {
+      for(const move_edge& edge : edges)
+	{
+	  for(shared_dfa_ptr condition : std::get<1>(edge))
+	    {
+	      condition->get_hash();
+	    }
+	}
+    }
+
+  // outputs of nodes built here are kept until cleanup so consumers
+  // do not reload them.
+
+  std::mutex node_outputs_mutex;
+  std::vector<shared_dfa_ptr> node_outputs(num_nodes);
+
   std::function<shared_dfa_ptr(int)> get_node_output = [&](int node_index)
   {
+    {
+      std::lock_guard<std::mutex> node_outputs_lock(node_outputs_mutex);
+      if(node_outputs.at(node_index))
+	{
+	  return node_outputs[node_index];
+	}
+    }
+
     std::string output_name = output_names.at(node_index);
 
     return DFAUtil::load_or_build(shape, output_name, [&]()
     {
-      profile.tic("node init");
+      Profile node_profile("get_moves node");
 
-      std::cout << "node " << node_index << "/" << node_names.size() << " (" << node_names[node_index] << ")" << std::endl;
+      std::cout << "node " << node_index << "/" << num_nodes << " (" << node_names[node_index] << ")" << std::endl;
 
-      profile.tic("node inputs");
+      node_profile.tic("node inputs");
 
       DNFBuilder node_builder(positions_in->get_shape());
       if(node_index == 0)
@@ -191,8 +284,6 @@ shared_dfa_ptr MoveGraph::get_moves(std::string name_prefix, shared_dfa_ptr posi
 
 	  for(int node_edge_index = 0; node_edge_index < node_inputs[node_index].size(); ++node_edge_index)
 	    {
-	      profile.tic("edge init");
-
 	      const std::pair<int, move_edge>& from_edge = node_inputs[node_index][node_edge_index];
 
 	      int from_node_index = std::get<0>(from_edge);
@@ -203,44 +294,46 @@ shared_dfa_ptr MoveGraph::get_moves(std::string name_prefix, shared_dfa_ptr posi
 	      int to_node_index = std::get<2>(edge);
 	      assert(to_node_index == node_index);
 
-	      std::cout << " node " << node_index << "/" << node_names.size() << " (" << node_names[node_index] << "), incoming edge " << node_edge_index << "/" << node_inputs[node_index].size() << " (" << edge_name << ")" << std::endl;
+	      std::cout << " node " << node_index << "/" << num_nodes << " (" << node_names[node_index] << "), incoming edge " << node_edge_index << "/" << node_inputs[node_index].size() << " (" << edge_name << ")" << std::endl;
 
 	      shared_dfa_ptr edge_positions = get_node_output(from_node_index);
+	      if(edge_positions->is_constant(0))
+		{
+		  continue;
+		}
 
-	      // apply choice conditions
-	      profile.tic("edge conditions");
-
-	      move_edge_condition_vector conditions_todo = conditions;
-	      conditions_todo.push_back(edge_positions);
-	      edge_positions = DFAUtil::get_intersection_vector(shape, conditions_todo);
-
-	      std::cout << "  conditions for node " << to_node_index << " (" << node_names[to_node_index] << ") => " << DFAUtil::quick_stats(edge_positions) << std::endl;
+	      // choice conditions are applied by the builder, which
+	      // evaluates the clauses of all incoming edges together.
 
-	      node_builder.add_clause(DNFBuilder::clause_type(1, edge_positions));
+	      DNFBuilder::clause_type edge_clause = conditions;
+	      edge_clause.push_back(edge_positions);
+	      node_builder.add_clause(edge_clause);
 	    }
 	}
 
       // combine all positions coming into this node
+      node_profile.tic("node combine");
       shared_dfa_ptr node_positions_input = node_builder.to_dfa();
-      std::cout << " node " << node_index << "/" << node_names.size() << " input: " << DFAUtil::quick_stats(node_positions_input) << std::endl;
+      std::cout << " node " << node_index << "/" << num_nodes << " input: " << DFAUtil::quick_stats(node_positions_input) << std::endl;
       if(node_positions_input->is_constant(0))
 	{
 	  return node_positions_input;
 	}
 
-      profile.tic("node change");
+      node_profile.tic("node change");
 
       return DFAUtil::get_change(node_positions_input,
 				 node_changes[node_index]);
     });
   };
 
-  std::vector<bool> node_todo(node_names.size(), false);
+  profile.tic("todo");
+
+  std::vector<bool> node_todo(num_nodes, false);
+  std::vector<size_t> node_bytes(num_nodes, 0);
   node_todo.back() = true;
-  std::vector<std::vector<int>> cleanup_schedule(node_names.size());
-  for(int node_index = int(node_names.size()) - 1; node_index >= 0; --node_index)
+  for(int node_index = num_nodes - 1; node_index >= 0; --node_index)
     {
-      int last_to_node_index = 0;
       for(const move_edge& edge : node_edges[node_index])
 	{
 	  int to_node_index = std::get<2>(edge);
@@ -248,13 +341,6 @@ shared_dfa_ptr MoveGraph::get_moves(std::string name_prefix, shared_dfa_ptr posi
 	    {
 	      node_todo[node_index] = true;
 	    }
-
-	  last_to_node_index = std::max(last_to_node_index, to_node_index);
-	}
-      if(node_index + 1 < node_names.size())
-	{
-	  // schedule cleanup except the last node
-	  cleanup_schedule.at(last_to_node_index).push_back(node_index);
 	}
 
       if(!node_todo[node_index])
@@ -274,6 +360,7 @@ shared_dfa_ptr MoveGraph::get_moves(std::string name_prefix, shared_dfa_ptr posi
 	      std::cout << "node " << node_index << " is already built." << std::endl;
 #endif
 	      node_todo[node_index] = false;
+	      node_bytes[node_index] = BoundedTasks::get_dfa_bytes(previous);
 	      continue;
 	    }
 	}
@@ -286,21 +373,391 @@ shared_dfa_ptr MoveGraph::get_moves(std::string name_prefix, shared_dfa_ptr posi
 #endif
     }
 
-  for(int node_index = 0; node_index < node_names.size(); ++node_index)
+  // nodes become ready once all their inputs are built. unbuilt
+  // inputs of needed nodes are always needed themselves. each output
+  // except the last is cleaned up once the needed nodes reading it
+  // are done.
+
+  std::vector<std::set<int>> node_from_nodes(num_nodes);
+  std::vector<std::vector<int>> node_todo_outputs(num_nodes);
+  std::vector<size_t> node_inputs_pending(num_nodes, 0);
+  std::vector<size_t> node_consumers_pending(num_nodes, 0);
+  std::set<int> nodes_ready;
+  for(int node_index = 0; node_index < num_nodes; ++node_index)
+    {
+      if(!node_todo[node_index])
+	{
+	  continue;
+	}
+
+      for(const std::pair<int, move_edge>& from_edge : node_inputs[node_index])
+	{
+	  int from_node_index = std::get<0>(from_edge);
+	  if(!node_from_nodes[node_index].contains(from_node_index))
+	    {
+	      node_from_nodes[node_index].insert(from_node_index);
+	      node_consumers_pending[from_node_index] += 1;
+	      if(node_todo[from_node_index])
+		{
+		  node_todo_outputs[from_node_index].push_back(node_index);
+		  node_inputs_pending[node_index] += 1;
+		}
+	    }
+	}
+
+      if(node_inputs_pending[node_index] == 0)
+	{
+	  nodes_ready.insert(node_index);
+	}
+    }
+
+  // live bytes are the outputs built here that still have readers
+  // pending, which is what the node order can change.
+
+  size_t live_bytes = 0;
+  size_t live_bytes_peak = 0;
+
+  auto cleanup_node = [&](int node_index)
+  {
+    std::string cleanup_link = "scratch/" + output_names.at(node_index);
+    unlink(cleanup_link.c_str());
+
+    std::lock_guard<std::mutex> node_outputs_lock(node_outputs_mutex);
+    if(node_outputs[node_index])
+      {
+	live_bytes -= node_bytes[node_index];
+	node_outputs[node_index] = shared_dfa_ptr();
+      }
+  };
+
+  for(int node_index = 0; node_index < num_nodes - 1; ++node_index)
+    {
+      if(node_consumers_pending[node_index] == 0)
+	{
+	  cleanup_node(node_index);
+	}
+    }
+
+  // simulated peak live bytes when building the needed nodes in
+  // the given order with the given output sizes.
+
+  auto get_order_peak = [&](const std::vector<int>& order, const std::vector<double>& sizes)
+  {
+    std::vector<size_t> consumers_pending(num_nodes, 0);
+    for(int node_index : order)
+      {
+	for(int from_node_index : node_from_nodes[node_index])
+	  {
+	    consumers_pending[from_node_index] += 1;
+	  }
+      }
+
+    double live = 0.0;
+    double peak = 0.0;
+    for(int node_index : order)
+      {
+	live += sizes[node_index];
+	peak = std::max(peak, live);
+
+	for(int from_node_index : node_from_nodes[node_index])
+	  {
+	    consumers_pending[from_node_index] -= 1;
+	    if(node_todo[from_node_index] && (consumers_pending[from_node_index] == 0))
+	      {
+		live -= sizes[from_node_index];
+	      }
+	  }
+      }
+
+    return peak;
+  };
+
+  std::vector<int> index_order;
+  for(int node_index = 0; node_index < num_nodes; ++node_index)
+    {
+      if(node_todo[node_index])
+	{
+	  index_order.push_back(node_index);
+	}
+    }
+
+  // plan the node order from output sizes relative to the input seen
+  // on the previous call. the plan is a greedy register allocation
+  // (build the ready node that adds the least to live bytes, counting
+  // the inputs it is the last reader of), kept only if its simulated
+  // peak beats index order.
+
+  profile.tic("plan");
+
+  double input_bytes = std::max(double(BoundedTasks::get_dfa_bytes(positions_in)), 1.0);
+
+  std::vector<int> planned_order = index_order;
+  double planned_peak = 0.0;
+  bool planned = false;
+  {
+    std::lock_guard<std::mutex> node_bytes_ratios_lock(node_bytes_ratios_mutex);
+    if(node_bytes_ratios.size() == num_nodes)
+      {
+	std::vector<double> estimates(num_nodes, 0.0);
+	for(int node_index = 0; node_index < num_nodes; ++node_index)
+	  {
+	    estimates[node_index] = node_todo[node_index] ? node_bytes_ratios[node_index] * input_bytes : 0.0;
+	  }
+
+	std::vector<int> greedy_order;
+	std::vector<size_t> inputs_pending = node_inputs_pending;
+	std::vector<size_t> consumers_pending(num_nodes, 0);
+	for(int node_index : index_order)
+	  {
+	    for(int from_node_index : node_from_nodes[node_index])
+	      {
+		consumers_pending[from_node_index] += 1;
+	      }
+	  }
+
+	std::set<int> ready = nodes_ready;
+	while(ready.size() > 0)
+	  {
+	    int best_node_index = -1;
+	    double best_score = 0.0;
+	    for(int node_index : ready)
+	      {
+		double score = estimates[node_index];
+		for(int from_node_index : node_from_nodes[node_index])
+		  {
+		    if(node_todo[from_node_index] && (consumers_pending[from_node_index] == 1))
+		      {
+			score -= estimates[from_node_index];
+		      }
+		  }
+
+		if((best_node_index < 0) || (score < best_score))
+		  {
+		    best_node_index = node_index;
+		    best_score = score;
+		  }
+	      }
+
+	    ready.erase(best_node_index);
+	    greedy_order.push_back(best_node_index);
+
+	    for(int from_node_index : node_from_nodes[best_node_index])
+	      {
+		consumers_pending[from_node_index] -= 1;
+	      }
+	    for(int to_node_index : node_todo_outputs[best_node_index])
+	      {
+		inputs_pending[to_node_index] -= 1;
+		if(inputs_pending[to_node_index] == 0)
+		  {
+		    ready.insert(to_node_index);
+		  }
+	      }
+	  }
+	assert(greedy_order.size() == index_order.size());
+
+	planned = true;
+	planned_peak = get_order_peak(index_order, estimates);
+	double greedy_peak = get_order_peak(greedy_order, estimates);
+	if(greedy_peak < planned_peak)
+	  {
+	    planned_order = greedy_order;
+	    planned_peak = greedy_peak;
+	  }
+      }
+  }
+
+  std::vector<int> node_ranks(num_nodes, num_nodes);
+  for(int rank = 0; rank < planned_order.size(); ++rank)
     {
-      if(node_todo.at(node_index))
+      node_ranks[planned_order[rank]] = rank;
+    }
+
+  auto get_next_ready = [&]()
+  {
+    return *std::min_element(nodes_ready.begin(), nodes_ready.end(), [&](int a, int b)
+    {
+      return node_ranks[a] < node_ranks[b];
+    });
+  };
+
+  // run ready nodes in the order above, starting another whenever
+  // the shared task limits have room for the estimated memory of its
+  // inputs.
+
+  profile.tic("nodes");
+
+  BoundedTasks tasks(workers);
+  std::map<int, std::chrono::steady_clock::time_point> node_starts;
+  std::vector<int> node_order;
+  std::vector<double> node_seconds(num_nodes, 0.0);
+
+  auto wall_start = std::chrono::steady_clock::now();
+
+  while((nodes_ready.size() > 0) || (tasks.size() > 0))
+    {
+      while(nodes_ready.size() > 0)
 	{
-	  get_node_output(node_index);
+	  int node_index = get_next_ready();
+
+	  size_t memory = 0;
+	  for(int from_node_index : node_from_nodes[node_index])
+	    {
+	      memory += node_bytes[from_node_index];
+	    }
+
+	  node_starts[node_index] = std::chrono::steady_clock::now();
+	  if(!tasks.try_launch(node_index, memory, [&, node_index]()
+	  {
+	    return get_node_output(node_index);
+	  }))
+	    {
+	      break;
+	    }
+
+	  nodes_ready.erase(node_index);
 	}
 
-      for(int cleanup_node_index : cleanup_schedule.at(node_index))
+      assert(tasks.size() > 0);
+
+      // wait for at least one node to finish
+
+      for(auto& [task_id, node_output] : tasks.wait_any())
 	{
-	  std::string cleanup_link = "scratch/" + output_names.at(cleanup_node_index);
-	  unlink(cleanup_link.c_str());
+	  int node_index = int(task_id);
+	  node_seconds[node_index] = std::chrono::duration<double>(std::chrono::steady_clock::now() - node_starts.at(node_index)).count();
+	  node_starts.erase(node_index);
+
+	  node_order.push_back(node_index);
+	  node_bytes[node_index] = BoundedTasks::get_dfa_bytes(node_output);
+	  {
+	    std::lock_guard<std::mutex> node_outputs_lock(node_outputs_mutex);
+	    node_outputs[node_index] = node_output;
+	    live_bytes += node_bytes[node_index];
+	    live_bytes_peak = std::max(live_bytes_peak, live_bytes);
+	  }
+
+	  for(int to_node_index : node_todo_outputs[node_index])
+	    {
+	      node_inputs_pending[to_node_index] -= 1;
+	      if(node_inputs_pending[to_node_index] == 0)
+		{
+		  nodes_ready.insert(to_node_index);
+		}
+	    }
+
+	  for(int from_node_index : node_from_nodes[node_index])
+	    {
+	      node_consumers_pending[from_node_index] -= 1;
+	      if((node_consumers_pending[from_node_index] == 0) && (from_node_index < num_nodes - 1))
+		{
+		  cleanup_node(from_node_index);
+		}
+	    }
 	}
     }
 
-  return get_node_output(int(node_names.size()) - 1);
+  // report the peak against building in index order with the same
+  // sizes, which is what get_moves did before ordering nodes, and
+  // remember the sizes for planning the next call.
+
+  if(node_order.size() > 0)
+    {
+      std::vector<double> sizes(num_nodes, 0.0);
+      for(int node_index : node_order)
+	{
+	  sizes[node_index] = double(node_bytes[node_index]);
+	}
+
+      std::ostringstream report;
+      report << "get_moves " << name_prefix << ": peak " << live_bytes_peak << " live bytes over "
+	     << node_order.size() << " nodes (";
+      if(planned)
+	{
+	  report << "planned " << size_t(planned_peak) << ", ";
+	}
+      report << "index order " << size_t(get_order_peak(index_order, sizes)) << ")";
+
+      std::cout << report.str() << std::endl;
+
+      std::lock_guard<std::mutex> node_bytes_ratios_lock(node_bytes_ratios_mutex);
+      if(node_bytes_ratios.size() != num_nodes)
+	{
+	  node_bytes_ratios.assign(num_nodes, 0.0);
+	}
+      for(int node_index : node_order)
+	{
+	  node_bytes_ratios[node_index] = sizes[node_index] / input_bytes;
+	}
+    }
+
+  // report the critical path through the nodes built, since that
+  // bounds the wall time no matter how many workers are available.
+
+  double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+  std::vector<double> path_seconds(num_nodes, 0.0);
+  std::vector<int> path_previous(num_nodes, -1);
+  int path_last = 0;
+  double node_seconds_total = 0.0;
+  for(int node_index = 0; node_index < num_nodes; ++node_index)
+    {
+      for(const std::pair<int, move_edge>& from_edge : node_inputs[node_index])
+	{
+	  int from_node_index = std::get<0>(from_edge);
+	  if(path_seconds[from_node_index] > path_seconds[node_index])
+	    {
+	      path_seconds[node_index] = path_seconds[from_node_index];
+	      path_previous[node_index] = from_node_index;
+	    }
+	}
+      path_seconds[node_index] += node_seconds[node_index];
+      node_seconds_total += node_seconds[node_index];
+
+      if(path_seconds[node_index] > path_seconds[path_last])
+	{
+	  path_last = node_index;
+	}
+    }
+
+  if(node_seconds_total > 0.0)
+    {
+      std::vector<int> path;
+      for(int node_index = path_last; node_index >= 0; node_index = path_previous[node_index])
+	{
+	  if(node_seconds[node_index] > 0.0)
+	    {
+	      path.push_back(node_index);
+	    }
+	}
+
+      std::ostringstream report;
+      report << "get_moves " << name_prefix << ": " << std::fixed << std::setprecision(3)
+	     << wall_seconds << "s wall, " << node_seconds_total << "s in nodes, critical path "
+	     << path_seconds[path_last] << "s over " << path.size() << " nodes";
+      for(auto iter = path.rbegin(); iter != path.rend(); ++iter)
+	{
+	  report << ((iter == path.rbegin()) ? " (" : ", ") << node_names[*iter];
+	}
+      report << ")";
+
+      std::cout << report.str() << std::endl;
+    }
+
+  return get_node_output(num_nodes - 1);
+}
+
+shared_dfa_ptr MoveGraph::get_moves_universal(std::string name_prefix, shared_dfa_ptr positions_in) const
+{
+  // positions only reached by moves from the given positions (or not
+  // reached at all). on a backward graph these are the positions
+  // whose moves all lead into the given positions. this is the
+  // complement of the moves from the complement, so it takes a single
+  // pass over the graph instead of an existential pass per side.
+
+  assert(positions_in);
+
+  return DFAUtil::get_inverse(get_moves(name_prefix, DFAUtil::get_inverse(positions_in)));
 }
 
 int MoveGraph::get_node_index(std::string node_name_in) const
@@ -319,68 +776,422 @@ const move_edge_condition_vector& MoveGraph::get_node_pre_conditions(std::string
   return node_pre_conditions[get_node_index(node_name_in)];
 }
 
+size_t MoveGraph::get_workers()
+{
+  return workers;
+}
+
+std::optional<MoveGraph> MoveGraph::load(const dfa_shape_t& shape_in, std::string name_in)
+{
+  // loads a graph written by save(), or returns nothing if it is
+  // missing, from another format version, malformed, or a condition
+  // DFA is gone.
+
+  Profile profile("MoveGraph::load");
+
+  std::ifstream graph_file("scratch/" + name_in + "/graph");
+  if(!graph_file)
+    {
+      return std::nullopt;
+    }
+
+  std::string header;
+  int version = 0;
+  if(!(graph_file >> header >> version) ||
+     (header != "move_graph") ||
+     (version != MOVE_GRAPH_FORMAT_VERSION))
+    {
+      return std::nullopt;
+    }
+
+  MoveGraph output(shape_in);
+  std::map<std::string, shared_dfa_ptr> conditions_by_hash;
+
+  auto load_condition = [&](std::string hash) -> shared_dfa_ptr
+  {
+    auto search = conditions_by_hash.find(hash);
+    if(search != conditions_by_hash.end())
+      {
+	return search->second;
+      }
+
+    shared_dfa_ptr condition = DFAUtil::load_by_hash(shape_in, hash);
+    conditions_by_hash[hash] = condition;
+    return condition;
+  };
+
+  // records are collected and then added raw, since add_node() and
+  // add_edge() would derive the node conditions a second time.
+
+  std::vector<std::string> load_node_names;
+  std::vector<change_vector> load_node_changes;
+  std::vector<move_edge_condition_vector> load_node_pre_conditions;
+  std::vector<move_edge_condition_vector> load_node_post_conditions;
+  std::vector<std::pair<int, move_edge>> load_edges;
+
+  std::string record;
+  while(graph_file >> record)
+    {
+      if(record == "node")
+	{
+	  std::string node_name;
+	  std::getline(graph_file >> std::ws, node_name);
+
+	  load_node_names.push_back(node_name);
+	  load_node_changes.emplace_back(shape_in.size());
+	  load_node_pre_conditions.emplace_back();
+	  load_node_post_conditions.emplace_back();
+	}
+      else if(record == "change")
+	{
+	  // node details follow their node
+	  if(load_node_names.empty())
+	    {
+	      return std::nullopt;
+	    }
+
+	  int layer, before_character, after_character;
+	  graph_file >> layer >> before_character >> after_character;
+	  load_node_changes.back().at(layer) = change_type(before_character, after_character);
+	}
+      else if((record == "pre") || (record == "post"))
+	{
+	  if(load_node_names.empty())
+	    {
+	      return std::nullopt;
+	    }
+
+	  std::string hash;
+	  graph_file >> hash;
+	  shared_dfa_ptr condition = load_condition(hash);
+	  if(!condition)
+	    {
+	      return std::nullopt;
+	    }
+
+	  ((record == "pre") ? load_node_pre_conditions : load_node_post_conditions).back().push_back(condition);
+	}
+      else if(record == "edge")
+	{
+	  int from_node_index, to_node_index;
+	  std::string edge_name;
+	  graph_file >> from_node_index >> to_node_index;
+	  std::getline(graph_file >> std::ws, edge_name);
+
+	  load_edges.emplace_back(from_node_index, move_edge(edge_name, move_edge_condition_vector(), to_node_index));
+	}
+      else if(record == "condition")
+	{
+	  // conditions follow their edge
+	  if(load_edges.empty())
+	    {
+	      return std::nullopt;
+	    }
+
+	  std::string hash;
+	  graph_file >> hash;
+	  shared_dfa_ptr condition = load_condition(hash);
+	  if(!condition)
+	    {
+	      return std::nullopt;
+	    }
+
+	  std::get<1>(std::get<1>(load_edges.back())).push_back(condition);
+	}
+      else
+	{
+	  throw std::runtime_error("MoveGraph::load() unexpected record " + record);
+	}
+    }
+
+  for(int node_index = 0; node_index < load_node_names.size(); ++node_index)
+    {
+      output.add_node_raw(load_node_names[node_index],
+			  load_node_changes[node_index],
+			  load_node_pre_conditions[node_index],
+			  load_node_post_conditions[node_index]);
+    }
+
+  for(const auto& [from_node_index, edge] : load_edges)
+    {
+      output.add_edge_raw(std::get<0>(edge), from_node_index, std::get<2>(edge), std::get<1>(edge));
+    }
+
+  std::cout << "loaded move graph " << name_in << " with " << output.size() << " nodes" << std::endl;
+
+  return output;
+}
+
 MoveGraph MoveGraph::optimize() const
 {
-  MoveGraph output(shape);
+  // rewrites the graph to need fewer DFA operations in get_moves:
+  //
+  // * chains where a node's only output edge is its successor's only
+  //   input are fused into one node with the combined changes.
+  // * conditions shared by all output edges of a node are hoisted to
+  //   its input edges when there are no more inputs than outputs.
+  // * edges with a rejecting condition and nodes that cannot reach
+  //   the end are removed.
+  //
+  // conditions moved across a node's changes are replaced by their
+  // pre-image under those changes, which is the change in reverse.
+
+  Profile profile("MoveGraph::optimize");
+
+  int num_nodes = int(node_names.size());
+  assert(num_nodes >= 2);
+
+  struct edge_t
+  {
+    std::string name;
+    int from_node_index;
+    int to_node_index;
+    move_edge_condition_vector conditions;
+  };
+
+  std::vector<edge_t> edges;
+  for(int from_node_index = 0; from_node_index < num_nodes; ++from_node_index)
+    {
+      for(const move_edge& edge : node_edges[from_node_index])
+	{
+	  edges.push_back(edge_t{std::get<0>(edge), from_node_index, std::get<2>(edge), std::get<1>(edge)});
+	}
+    }
 
-  std::vector<bool> node_added(node_names.size(), false);
+  std::vector<change_vector> changes = node_changes;
+  std::vector<move_edge_condition_vector> pre_conditions = node_pre_conditions;
+  std::vector<bool> node_removed(num_nodes, false);
 
-  // add nodes with a depth first search
-  std::function<void(int)> traverse = [&](int old_node_index)
+  auto add_conditions = [](move_edge_condition_vector& conditions, const move_edge_condition_vector& conditions_new)
   {
-    if(node_added.at(old_node_index))
+    for(shared_dfa_ptr condition : conditions_new)
       {
-        return;
+	if(std::none_of(conditions.begin(), conditions.end(), [&](shared_dfa_ptr existing)
+	{
+	  return existing->get_hash() == condition->get_hash();
+	}))
+	  {
+	    conditions.push_back(condition);
+	  }
       }
+  };
+
+  auto get_pre_image = [&](const move_edge_condition_vector& conditions, const change_vector& changes_in)
+  {
+    change_vector changes_reversed = reverse_changes(changes_in);
 
-    for(auto from_edge : node_inputs.at(old_node_index))
+    move_edge_condition_vector output;
+    for(shared_dfa_ptr condition : conditions)
       {
-        traverse(std::get<0>(from_edge));
+	add_conditions(output, {DFAUtil::get_change(condition, changes_reversed)});
       }
+    return output;
+  };
 
-    output.add_node(node_names.at(old_node_index),
-                    node_changes.at(old_node_index),
-                    node_pre_conditions.at(old_node_index),
-                    node_post_conditions.at(old_node_index));
+  auto get_edges = [&](std::function<bool(const edge_t&)> filter)
+  {
+    std::vector<size_t> output;
+    for(size_t edge_index = 0; edge_index < edges.size(); ++edge_index)
+      {
+	if(filter(edges[edge_index]))
+	  {
+	    output.push_back(edge_index);
+	  }
+      }
+    return output;
+  };
 
-    node_added.at(old_node_index) = true;
+  auto remove_edges = [&](std::function<bool(const edge_t&)> filter)
+  {
+    edges.erase(std::remove_if(edges.begin(), edges.end(), filter), edges.end());
   };
-  // make sure input node stays first.
-  // unreachable nodes can show up first if not forced.
-  traverse(0);
-  assert(output.node_names[0] == node_names[0]);
-  // traverse from output
-  traverse(int(node_names.size()) - 1);
-
-  // add edges to output
-
-  for(int i = 0; i < node_names.size(); ++i)
-    {
-      if(!node_added[i])
-        {
-          // this node cannot reach end
-          continue;
-        }
-
-      for(const move_edge& old_edge : node_edges.at(i))
-        {
-          if(!node_added[std::get<2>(old_edge)])
-            {
-              // end of this edge cannot reach end
-              continue;
-            }
-
-          // edge conditions are copied as is, so node conditions will
-          // be duplicated. however, those will be automatically
-          // deduped in get_intersection_vector.
-          output.add_edge(std::get<0>(old_edge),
-                          node_names.at(i),
-                          node_names.at(std::get<2>(old_edge)),
-                          std::get<1>(old_edge));
-        }
-    }
-
-  // done
+
+  // dedupe conditions since edges repeat their nodes' conditions
+
+  profile.tic("dedupe");
+  for(edge_t& edge : edges)
+    {
+      move_edge_condition_vector conditions;
+      add_conditions(conditions, edge.conditions);
+      edge.conditions = conditions;
+    }
+
+  // fuse chains, moving each edge's conditions before the first
+  // node's changes. a chain is fused forward one node at a time.
+
+  profile.tic("fuse");
+  for(int node_index = 1; node_index < num_nodes - 1; ++node_index)
+    {
+      std::vector<size_t> node_outputs = get_edges([&](const edge_t& edge) {return edge.from_node_index == node_index;});
+      if(node_outputs.size() != 1)
+	{
+	  continue;
+	}
+
+      edge_t chain_edge = edges[node_outputs[0]];
+      int next_node_index = chain_edge.to_node_index;
+      if(get_edges([&](const edge_t& edge) {return edge.to_node_index == next_node_index;}).size() != 1)
+	{
+	  continue;
+	}
+
+      move_edge_condition_vector chain_conditions = get_pre_image(chain_edge.conditions, changes[node_index]);
+      for(edge_t& edge : edges)
+	{
+	  if(edge.to_node_index == node_index)
+	    {
+	      edge.to_node_index = next_node_index;
+	      add_conditions(edge.conditions, chain_conditions);
+	    }
+	}
+      remove_edges([&](const edge_t& edge) {return edge.from_node_index == node_index;});
+
+      for(int layer = 0; layer < shape.size(); ++layer)
+	{
+	  const change_optional& first_change = changes[node_index][layer];
+	  const change_optional& second_change = changes[next_node_index][layer];
+	  if(first_change.has_value() && second_change.has_value())
+	    {
+	      // a mismatch in between is already a rejecting pre-image
+	      changes[next_node_index][layer] = change_type(std::get<0>(*first_change), std::get<1>(*second_change));
+	    }
+	  else if(first_change.has_value())
+	    {
+	      changes[next_node_index][layer] = first_change;
+	    }
+	}
+
+      move_edge_condition_vector fused_pre_conditions = pre_conditions[node_index];
+      add_conditions(fused_pre_conditions, get_pre_image(pre_conditions[next_node_index], changes[node_index]));
+      pre_conditions[next_node_index] = fused_pre_conditions;
+
+      node_removed[node_index] = true;
+    }
+
+  // hoist conditions shared by sibling edges, last nodes first so
+  // conditions can keep moving up.
+
+  profile.tic("hoist");
+  for(int node_index = num_nodes - 2; node_index >= 1; --node_index)
+    {
+      if(node_removed[node_index])
+	{
+	  continue;
+	}
+
+      std::vector<size_t> node_inputs_todo = get_edges([&](const edge_t& edge) {return edge.to_node_index == node_index;});
+      std::vector<size_t> node_outputs_todo = get_edges([&](const edge_t& edge) {return edge.from_node_index == node_index;});
+      if((node_outputs_todo.size() < 2) ||
+	 (node_inputs_todo.size() == 0) ||
+	 (node_inputs_todo.size() > node_outputs_todo.size()))
+	{
+	  continue;
+	}
+
+      move_edge_condition_vector shared_conditions;
+      for(shared_dfa_ptr condition : edges[node_outputs_todo[0]].conditions)
+	{
+	  if(std::all_of(node_outputs_todo.begin(), node_outputs_todo.end(), [&](size_t edge_index)
+	  {
+	    const move_edge_condition_vector& conditions = edges[edge_index].conditions;
+	    return std::any_of(conditions.begin(), conditions.end(), [&](shared_dfa_ptr other)
+	    {
+	      return other->get_hash() == condition->get_hash();
+	    });
+	  }))
+	    {
+	      shared_conditions.push_back(condition);
+	    }
+	}
+      if(shared_conditions.size() == 0)
+	{
+	  continue;
+	}
+
+      move_edge_condition_vector hoisted_conditions = get_pre_image(shared_conditions, changes[node_index]);
+      for(size_t edge_index : node_inputs_todo)
+	{
+	  add_conditions(edges[edge_index].conditions, hoisted_conditions);
+	}
+
+      for(size_t edge_index : node_outputs_todo)
+	{
+	  move_edge_condition_vector& conditions = edges[edge_index].conditions;
+	  conditions.erase(std::remove_if(conditions.begin(), conditions.end(), [&](shared_dfa_ptr condition)
+	  {
+	    return std::any_of(shared_conditions.begin(), shared_conditions.end(), [&](shared_dfa_ptr shared_condition)
+	    {
+	      return shared_condition->get_hash() == condition->get_hash();
+	    });
+	  }), conditions.end());
+	}
+    }
+
+  // prune edges that can never pass, then nodes that are not
+  // reachable from the start or cannot reach the end.
+
+  profile.tic("prune");
+  remove_edges([](const edge_t& edge)
+  {
+    return std::any_of(edge.conditions.begin(), edge.conditions.end(), [](shared_dfa_ptr condition)
+    {
+      return condition->is_constant(0);
+    });
+  });
+
+  std::vector<bool> from_start(num_nodes, false);
+  from_start[0] = true;
+  for(const edge_t& edge : edges)
+    {
+      // edges are sorted by from node, which is less than to node
+      if(from_start[edge.from_node_index])
+	{
+	  from_start[edge.to_node_index] = true;
+	}
+    }
+
+  std::vector<bool> to_end(num_nodes, false);
+  to_end[num_nodes - 1] = true;
+  for(auto iter = edges.rbegin(); iter != edges.rend(); ++iter)
+    {
+      if(to_end[iter->to_node_index])
+	{
+	  to_end[iter->from_node_index] = true;
+	}
+    }
+
+  // build output
+
+  profile.tic("output");
+  MoveGraph output(shape);
+
+  std::vector<int> output_node_indexes(num_nodes, -1);
+  for(int node_index = 0; node_index < num_nodes; ++node_index)
+    {
+      bool keep = (node_index == 0) || (node_index == num_nodes - 1) ||
+	(!node_removed[node_index] && from_start[node_index] && to_end[node_index]);
+      if(keep)
+	{
+	  output_node_indexes[node_index] = int(output.node_names.size());
+	  output.add_node_raw(node_names[node_index],
+			      changes[node_index],
+			      pre_conditions[node_index],
+			      node_post_conditions[node_index]);
+	}
+    }
+
+  for(const edge_t& edge : edges)
+    {
+      int from_node_index = output_node_indexes[edge.from_node_index];
+      int to_node_index = output_node_indexes[edge.to_node_index];
+      if((from_node_index >= 0) && (to_node_index >= 0))
+	{
+	  output.add_edge_raw(edge.name, from_node_index, to_node_index, edge.conditions);
+	}
+    }
+
+  std::cout << "optimized move graph from " << num_nodes << " nodes and " << edge_names.size() << " edges to "
+	    << output.size() << " nodes and " << output.edge_names.size() << " edges" << std::endl;
 
   return output;
 }
@@ -444,6 +1255,89 @@ static change_vector reverse_changes(const change_vector& changes_in)
   return changes_out;
 }
 
+void MoveGraph::save(std::string name_in) const
+{
+  // writes the graph to scratch/<name>/graph. condition DFAs are
+  // referenced by hash, with links under conditions/ so they stay
+  // live for garbage collection.
+
+  Profile profile("MoveGraph::save");
+
+  create_directory("scratch/" + name_in);
+  create_directory("scratch/" + name_in + "/conditions");
+
+  std::set<std::string> conditions_saved;
+  auto save_condition = [&](shared_dfa_ptr condition)
+  {
+    std::string hash = condition->get_hash();
+    if(!conditions_saved.contains(hash))
+      {
+	condition->save(name_in + "/conditions/" + hash);
+	conditions_saved.insert(hash);
+      }
+    return hash;
+  };
+
+  std::string graph_filename = "scratch/" + name_in + "/graph";
+  std::string graph_filename_temp = graph_filename + "." + get_process_name();
+
+  std::ofstream graph_file(graph_filename_temp);
+  graph_file << "move_graph " << MOVE_GRAPH_FORMAT_VERSION << "\n";
+
+  for(int node_index = 0; node_index < node_names.size(); ++node_index)
+    {
+      graph_file << "node " << node_names[node_index] << "\n";
+
+      const change_vector& changes = node_changes[node_index];
+      for(int layer = 0; layer < changes.size(); ++layer)
+	{
+	  if(changes[layer].has_value())
+	    {
+	      graph_file << "change " << layer << " " << std::get<0>(*changes[layer]) << " " << std::get<1>(*changes[layer]) << "\n";
+	    }
+	}
+
+      for(shared_dfa_ptr condition : node_pre_conditions[node_index])
+	{
+	  graph_file << "pre " << save_condition(condition) << "\n";
+	}
+      for(shared_dfa_ptr condition : node_post_conditions[node_index])
+	{
+	  graph_file << "post " << save_condition(condition) << "\n";
+	}
+    }
+
+  for(int node_index = 0; node_index < node_names.size(); ++node_index)
+    {
+      for(const move_edge& edge : node_edges[node_index])
+	{
+	  graph_file << "edge " << node_index << " " << std::get<2>(edge) << " " << std::get<0>(edge) << "\n";
+	  for(shared_dfa_ptr condition : std::get<1>(edge))
+	    {
+	      graph_file << "condition " << save_condition(condition) << "\n";
+	    }
+	}
+    }
+
+  graph_file.close();
+  if(!graph_file)
+    {
+      throw std::runtime_error("MoveGraph::save() write failed");
+    }
+
+  if(std::rename(graph_filename_temp.c_str(), graph_filename.c_str()))
+    {
+      perror("MoveGraph save rename");
+      throw std::runtime_error("MoveGraph::save() rename failed");
+    }
+}
+
+void MoveGraph::set_workers(size_t workers_in)
+{
+  assert(workers_in >= 1);
+  workers = workers_in;
+}
+
 size_t MoveGraph::size() const
 {
   return node_names.size();
@@ -6,6 +6,7 @@
 // implements an acyclic multigraph representing all possible moves in a game.
 
 #include <map>
+#include <optional>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -35,6 +36,12 @@ class MoveGraph
 
   std::set<std::string> edge_names;
 
+  // node output sizes relative to the input on the last get_moves
+  // call, used to plan the next node order.
+  mutable std::vector<double> node_bytes_ratios;
+
+  void add_edge_raw(std::string, int, int, const move_edge_condition_vector&);
+  void add_node_raw(std::string, const change_vector&, const move_edge_condition_vector&, const move_edge_condition_vector&);
   int get_node_index(std::string) const;
 
  public:
@@ -52,10 +59,16 @@ class MoveGraph
   void add_node(std::string, int, int, int);
 
   shared_dfa_ptr get_moves(std::string name_prefix, shared_dfa_ptr) const;
+  shared_dfa_ptr get_moves_universal(std::string name_prefix, shared_dfa_ptr) const;
   const move_edge_condition_vector& get_node_pre_conditions(std::string) const;
 
+  static size_t get_workers();
+  static void set_workers(size_t);
+
+  static std::optional<MoveGraph> load(const dfa_shape_t&, std::string);
   MoveGraph optimize() const;
   MoveGraph reverse() const;
+  void save(std::string) const;
   size_t size() const;
 };
 
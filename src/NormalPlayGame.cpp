@@ -21,14 +21,19 @@ shared_dfa_ptr NormalPlayGame::build_positions_losing(int side_to_move, int ply_
       --ply_max;
     }
 
+  if(get_incremental_backward() && (ply_max >= 3))
+    {
+      return build_positions_losing_incremental(side_to_move, ply_max);
+    }
+
   shared_dfa_ptr winning_soon =
     ((ply_max <= 0) ?
      DFAUtil::get_reject(get_shape()) :
      get_positions_winning(1 - side_to_move, ply_max - 1));
 
-  shared_dfa_ptr not_winning_soon = DFAUtil::get_inverse(winning_soon);
-  shared_dfa_ptr not_losing_soon = this->get_moves_backward(side_to_move, not_winning_soon);
-  shared_dfa_ptr losing_soon = DFAUtil::get_inverse(not_losing_soon);
+  // positions without moves are lost, which the universal pre-image
+  // includes.
+  shared_dfa_ptr losing_soon = this->get_moves_backward_universal(side_to_move, winning_soon);
   return losing_soon;
 }
 
@@ -52,6 +57,11 @@ shared_dfa_ptr NormalPlayGame::build_positions_winning(int side_to_move, int ply
       --ply_max;
     }
 
+  if(get_incremental_backward() && (ply_max >= 3))
+    {
+      return build_positions_winning_incremental(side_to_move, ply_max);
+    }
+
   shared_dfa_ptr losing_soon = get_positions_losing(1 - side_to_move, ply_max - 1);
   shared_dfa_ptr winning_soon = this->get_moves_backward(side_to_move, losing_soon);
   return winning_soon;
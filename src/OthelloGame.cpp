@@ -367,6 +367,14 @@ shared_dfa_ptr OthelloGame::get_positions_legal() const
   });
 }
 
+std::vector<std::vector<int>> OthelloGame::get_symmetries() const
+{
+  return GameUtil::get_board_symmetries(width, height, [=, this](int x, int y)
+  {
+    return CALCULATE_LAYER(x, y);
+  });
+}
+
 std::string OthelloGame::position_to_string(const DFAString& string_in) const
 {
   std::ostringstream output;
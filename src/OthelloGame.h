@@ -4,6 +4,7 @@
 #define OTHELLO_GAME_H
 
 #include <string>
+#include <vector>
 
 #include "Game.h"
 
@@ -39,6 +40,7 @@ public:
   virtual shared_dfa_ptr build_positions_won(int) const; // side to move has won, no moves available
 
   virtual DFAString get_position_initial() const;
+  virtual std::vector<std::vector<int>> get_symmetries() const;
 
   virtual std::string position_to_string(const DFAString&) const;
 };
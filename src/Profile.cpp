@@ -7,12 +7,17 @@
 #include <chrono>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <utility>
 #include <vector>
 
-static std::vector<Profile *> profile_stack;
-static std::vector<std::string> profile_label_stack;
+// stacks are per thread so concurrent builds each get their own
+// nesting. totals are shared across threads.
 
+static thread_local std::vector<Profile *> profile_stack;
+static thread_local std::vector<std::string> profile_label_stack;
+
+static std::mutex profile_totals_mutex;
 static std::vector<std::string> profile_total_order;
 static std::map<std::string, std::chrono::milliseconds> profile_totals;
 
@@ -61,6 +66,7 @@ void Profile::push_label_suffix(std::string suffix_in)
 			     suffix_in :
 			     profile_label_stack.back() + " / " + suffix_in);
 
+  std::lock_guard<std::mutex> totals_lock(profile_totals_mutex);
   auto search = profile_totals.find(total_label);
   if(search == profile_totals.end())
     {
@@ -97,7 +103,10 @@ void Profile::tic(std::string label_in)
   std::string total_label = profile_label_stack.back();
   auto diff_ms = std::chrono::duration_cast<std::chrono::milliseconds>(diff);
 
-  profile_totals[total_label] = profile_totals[total_label] + diff_ms;
+  {
+    std::lock_guard<std::mutex> totals_lock(profile_totals_mutex);
+    profile_totals[total_label] = profile_totals[total_label] + diff_ms;
+  }
 
   // update label
 
@@ -3,7 +3,7 @@
 #include "RejectDFA.h"
 
 RejectDFA::RejectDFA(const dfa_shape_t& shape_in)
-  : DFA(shape_in)
+  : DFA(shape_in, dfa_in_memory_t())
 {
   this->set_initial_state(0);
   this->set_name("reject");
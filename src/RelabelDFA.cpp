@@ -0,0 +1,222 @@
+// RelabelDFA.cpp
+
+#include "RelabelDFA.h"
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <numeric>
+#include <vector>
+
+#include "Profile.h"
+#include "parallel.h"
+
+static dfa_shape_t get_relabeled_shape(const dfa_shape_t& shape_in, const std::vector<std::vector<int>>& maps_in)
+{
+  int ndim = int(shape_in.size());
+  assert(maps_in.size() == ndim);
+
+  dfa_shape_t output(ndim);
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      const std::vector<int>& layer_map = maps_in[layer];
+      assert(layer_map.size() == shape_in[layer]);
+
+      output[layer] = *std::max_element(layer_map.begin(), layer_map.end()) + 1;
+
+      // onto, so accepting every input suffix accepts every output
+      // suffix.
+      std::vector<bool> covered(output[layer], false);
+      for(int c : layer_map)
+	{
+	  assert(c >= 0);
+	  covered[c] = true;
+	}
+      assert(std::all_of(covered.begin(), covered.end(), [](bool c_covered) {return c_covered;}));
+    }
+
+  return output;
+}
+
+RelabelDFA::RelabelDFA(const DFA& dfa_in, const std::vector<std::vector<int>>& maps_in)
+  : DFA(get_relabeled_shape(dfa_in.get_shape(), maps_in))
+{
+  Profile profile("RelabelDFA");
+
+  dfa_in.mmap();
+
+  int ndim = get_shape_size();
+  assert(dfa_in.get_initial_state() >= 2);
+
+  bool one_to_one = true;
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      one_to_one = one_to_one && (get_layer_shape(layer) == dfa_in.get_layer_shape(layer));
+    }
+
+  if(one_to_one)
+    {
+      // states keep their numbering, so each layer is a single pass
+      // moving transition columns.
+
+      for(int layer = ndim - 1; layer >= 0; --layer)
+	{
+	  profile.tic("layer " + std::to_string(layer));
+
+	  const std::vector<int>& layer_map = maps_in[layer];
+	  int layer_shape = get_layer_shape(layer);
+
+	  std::vector<int> identity(layer_shape);
+	  std::iota(identity.begin(), identity.end(), 0);
+	  if(layer_map == identity)
+	    {
+	      copy_layer(layer, dfa_in);
+	      continue;
+	    }
+
+	  build_layer(layer, dfa_in.get_layer_size(layer), [&](dfa_state_t state, dfa_state_t *transitions_out)
+	  {
+	    DFATransitionsReference transitions_in = dfa_in.get_transitions(layer, state);
+	    for(int c = 0; c < layer_shape; ++c)
+	      {
+		transitions_out[layer_map[c]] = transitions_in[c];
+	      }
+	  });
+	}
+
+      set_initial_state(dfa_in.get_initial_state());
+      return;
+    }
+
+  // merged characters make each new state a set of input states.
+  // forward pass finds the reachable sets, and the backward pass
+  // dedupes the states built from them.
+
+  typedef std::vector<dfa_state_t> state_set;
+
+  // non-constant sets per layer, and transitions of each set with
+  // sets numbered from 2 like states.
+  std::vector<std::vector<state_set>> layer_sets(ndim);
+  std::vector<std::vector<dfa_state_t>> layer_transitions(ndim);
+
+  layer_sets[0].push_back(state_set({dfa_in.get_initial_state()}));
+
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      profile.tic("forward " + std::to_string(layer));
+
+      const std::vector<int>& layer_map = maps_in[layer];
+      int layer_shape_in = dfa_in.get_layer_shape(layer);
+      int layer_shape = get_layer_shape(layer);
+      const std::vector<state_set>& sets = layer_sets[layer];
+
+      std::vector<state_set> next_sets(sets.size() * layer_shape);
+      std::vector<size_t> sets_iota(sets.size());
+      std::iota(sets_iota.begin(), sets_iota.end(), size_t(0));
+
+      TRY_PARALLEL_3(std::for_each, sets_iota.begin(), sets_iota.end(), [&](size_t set_index)
+      {
+	state_set *next_out = next_sets.data() + set_index * layer_shape;
+	for(dfa_state_t state : sets[set_index])
+	  {
+	    DFATransitionsReference transitions_in = dfa_in.get_transitions(layer, state);
+	    for(int c = 0; c < layer_shape_in; ++c)
+	      {
+		if(transitions_in[c])
+		  {
+		    next_out[layer_map[c]].push_back(transitions_in[c]);
+		  }
+	      }
+	  }
+
+	for(int c = 0; c < layer_shape; ++c)
+	  {
+	    state_set& next_set = next_out[c];
+	    std::sort(next_set.begin(), next_set.end());
+	    next_set.erase(std::unique(next_set.begin(), next_set.end()), next_set.end());
+	    if(next_set.size() && (next_set[0] == 1))
+	      {
+		// accepts everything
+		next_set.resize(1);
+	      }
+	  }
+      });
+
+      std::map<state_set, dfa_state_t> next_lookup;
+      std::vector<dfa_state_t>& transitions = layer_transitions[layer];
+      transitions.resize(next_sets.size());
+      for(size_t i = 0; i < next_sets.size(); ++i)
+	{
+	  state_set& next_set = next_sets[i];
+	  if(next_set.size() == 0)
+	    {
+	      transitions[i] = 0;
+	    }
+	  else if(next_set[0] == 1)
+	    {
+	      transitions[i] = 1;
+	    }
+	  else
+	    {
+	      assert(layer + 1 < ndim);
+
+	      auto [search, inserted] = next_lookup.try_emplace(next_set, dfa_state_t(layer_sets[layer + 1].size() + 2));
+	      if(inserted)
+		{
+		  layer_sets[layer + 1].push_back(std::move(next_set));
+		}
+	      transitions[i] = search->second;
+	    }
+	}
+    }
+
+  // backward pass deduping states with identical transitions
+
+  std::vector<dfa_state_t> next_states = {0, 1};
+  for(int layer = ndim - 1; layer >= 0; --layer)
+    {
+      profile.tic("backward " + std::to_string(layer));
+
+      int layer_shape = get_layer_shape(layer);
+      size_t sets_count = layer_sets[layer].size();
+      std::vector<dfa_state_t>& transitions = layer_transitions[layer];
+      for(dfa_state_t& next_state : transitions)
+	{
+	  next_state = next_states[next_state];
+	}
+
+      std::map<std::vector<dfa_state_t>, dfa_state_t> state_lookup;
+      std::vector<size_t> state_sets = {0, 0};
+      std::vector<dfa_state_t> set_states(sets_count + 2);
+      set_states[0] = 0;
+      set_states[1] = 1;
+      for(size_t set_index = 0; set_index < sets_count; ++set_index)
+	{
+	  auto row_begin = transitions.begin() + set_index * layer_shape;
+	  std::vector<dfa_state_t> row(row_begin, row_begin + layer_shape);
+
+	  if((row[0] < 2) && std::all_of(row.begin(), row.end(), [&](dfa_state_t next_state) {return next_state == row[0];}))
+	    {
+	      set_states[set_index + 2] = row[0];
+	      continue;
+	    }
+
+	  auto [search, inserted] = state_lookup.try_emplace(row, dfa_state_t(state_sets.size()));
+	  if(inserted)
+	    {
+	      assert(state_sets.size() <= DFA_STATE_MAX);
+	      state_sets.push_back(set_index);
+	    }
+	  set_states[set_index + 2] = search->second;
+	}
+
+      build_layer(layer, state_sets.size(), [&](dfa_state_t state, dfa_state_t *transitions_out)
+      {
+	std::copy_n(transitions.begin() + state_sets[state] * layer_shape, layer_shape, transitions_out);
+      });
+
+      next_states = std::move(set_states);
+    }
+
+  set_initial_state(next_states[2]);
+}
@@ -0,0 +1,22 @@
+// RelabelDFA.h
+
+#ifndef RELABEL_DFA_H
+#define RELABEL_DFA_H
+
+#include <vector>
+
+#include "DFA.h"
+
+// input DFA with the characters of each layer mapped to new
+// characters. maps must be onto the new layer shapes. one-to-one maps
+// just move transition columns and keep the state numbering, while
+// merged characters take the union of their transitions with the
+// resulting states deduped.
+
+class RelabelDFA : public DFA
+{
+ public:
+  RelabelDFA(const DFA&, const std::vector<std::vector<int>>&);
+};
+
+#endif
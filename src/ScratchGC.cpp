@@ -0,0 +1,495 @@
+// ScratchGC.cpp
+
+#include "ScratchGC.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "BuildLease.h"
+#include "Profile.h"
+#include "utils.h"
+
+#ifndef SCRATCH_GC_FREE_THRESHOLD
+#define SCRATCH_GC_FREE_THRESHOLD (size_t(1) << 30)
+#endif
+
+static size_t free_threshold = SCRATCH_GC_FREE_THRESHOLD;
+
+// pins of this process. the lease is taken with the first pin and
+// released at exit, leaving the pin file to the next collection.
+
+static std::mutex pins_mutex;
+static std::unique_ptr<BuildLease> pins_lease;
+
+static std::string pins_filename()
+{
+  return "scratch/pins/" + get_process_name();
+}
+
+static void pins_start()
+{
+  // called with pins_mutex held
+
+  if(pins_lease)
+    {
+      return;
+    }
+
+  create_directory("scratch/pins");
+  std::string lease_filename = pins_filename() + ".lock";
+  pins_lease = BuildLease::try_acquire(lease_filename);
+  if(!pins_lease)
+    {
+      // left by an earlier process with the same name
+      unlink(lease_filename.c_str());
+      pins_lease = BuildLease::try_acquire(lease_filename);
+    }
+  if(!pins_lease)
+    {
+      throw std::runtime_error("ScratchGC pins lease held by another process");
+    }
+}
+
+static bool is_hash(std::string name_in)
+{
+  if(name_in.size() != 64)
+    {
+      return false;
+    }
+
+  return std::all_of(name_in.begin(), name_in.end(), [](char c)
+  {
+    return (('0' <= c) && (c <= '9')) || (('a' <= c) && (c <= 'f'));
+  });
+}
+
+static std::string read_link_hash(std::string link_path)
+{
+  // returns the final path component of the link target if it is a
+  // DFA hash, otherwise an empty string.
+
+  char link_target[1024] = {0};
+  ssize_t ret = readlink(link_path.c_str(), link_target, sizeof(link_target) - 1);
+  if(ret < 0)
+    {
+      return "";
+    }
+
+  std::string target(link_target);
+  size_t slash = target.rfind('/');
+  std::string target_hash = (slash == std::string::npos) ? target : target.substr(slash + 1);
+
+  return is_hash(target_hash) ? target_hash : "";
+}
+
+static bool timespec_less(const struct timespec& a, const struct timespec& b)
+{
+  return (a.tv_sec < b.tv_sec) || ((a.tv_sec == b.tv_sec) && (a.tv_nsec < b.tv_nsec));
+}
+
+ScratchGC::ScratchGC(const std::unordered_set<std::string>& pinned_hashes_in)
+  : pinned_hashes(pinned_hashes_in)
+{
+}
+
+void ScratchGC::collect(size_t budget_bytes)
+{
+  // evict unreachable DFAs until the total is within budget.
+
+  Profile profile("ScratchGC::collect");
+
+  scan();
+  evict(budget_bytes);
+}
+
+void ScratchGC::evict(size_t budget_bytes)
+{
+  Profile profile("ScratchGC::evict");
+
+  std::unordered_map<std::string, std::vector<const scratch_gc_entry_t *>> complements_by_base;
+  std::vector<const scratch_gc_entry_t *> candidates;
+  for(const scratch_gc_entry_t& entry : entries)
+    {
+      if(entry.base_hash.size())
+	{
+	  complements_by_base[entry.base_hash].push_back(&entry);
+	}
+
+      if(!live_hashes.contains(entry.hash))
+	{
+	  candidates.push_back(&entry);
+	}
+    }
+
+  // least recently used first, ties broken by hash to keep runs
+  // reproducible.
+
+  std::sort(candidates.begin(), candidates.end(), [](const scratch_gc_entry_t *a, const scratch_gc_entry_t *b)
+  {
+    if(timespec_less(a->last_access, b->last_access))
+      {
+	return true;
+      }
+    if(timespec_less(b->last_access, a->last_access))
+      {
+	return false;
+      }
+    return a->hash < b->hash;
+  });
+
+  std::unordered_set<std::string> evicted;
+  size_t bytes_remaining = stats.bytes_total;
+
+  auto evict_entry = [&](const scratch_gc_entry_t *entry)
+  {
+    if(evicted.contains(entry->hash))
+      {
+	return;
+      }
+
+    remove_directory("scratch/dfas_by_hash/" + entry->hash);
+    evicted.insert(entry->hash);
+    evicted_hashes.push_back(entry->hash);
+
+    stats.dfas_evicted += 1;
+    stats.bytes_evicted += entry->bytes;
+    bytes_remaining -= entry->bytes;
+  };
+
+  profile.tic("remove");
+  for(const scratch_gc_entry_t *entry : candidates)
+    {
+      if(bytes_remaining <= budget_bytes)
+	{
+	  break;
+	}
+
+      // complements point at their base, so they go first. they are
+      // never live here since a live complement keeps its base live.
+      for(const scratch_gc_entry_t *complement : complements_by_base[entry->hash])
+	{
+	  assert(!live_hashes.contains(complement->hash));
+	  evict_entry(complement);
+	}
+
+      evict_entry(entry);
+    }
+
+  profile.tic("links");
+  if(evicted.size())
+    {
+      for(std::string scratch_entry : list_directory("scratch"))
+	{
+	  if(scratch_entry.ends_with("_cache"))
+	    {
+	      remove_dangling_links("scratch/" + scratch_entry);
+	    }
+	}
+    }
+
+  std::cout << "scratch gc: " << stats.dfas_total << " DFAs (" << stats.bytes_total << " bytes), "
+	    << stats.dfas_live << " live (" << stats.bytes_live << " bytes), "
+	    << stats.dfas_evicted << " evicted (" << stats.bytes_evicted << " bytes), "
+	    << stats.links_removed << " cache links removed, "
+	    << stats.workspaces_removed << " dead workspaces removed" << std::endl;
+}
+
+size_t ScratchGC::get_free_bytes()
+{
+  struct statvfs buf;
+  if(statvfs("scratch", &buf))
+    {
+      perror("statvfs");
+      throw std::runtime_error("statvfs failed");
+    }
+
+  return size_t(buf.f_bavail) * size_t(buf.f_frsize);
+}
+
+size_t ScratchGC::get_free_threshold()
+{
+  return free_threshold;
+}
+
+void ScratchGC::pin(std::string hash_in)
+{
+  assert(is_hash(hash_in));
+
+  std::lock_guard<std::mutex> pins_lock(pins_mutex);
+  pins_start();
+
+  // single line appends, compacted by write_pins
+  std::ofstream pins_file(pins_filename(), std::ios::app);
+  pins_file << hash_in << std::endl;
+}
+
+const std::vector<std::string>& ScratchGC::get_evicted_hashes() const
+{
+  return evicted_hashes;
+}
+
+const scratch_gc_stats_t& ScratchGC::get_stats() const
+{
+  return stats;
+}
+
+void ScratchGC::reclaim(size_t bytes_needed)
+{
+  // evict unreachable DFAs until at least the requested bytes have
+  // been freed (or nothing evictable is left).
+
+  Profile profile("ScratchGC::reclaim");
+
+  scan();
+  evict((stats.bytes_total > bytes_needed) ? stats.bytes_total - bytes_needed : 0);
+}
+
+void ScratchGC::remove_dangling_links(std::string directory)
+{
+  for(std::string link_name : list_directory(directory))
+    {
+      std::string link_path = directory + "/" + link_name;
+
+      struct stat link_stat;
+      if(lstat(link_path.c_str(), &link_stat) || !S_ISLNK(link_stat.st_mode))
+	{
+	  continue;
+	}
+
+      struct stat target_stat;
+      if(stat(link_path.c_str(), &target_stat) && (errno == ENOENT))
+	{
+	  if(unlink(link_path.c_str()) && (errno != ENOENT))
+	    {
+	      perror("ScratchGC unlink");
+	      throw std::runtime_error("ScratchGC unlink failed");
+	    }
+	  stats.links_removed += 1;
+	}
+    }
+}
+
+void ScratchGC::remove_dead_workspaces(std::string directory)
+{
+  // temporary directories are named <hostname>,<pid>-<n> (see
+  // get_process_name), so anything left by a process on this host
+  // that no longer exists can be removed.
+
+  for(std::string workspace_name : list_directory(directory))
+    {
+      size_t dash = workspace_name.find('-', workspace_name.find(','));
+      if((dash == std::string::npos) || !is_dead_process(workspace_name.substr(0, dash)))
+	{
+	  continue;
+	}
+
+      remove_directory(directory + "/" + workspace_name);
+      stats.workspaces_removed += 1;
+    }
+}
+
+void ScratchGC::scan()
+{
+  Profile profile("ScratchGC::scan");
+
+  entries.clear();
+  live_hashes = pinned_hashes;
+  stats = scratch_gc_stats_t();
+  evicted_hashes.clear();
+
+  profile.tic("workspaces");
+  remove_dead_workspaces("scratch/binarydfa");
+  remove_dead_workspaces("scratch/temp");
+
+  profile.tic("dfas");
+  for(std::string hash : list_directory("scratch/dfas_by_hash"))
+    {
+      if(!is_hash(hash))
+	{
+	  continue;
+	}
+
+      std::string directory = "scratch/dfas_by_hash/" + hash;
+
+      struct stat directory_stat;
+      if(lstat(directory.c_str(), &directory_stat) || !S_ISDIR(directory_stat.st_mode))
+	{
+	  continue;
+	}
+
+      scratch_gc_entry_t entry;
+      entry.hash = hash;
+      entry.bytes = size_t(directory_stat.st_blocks) * 512;
+      entry.last_access = directory_stat.st_mtim;
+      entry.base_hash = read_link_hash(directory + "/base");
+
+      for(std::string file_name : list_directory(directory))
+	{
+	  struct stat file_stat;
+	  if(!lstat((directory + "/" + file_name).c_str(), &file_stat))
+	    {
+	      entry.bytes += size_t(file_stat.st_blocks) * 512;
+	    }
+	}
+
+      stats.dfas_total += 1;
+      stats.bytes_total += entry.bytes;
+      entries.push_back(entry);
+    }
+
+  profile.tic("pins");
+  scan_pins();
+
+  profile.tic("live");
+  for(std::string scratch_entry : list_directory("scratch"))
+    {
+      if((scratch_entry == "binarydfa") ||
+	 (scratch_entry == "dfas_by_hash") ||
+	 (scratch_entry == "pins") ||
+	 (scratch_entry == "temp") ||
+	 scratch_entry.ends_with("_cache"))
+	{
+	  continue;
+	}
+
+      scan_live("scratch/" + scratch_entry);
+    }
+
+  // recently used DFAs may be in the middle of being saved or loaded
+  // by another process before its pins list them.
+
+  time_t recent_min = time(0) - BuildLease::get_timeout_seconds();
+  for(const scratch_gc_entry_t& entry : entries)
+    {
+      if(entry.last_access.tv_sec >= recent_min)
+	{
+	  live_hashes.insert(entry.hash);
+	}
+    }
+
+  // complements keep their base DFA
+
+  for(const scratch_gc_entry_t& entry : entries)
+    {
+      if(entry.base_hash.size() && live_hashes.contains(entry.hash))
+	{
+	  live_hashes.insert(entry.base_hash);
+	}
+    }
+
+  for(const scratch_gc_entry_t& entry : entries)
+    {
+      if(live_hashes.contains(entry.hash))
+	{
+	  stats.dfas_live += 1;
+	  stats.bytes_live += entry.bytes;
+	}
+    }
+}
+
+void ScratchGC::scan_live(std::string path)
+{
+  struct stat path_stat;
+  if(lstat(path.c_str(), &path_stat))
+    {
+      return;
+    }
+
+  if(S_ISLNK(path_stat.st_mode))
+    {
+      std::string link_hash = read_link_hash(path);
+      if(link_hash.size())
+	{
+	  live_hashes.insert(link_hash);
+	}
+    }
+  else if(S_ISDIR(path_stat.st_mode))
+    {
+      for(std::string child : list_directory(path))
+	{
+	  scan_live(path + "/" + child);
+	}
+    }
+}
+
+void ScratchGC::scan_pins()
+{
+  for(std::string pins_name : list_directory("scratch/pins"))
+    {
+      if(pins_name.ends_with(".lock") || pins_name.ends_with(".new"))
+	{
+	  continue;
+	}
+
+      std::string pins_path = "scratch/pins/" + pins_name;
+      if(BuildLease::is_stale(pins_path + ".lock"))
+	{
+	  // pinning process is gone
+	  unlink(pins_path.c_str());
+	  unlink((pins_path + ".lock").c_str());
+	  continue;
+	}
+
+      std::ifstream pins_file(pins_path);
+      std::string hash;
+      while(pins_file >> hash)
+	{
+	  if(is_hash(hash))
+	    {
+	      live_hashes.insert(hash);
+	    }
+	}
+    }
+}
+
+void ScratchGC::set_free_threshold(size_t free_threshold_in)
+{
+  free_threshold = free_threshold_in;
+}
+
+void ScratchGC::touch(std::string hash_in)
+{
+  // record an access by bumping the directory modification time,
+  // since atime is unreliable on relatime/noatime mounts.
+
+  std::string directory = "scratch/dfas_by_hash/" + hash_in;
+  utimensat(AT_FDCWD, directory.c_str(), 0, 0);
+}
+
+void ScratchGC::write_pins(std::function<std::unordered_set<std::string>()> pins_func)
+{
+  // rewrite this process's pins from scratch, dropping DFAs it no
+  // longer holds. pins_func runs under the pins lock so pins added
+  // concurrently land in the new file.
+
+  std::lock_guard<std::mutex> pins_lock(pins_mutex);
+  pins_start();
+
+  std::string pins_filename_new = pins_filename() + ".new";
+  {
+    std::ofstream pins_file(pins_filename_new);
+    for(const std::string& hash : pins_func())
+      {
+	pins_file << hash << "\n";
+      }
+  }
+
+  if(std::rename(pins_filename_new.c_str(), pins_filename().c_str()))
+    {
+      perror("ScratchGC pins rename");
+      throw std::runtime_error("ScratchGC pins rename failed");
+    }
+}
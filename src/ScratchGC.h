@@ -0,0 +1,79 @@
+// ScratchGC.h
+
+#ifndef SCRATCH_GC_H
+#define SCRATCH_GC_H
+
+#include <ctime>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// garbage collection for scratch/dfas_by_hash.
+//
+// the live set is every hash reachable from a named symlink outside
+// the operation caches (scratch/*_cache), plus the bases of live
+// complements, any hashes pinned by the caller, and the hashes pinned
+// by every process sharing scratch/. everything else is evicted least
+// recently used first until the DFAs fit in the byte budget, then
+// cache links left dangling are removed.
+//
+// each process lists the DFAs it holds in scratch/pins/<process>,
+// guarded by a BuildLease on scratch/pins/<process>.lock so pins of
+// dead processes are dropped, including processes on other hosts.
+// DFAs used within the lease timeout are never evicted either, which
+// covers DFAs being saved or loaded before their pins are written.
+
+struct scratch_gc_entry_t
+{
+  std::string hash;
+  size_t bytes;
+  struct timespec last_access;
+  std::string base_hash;
+};
+
+struct scratch_gc_stats_t
+{
+  size_t dfas_total = 0;
+  size_t dfas_live = 0;
+  size_t bytes_total = 0;
+  size_t bytes_live = 0;
+  size_t dfas_evicted = 0;
+  size_t bytes_evicted = 0;
+  size_t links_removed = 0;
+  size_t workspaces_removed = 0;
+};
+
+class ScratchGC
+{
+  std::unordered_set<std::string> pinned_hashes;
+  std::vector<scratch_gc_entry_t> entries;
+  std::unordered_set<std::string> live_hashes;
+  scratch_gc_stats_t stats;
+  std::vector<std::string> evicted_hashes;
+
+  void evict(size_t);
+  void remove_dangling_links(std::string);
+  void remove_dead_workspaces(std::string);
+  void scan();
+  void scan_live(std::string);
+  void scan_pins();
+
+public:
+
+  ScratchGC(const std::unordered_set<std::string>&);
+
+  void collect(size_t);
+  void reclaim(size_t);
+  const std::vector<std::string>& get_evicted_hashes() const;
+  const scratch_gc_stats_t& get_stats() const;
+
+  static size_t get_free_bytes();
+  static size_t get_free_threshold();
+  static void pin(std::string);
+  static void set_free_threshold(size_t);
+  static void touch(std::string);
+  static void write_pins(std::function<std::unordered_set<std::string>()>);
+};
+
+#endif
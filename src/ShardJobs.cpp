@@ -0,0 +1,306 @@
+// ShardJobs.cpp
+
+#include "ShardJobs.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "BuildLease.h"
+#include "DFAUtil.h"
+#include "Profile.h"
+#include "ShardedDFA.h"
+#include "utils.h"
+
+// bump when the job file format changes
+#define SHARD_JOBS_FORMAT_VERSION 1
+
+static std::atomic<int> next_removed_job_id = 0;
+
+static std::string _get_claim_path(std::string job_name, int shard_index)
+{
+  return std::format("scratch/{:s}/claim,shard={:03d}", job_name, shard_index);
+}
+
+static std::string _get_output_name(std::string job_name, int shard_index)
+{
+  return std::format("{:s}/output,shard={:03d}", job_name, shard_index);
+}
+
+static std::unique_ptr<BuildLease> _try_claim(std::string job_name, int shard_index)
+{
+  // claims are build leases, so claims of dead or unreachable workers
+  // time out and are taken over.
+
+  try
+    {
+      return BuildLease::try_acquire(_get_claim_path(job_name, shard_index));
+    }
+  catch(const std::runtime_error& e)
+    {
+      // job already merged and removed
+      return std::unique_ptr<BuildLease>();
+    }
+}
+
+static bool _job_exists(std::string job_name)
+{
+  struct stat job_stat;
+  return stat(("scratch/" + job_name + "/job").c_str(), &job_stat) == 0;
+}
+
+shared_dfa_ptr ShardJobs::run(const MoveGraph& move_graph_in,
+			      std::string move_graph_name,
+			      std::string name_prefix,
+			      shared_dfa_ptr positions_in,
+			      int shards_in)
+{
+  // posts a job for the given moves, works on its shards alongside any
+  // other processes, then merges the outputs.
+
+  Profile profile("ShardJobs::run");
+
+  const dfa_shape_t& shape = positions_in->get_shape();
+  if((shards_in <= 1) || positions_in->is_constant(false))
+    {
+      return move_graph_in.get_moves(name_prefix, positions_in);
+    }
+
+  profile.tic("post");
+
+  ShardedDFA sharded = ShardedDFA::from_dfa(positions_in, std::min(shards_in, shape[0]));
+  int shard_count = sharded.get_shard_count();
+
+  std::string job_name = std::format("shard_jobs/{:s},{:s},shards={:d}", name_prefix, positions_in->get_hash(), shard_count);
+
+  create_directory("scratch/shard_jobs");
+  sharded.save(job_name);
+
+  std::string job_filename = "scratch/" + job_name + "/job";
+  std::string job_filename_temp = job_filename + "." + get_process_name();
+
+  std::ofstream job_file(job_filename_temp);
+  job_file << "shard_job " << SHARD_JOBS_FORMAT_VERSION << "\n";
+  job_file << "graph " << move_graph_name << "\n";
+  job_file << "prefix " << name_prefix << "\n";
+  job_file << "shape " << shape.size();
+  for(int layer_shape : shape)
+    {
+      job_file << " " << layer_shape;
+    }
+  job_file << "\n";
+
+  job_file.close();
+  if(!job_file)
+    {
+      throw std::runtime_error("ShardJobs::run() write failed");
+    }
+
+  if(std::rename(job_filename_temp.c_str(), job_filename.c_str()))
+    {
+      perror("ShardJobs run rename");
+      throw std::runtime_error("ShardJobs::run() rename failed");
+    }
+
+  std::cout << "posted " << job_name << std::endl;
+
+  // build unclaimed shards here, and poll for the rest with backoff.
+
+  profile.tic("work");
+
+  std::vector<shared_dfa_ptr> outputs(shard_count);
+  int shards_done = 0;
+  for(int shard_index = 0; shard_index < shard_count; ++shard_index)
+    {
+      if(sharded.get_shard(shard_index)->is_constant(false))
+	{
+	  outputs[shard_index] = DFAUtil::get_reject(shape);
+	  ++shards_done;
+	}
+    }
+
+  auto poll_delay = std::chrono::milliseconds(10);
+  while(shards_done < shard_count)
+    {
+      bool progress = false;
+      for(int shard_index = 0; shard_index < shard_count; ++shard_index)
+	{
+	  if(outputs[shard_index])
+	    {
+	      continue;
+	    }
+
+	  outputs[shard_index] = DFAUtil::try_load_by_name(shape, _get_output_name(job_name, shard_index));
+	  if(!outputs[shard_index])
+	    {
+	      std::unique_ptr<BuildLease> claim = _try_claim(job_name, shard_index);
+	      if(claim)
+		{
+		  std::cout << "shard " << shard_index << "/" << shard_count << " of " << job_name << std::endl;
+		  outputs[shard_index] = move_graph_in.get_moves(name_prefix, sharded.get_shard(shard_index));
+		  outputs[shard_index]->save(_get_output_name(job_name, shard_index));
+		}
+	      else if(!_job_exists(job_name))
+		{
+		  // another process posted the same job and already
+		  // removed it, so nobody else will build this shard.
+		  std::cout << "shard " << shard_index << "/" << shard_count << " of removed " << job_name << std::endl;
+		  outputs[shard_index] = move_graph_in.get_moves(name_prefix, sharded.get_shard(shard_index));
+		}
+	    }
+
+	  if(outputs[shard_index])
+	    {
+	      ++shards_done;
+	      progress = true;
+	    }
+	}
+
+      if(progress)
+	{
+	  poll_delay = std::chrono::milliseconds(10);
+	}
+      else if(shards_done < shard_count)
+	{
+	  std::this_thread::sleep_for(poll_delay);
+	  poll_delay = std::min(poll_delay * 2, std::chrono::milliseconds(1000));
+	}
+    }
+
+  // move the job out of sight before removing it, so late claims
+  // fail instead of landing in a half removed directory.
+
+  profile.tic("remove");
+
+  std::string removed_directory = std::format("scratch/temp/{:s}-shard_job-{:d}", get_process_name(), next_removed_job_id++);
+  if(std::rename(("scratch/" + job_name).c_str(), removed_directory.c_str()) == 0)
+    {
+      remove_directory(removed_directory);
+    }
+  else if(errno != ENOENT)
+    {
+      // ENOENT means another process posting the same job removed it
+      perror("ShardJobs run rename job");
+      throw std::runtime_error("ShardJobs::run() rename job failed");
+    }
+
+  profile.tic("merge");
+
+  std::vector<shared_dfa_ptr> nonempty;
+  for(shared_dfa_ptr output : outputs)
+    {
+      if(!output->is_constant(false))
+	{
+	  nonempty.push_back(output);
+	}
+    }
+
+  if(nonempty.size() == 0)
+    {
+      return DFAUtil::get_reject(shape);
+    }
+  else if(nonempty.size() == 1)
+    {
+      return nonempty[0];
+    }
+
+  return DFAUtil::get_union_vector(shape, nonempty);
+}
+
+bool ShardJobs::work()
+{
+  // builds one unclaimed shard of any posted job, returning false if
+  // there was nothing to do.
+
+  Profile profile("ShardJobs::work");
+
+  static std::map<std::string, MoveGraph> move_graphs;
+
+  for(std::string job_entry : list_directory("scratch/shard_jobs"))
+    {
+      std::string job_name = "shard_jobs/" + job_entry;
+
+      std::ifstream job_file("scratch/" + job_name + "/job");
+      std::string header;
+      int version = 0;
+      std::string graph_label, move_graph_name;
+      std::string prefix_label, name_prefix;
+      std::string shape_label;
+      size_t shape_size = 0;
+      if(!(job_file >> header >> version) ||
+	 (header != "shard_job") ||
+	 (version != SHARD_JOBS_FORMAT_VERSION) ||
+	 !(job_file >> graph_label >> move_graph_name) ||
+	 (graph_label != "graph") ||
+	 !(job_file >> prefix_label >> name_prefix) ||
+	 (prefix_label != "prefix") ||
+	 !(job_file >> shape_label >> shape_size) ||
+	 (shape_label != "shape"))
+	{
+	  continue;
+	}
+
+      dfa_shape_t shape(shape_size);
+      for(int& layer_shape : shape)
+	{
+	  job_file >> layer_shape;
+	}
+      if(!job_file)
+	{
+	  continue;
+	}
+
+      std::optional<ShardedDFA> sharded = ShardedDFA::load(shape, job_name);
+      if(!sharded)
+	{
+	  continue;
+	}
+
+      for(int shard_index = 0; shard_index < sharded->get_shard_count(); ++shard_index)
+	{
+	  shared_dfa_ptr shard = sharded->get_shard(shard_index);
+	  if(shard->is_constant(false) ||
+	     DFA::parse_hash(_get_output_name(job_name, shard_index)))
+	    {
+	      continue;
+	    }
+
+	  std::unique_ptr<BuildLease> claim = _try_claim(job_name, shard_index);
+	  if(!claim)
+	    {
+	      continue;
+	    }
+
+	  if(!move_graphs.contains(move_graph_name))
+	    {
+	      std::optional<MoveGraph> move_graph = MoveGraph::load(shape, move_graph_name);
+	      if(!move_graph)
+		{
+		  // leave it to processes that have the graph
+		  continue;
+		}
+	      move_graphs.emplace(move_graph_name, *move_graph);
+	    }
+
+	  std::cout << "shard " << shard_index << "/" << sharded->get_shard_count() << " of " << job_name << std::endl;
+	  shared_dfa_ptr output = move_graphs.at(move_graph_name).get_moves(name_prefix, shard);
+	  output->save(_get_output_name(job_name, shard_index));
+	  return true;
+	}
+    }
+
+  return false;
+}
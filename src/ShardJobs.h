@@ -0,0 +1,30 @@
+// ShardJobs.h
+
+#ifndef SHARD_JOBS_H
+#define SHARD_JOBS_H
+
+// move applications split into prefix shards that any process sharing
+// scratch/ can work on, so a solve can spread over several machines
+// mounting the same volume.
+//
+// each job is a directory scratch/shard_jobs/<prefix>,<hash>,shards=N
+// holding the input shards (see ShardedDFA::save), a job file naming
+// the saved move graph, and per shard a claim (a BuildLease held by
+// the worker while it builds) and an output link. the job file is
+// written last, and the requesting process removes the directory after
+// merging.
+
+#include <string>
+
+#include "DFA.h"
+#include "MoveGraph.h"
+
+class ShardJobs
+{
+ public:
+
+  static shared_dfa_ptr run(const MoveGraph&, std::string, std::string, shared_dfa_ptr, int);
+  static bool work();
+};
+
+#endif
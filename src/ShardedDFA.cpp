@@ -0,0 +1,503 @@
+// ShardedDFA.cpp
+
+#include "ShardedDFA.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+#include "BoundedTasks.h"
+#include "DFAUtil.h"
+#include "Profile.h"
+#include "utils.h"
+
+// shard operations run concurrently under the shared task limits in
+// BoundedTasks, with at most this many shards at once.
+
+static size_t workers = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+static std::vector<bool> _first_characters(shared_dfa_ptr dfa_in)
+{
+  // first layer characters leading anywhere but the reject state
+
+  int layer_shape = dfa_in->get_layer_shape(0);
+  if(dfa_in->is_constant(false) || dfa_in->is_constant(true))
+    {
+      return std::vector<bool>(layer_shape, dfa_in->is_constant(true));
+    }
+
+  dfa_in->mmap();
+  DFATransitionsReference transitions = dfa_in->get_transitions(0, dfa_in->get_initial_state());
+
+  std::vector<bool> output(layer_shape, false);
+  for(int c = 0; c < layer_shape; ++c)
+    {
+      output[c] = (transitions[c] != 0);
+    }
+  return output;
+}
+
+ShardedDFA::ShardedDFA(const dfa_shape_t& shape_in,
+		       const std::vector<int>& boundaries_in,
+		       const std::vector<shared_dfa_ptr>& shards_in)
+  : shape(shape_in),
+    boundaries(boundaries_in),
+    shards(shards_in)
+{
+  assert(shape.size() > 0);
+  assert(boundaries.size() >= 2);
+  assert(boundaries.front() == 0);
+  assert(boundaries.back() == shape[0]);
+  assert(std::is_sorted(boundaries.begin(), boundaries.end()));
+  assert(shards.size() + 1 == boundaries.size());
+
+  for(shared_dfa_ptr shard : shards)
+    {
+      assert(shard);
+      assert(shard->get_shape() == shape);
+    }
+}
+
+ShardedDFA ShardedDFA::from_dfa(shared_dfa_ptr dfa_in, int shard_count_in)
+{
+  return from_dfa(dfa_in, get_even_boundaries(dfa_in->get_shape(), shard_count_in));
+}
+
+ShardedDFA ShardedDFA::from_dfa(shared_dfa_ptr dfa_in, const std::vector<int>& boundaries_in)
+{
+  Profile profile("ShardedDFA::from_dfa");
+
+  const dfa_shape_t& shape_in = dfa_in->get_shape();
+  ShardedDFA empty(shape_in,
+		   boundaries_in,
+		   std::vector<shared_dfa_ptr>(boundaries_in.size() - 1, DFAUtil::get_reject(shape_in)));
+
+  std::vector<shared_dfa_ptr> outputs(1, dfa_in);
+  return empty.reshard(outputs);
+}
+
+const std::vector<int>& ShardedDFA::get_boundaries() const
+{
+  return boundaries;
+}
+
+ShardedDFA ShardedDFA::get_change(const change_vector& changes_in) const
+{
+  Profile profile("ShardedDFA::get_change");
+
+  assert(changes_in.size() == shape.size());
+
+  std::vector<size_t> memory;
+  for(shared_dfa_ptr shard : shards)
+    {
+      memory.push_back(BoundedTasks::get_dfa_bytes(shard));
+    }
+
+  std::vector<shared_dfa_ptr> outputs = map_shards(memory, [&](int shard_index)
+  {
+    return DFAUtil::get_change(shards[shard_index], changes_in);
+  });
+
+  if(!changes_in[0].has_value())
+    {
+      // first characters are unchanged, so outputs stay in their shard
+      return ShardedDFA(shape, boundaries, outputs);
+    }
+
+  return reshard(outputs);
+}
+
+ShardedDFA ShardedDFA::get_difference(const ShardedDFA& right_in) const
+{
+  Profile profile("ShardedDFA::get_difference");
+
+  if((right_in.shape != shape) || (right_in.boundaries != boundaries))
+    {
+      throw std::logic_error("ShardedDFA::get_difference() shard mismatch");
+    }
+
+  std::vector<size_t> memory;
+  for(int shard_index = 0; shard_index < shards.size(); ++shard_index)
+    {
+      memory.push_back(BoundedTasks::get_dfa_bytes(shards[shard_index]) + BoundedTasks::get_dfa_bytes(right_in.shards[shard_index]));
+    }
+
+  return ShardedDFA(shape, boundaries, map_shards(memory, [&](int shard_index)
+  {
+    return DFAUtil::get_difference(shards[shard_index], right_in.shards[shard_index]);
+  }));
+}
+
+std::vector<int> ShardedDFA::get_even_boundaries(const dfa_shape_t& shape_in, int shard_count_in)
+{
+  // split the first layer characters into ranges of nearly equal size
+
+  assert(shape_in.size() > 0);
+  assert(0 < shard_count_in);
+  assert(shard_count_in <= shape_in[0]);
+
+  std::vector<int> output;
+  for(int shard_index = 0; shard_index <= shard_count_in; ++shard_index)
+    {
+      output.push_back(shard_index * shape_in[0] / shard_count_in);
+    }
+  return output;
+}
+
+ShardedDFA ShardedDFA::get_intersection(const ShardedDFA& right_in) const
+{
+  Profile profile("ShardedDFA::get_intersection");
+
+  if((right_in.shape != shape) || (right_in.boundaries != boundaries))
+    {
+      throw std::logic_error("ShardedDFA::get_intersection() shard mismatch");
+    }
+
+  std::vector<size_t> memory;
+  for(int shard_index = 0; shard_index < shards.size(); ++shard_index)
+    {
+      memory.push_back(BoundedTasks::get_dfa_bytes(shards[shard_index]) + BoundedTasks::get_dfa_bytes(right_in.shards[shard_index]));
+    }
+
+  return ShardedDFA(shape, boundaries, map_shards(memory, [&](int shard_index)
+  {
+    return DFAUtil::get_intersection(shards[shard_index], right_in.shards[shard_index]);
+  }));
+}
+
+ShardedDFA ShardedDFA::get_moves(const MoveGraph& move_graph_in, std::string name_prefix) const
+{
+  Profile profile("ShardedDFA::get_moves");
+
+  // shards are moved one at a time since get_moves already builds
+  // graph nodes concurrently, and so the node outputs of only one
+  // shard are live at once. the outputs may land in any shard.
+
+  std::vector<shared_dfa_ptr> outputs;
+  for(int shard_index = 0; shard_index < shards.size(); ++shard_index)
+    {
+      std::cout << "shard " << shard_index << "/" << shards.size() << " moves" << std::endl;
+
+      shared_dfa_ptr shard = shards[shard_index];
+      outputs.push_back(shard->is_constant(false) ? shard : move_graph_in.get_moves(name_prefix, shard));
+    }
+
+  return reshard(outputs);
+}
+
+shared_dfa_ptr ShardedDFA::get_range(const dfa_shape_t& shape_in, int begin_in, int end_in)
+{
+  // positions with first character in [begin, end)
+
+  assert(0 <= begin_in);
+  assert(begin_in <= end_in);
+  assert(end_in <= shape_in[0]);
+
+  if((begin_in == 0) && (end_in == shape_in[0]))
+    {
+      return DFAUtil::get_accept(shape_in);
+    }
+
+  std::vector<shared_dfa_ptr> fixed;
+  for(int c = begin_in; c < end_in; ++c)
+    {
+      fixed.push_back(DFAUtil::get_fixed(shape_in, 0, c));
+    }
+
+  if(fixed.size() == 0)
+    {
+      return DFAUtil::get_reject(shape_in);
+    }
+  else if(fixed.size() == 1)
+    {
+      return fixed[0];
+    }
+
+  return DFAUtil::get_union_vector(shape_in, fixed);
+}
+
+const dfa_shape_t& ShardedDFA::get_shape() const
+{
+  return shape;
+}
+
+shared_dfa_ptr ShardedDFA::get_shard(int shard_index) const
+{
+  return shards.at(shard_index);
+}
+
+int ShardedDFA::get_shard_count() const
+{
+  return int(shards.size());
+}
+
+int ShardedDFA::get_shard_index(int character_in) const
+{
+  assert(0 <= character_in);
+  assert(character_in < shape[0]);
+
+  return int(std::upper_bound(boundaries.begin(), boundaries.end(), character_in) - boundaries.begin()) - 1;
+}
+
+ShardedDFA ShardedDFA::get_union(const ShardedDFA& right_in) const
+{
+  Profile profile("ShardedDFA::get_union");
+
+  if((right_in.shape != shape) || (right_in.boundaries != boundaries))
+    {
+      throw std::logic_error("ShardedDFA::get_union() shard mismatch");
+    }
+
+  std::vector<size_t> memory;
+  for(int shard_index = 0; shard_index < shards.size(); ++shard_index)
+    {
+      memory.push_back(BoundedTasks::get_dfa_bytes(shards[shard_index]) + BoundedTasks::get_dfa_bytes(right_in.shards[shard_index]));
+    }
+
+  return ShardedDFA(shape, boundaries, map_shards(memory, [&](int shard_index)
+  {
+    return DFAUtil::get_union(shards[shard_index], right_in.shards[shard_index]);
+  }));
+}
+
+size_t ShardedDFA::get_workers()
+{
+  return workers;
+}
+
+bool ShardedDFA::is_constant(bool value_in) const
+{
+  for(int shard_index = 0; shard_index < shards.size(); ++shard_index)
+    {
+      if(value_in)
+	{
+	  shared_dfa_ptr range = get_range(shape, boundaries[shard_index], boundaries[shard_index + 1]);
+	  if(!DFAUtil::is_equal(shards[shard_index], range))
+	    {
+	      return false;
+	    }
+	}
+      else if(!shards[shard_index]->is_constant(false))
+	{
+	  return false;
+	}
+    }
+
+  return true;
+}
+
+std::optional<ShardedDFA> ShardedDFA::load(const dfa_shape_t& shape_in, std::string name_in)
+{
+  // loads shards written by save(), or returns nothing if the shard
+  // list is missing or any shard is gone.
+
+  Profile profile("ShardedDFA::load");
+
+  std::ifstream boundaries_file("scratch/" + name_in + "/boundaries");
+  if(!boundaries_file)
+    {
+      return std::nullopt;
+    }
+
+  std::vector<int> boundaries_loaded;
+  for(int boundary = 0; boundaries_file >> boundary;)
+    {
+      boundaries_loaded.push_back(boundary);
+    }
+
+  if((boundaries_loaded.size() < 2) ||
+     (boundaries_loaded.front() != 0) ||
+     (boundaries_loaded.back() != shape_in.at(0)) ||
+     !std::is_sorted(boundaries_loaded.begin(), boundaries_loaded.end()))
+    {
+      return std::nullopt;
+    }
+
+  std::vector<shared_dfa_ptr> shards_loaded;
+  for(int shard_index = 0; shard_index + 1 < boundaries_loaded.size(); ++shard_index)
+    {
+      shared_dfa_ptr shard = DFAUtil::try_load_by_name(shape_in, std::format("{:s}/shard={:03d}", name_in, shard_index));
+      if(!shard)
+	{
+	  return std::nullopt;
+	}
+      shards_loaded.push_back(shard);
+    }
+
+  return ShardedDFA(shape_in, boundaries_loaded, shards_loaded);
+}
+
+std::vector<shared_dfa_ptr> ShardedDFA::map_shards(const std::vector<size_t>& memory_in,
+						   std::function<shared_dfa_ptr(int)> shard_func) const
+{
+  // run shard_func for every shard under the shared task limits,
+  // estimating each shard by memory_in.
+
+  assert(memory_in.size() == shards.size());
+
+  // hashes are computed lazily, so fill them in before the shards and
+  // the shared range DFAs are used from other threads.
+
+  for(int shard_index = 0; shard_index < shards.size(); ++shard_index)
+    {
+      shards[shard_index]->get_hash();
+      get_range(shape, boundaries[shard_index], boundaries[shard_index + 1])->get_hash();
+    }
+
+  return BoundedTasks::map(memory_in, [&](size_t shard_index)
+  {
+    return shard_func(int(shard_index));
+  }, workers);
+}
+
+ShardedDFA ShardedDFA::reshard(const std::vector<shared_dfa_ptr>& outputs_in) const
+{
+  // split arbitrary outputs into this sharding. outputs entirely
+  // within a shard's range are used as is, and the rest are
+  // intersected with the range.
+
+  Profile profile("ShardedDFA::reshard");
+
+  std::vector<std::vector<bool>> outputs_characters;
+  for(shared_dfa_ptr output : outputs_in)
+    {
+      assert(output->get_shape() == shape);
+      output->get_hash();
+      outputs_characters.push_back(_first_characters(output));
+    }
+
+  std::vector<std::vector<int>> shard_outputs(shards.size());
+  std::vector<std::vector<bool>> shard_outputs_contained(shards.size());
+  std::vector<size_t> memory(shards.size(), 0);
+  for(int shard_index = 0; shard_index < shards.size(); ++shard_index)
+    {
+      for(int output_index = 0; output_index < outputs_in.size(); ++output_index)
+	{
+	  const std::vector<bool>& characters = outputs_characters[output_index];
+	  auto begin = characters.begin() + boundaries[shard_index];
+	  auto end = characters.begin() + boundaries[shard_index + 1];
+	  if(std::none_of(begin, end, [](bool b) {return b;}))
+	    {
+	      continue;
+	    }
+
+	  bool contained = ((std::count(characters.begin(), characters.end(), true) ==
+			     std::count(begin, end, true)));
+
+	  shard_outputs[shard_index].push_back(output_index);
+	  shard_outputs_contained[shard_index].push_back(contained);
+	  memory[shard_index] += BoundedTasks::get_dfa_bytes(outputs_in[output_index]);
+	}
+    }
+
+  return ShardedDFA(shape, boundaries, map_shards(memory, [&](int shard_index)
+  {
+    std::vector<shared_dfa_ptr> pieces;
+    for(int i = 0; i < shard_outputs[shard_index].size(); ++i)
+      {
+	shared_dfa_ptr output = outputs_in[shard_outputs[shard_index][i]];
+	if(shard_outputs_contained[shard_index][i])
+	  {
+	    pieces.push_back(output);
+	  }
+	else
+	  {
+	    shared_dfa_ptr range = get_range(shape, boundaries[shard_index], boundaries[shard_index + 1]);
+	    pieces.push_back(DFAUtil::get_intersection(output, range));
+	  }
+      }
+
+    if(pieces.size() == 0)
+      {
+	return DFAUtil::get_reject(shape);
+      }
+    else if(pieces.size() == 1)
+      {
+	return pieces[0];
+      }
+
+    return DFAUtil::get_union_vector(shape, pieces);
+  }));
+}
+
+void ShardedDFA::save(std::string name_in) const
+{
+  // saves each shard as <name>/shard=NNN, then the boundaries so a
+  // complete shard list is never seen before its shards.
+
+  Profile profile("ShardedDFA::save");
+
+  create_directory("scratch/" + name_in);
+
+  for(int shard_index = 0; shard_index < shards.size(); ++shard_index)
+    {
+      shards[shard_index]->save(std::format("{:s}/shard={:03d}", name_in, shard_index));
+    }
+
+  std::string boundaries_filename = "scratch/" + name_in + "/boundaries";
+  std::string boundaries_filename_temp = boundaries_filename + "." + get_process_name();
+
+  std::ofstream boundaries_file(boundaries_filename_temp);
+  for(int boundary : boundaries)
+    {
+      boundaries_file << boundary << "\n";
+    }
+
+  boundaries_file.close();
+  if(!boundaries_file)
+    {
+      throw std::runtime_error("ShardedDFA::save() write failed");
+    }
+
+  if(std::rename(boundaries_filename_temp.c_str(), boundaries_filename.c_str()))
+    {
+      perror("ShardedDFA save rename");
+      throw std::runtime_error("ShardedDFA::save() rename failed");
+    }
+}
+
+void ShardedDFA::set_workers(size_t workers_in)
+{
+  assert(workers_in >= 1);
+  workers = workers_in;
+}
+
+double ShardedDFA::size() const
+{
+  double output = 0.0;
+  for(shared_dfa_ptr shard : shards)
+    {
+      output += shard->size();
+    }
+  return output;
+}
+
+shared_dfa_ptr ShardedDFA::to_dfa() const
+{
+  Profile profile("ShardedDFA::to_dfa");
+
+  std::vector<shared_dfa_ptr> nonempty;
+  for(shared_dfa_ptr shard : shards)
+    {
+      if(!shard->is_constant(false))
+	{
+	  nonempty.push_back(shard);
+	}
+    }
+
+  if(nonempty.size() == 0)
+    {
+      return DFAUtil::get_reject(shape);
+    }
+  else if(nonempty.size() == 1)
+    {
+      return nonempty[0];
+    }
+
+  return DFAUtil::get_union_vector(shape, nonempty);
+}
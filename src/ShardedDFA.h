@@ -0,0 +1,65 @@
+// ShardedDFA.h
+
+#ifndef SHARDED_DFA_H
+#define SHARDED_DFA_H
+
+// positions split by the character of the first layer into shards,
+// each a regular DFA of the full shape accepting only its own range
+// of first characters. operations run shard by shard, so no working
+// set ever holds more than a few shards.
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ChangeDFA.h"
+#include "DFA.h"
+#include "MoveGraph.h"
+
+class ShardedDFA
+{
+ private:
+
+  dfa_shape_t shape;
+
+  // shard i accepts first characters in [boundaries[i], boundaries[i+1])
+  std::vector<int> boundaries;
+  std::vector<shared_dfa_ptr> shards;
+
+  std::vector<shared_dfa_ptr> map_shards(const std::vector<size_t>&, std::function<shared_dfa_ptr(int)>) const;
+  ShardedDFA reshard(const std::vector<shared_dfa_ptr>&) const;
+
+ public:
+
+  ShardedDFA(const dfa_shape_t&, const std::vector<int>&, const std::vector<shared_dfa_ptr>&);
+
+  static ShardedDFA from_dfa(shared_dfa_ptr, int);
+  static ShardedDFA from_dfa(shared_dfa_ptr, const std::vector<int>&);
+  shared_dfa_ptr to_dfa() const;
+
+  ShardedDFA get_change(const change_vector&) const;
+  ShardedDFA get_difference(const ShardedDFA&) const;
+  ShardedDFA get_intersection(const ShardedDFA&) const;
+  ShardedDFA get_moves(const MoveGraph&, std::string) const;
+  ShardedDFA get_union(const ShardedDFA&) const;
+
+  const std::vector<int>& get_boundaries() const;
+  static std::vector<int> get_even_boundaries(const dfa_shape_t&, int);
+  static shared_dfa_ptr get_range(const dfa_shape_t&, int, int);
+  const dfa_shape_t& get_shape() const;
+  shared_dfa_ptr get_shard(int) const;
+  int get_shard_count() const;
+  int get_shard_index(int) const;
+
+  static size_t get_workers();
+  static void set_workers(size_t);
+
+  bool is_constant(bool) const;
+  double size() const;
+
+  static std::optional<ShardedDFA> load(const dfa_shape_t&, std::string);
+  void save(std::string) const;
+};
+
+#endif
@@ -0,0 +1,78 @@
+// SortedRuns.h
+
+#ifndef SORTED_RUNS_H
+#define SORTED_RUNS_H
+
+// external sorting helpers for data bigger than the RAM budget, which
+// is sorted in chunks written as runs and then merged.
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "MemoryMap.h"
+
+template<class T>
+inline void merge_sorted_runs(std::vector<MemoryMap<T>>& runs, std::function<void(const T&, size_t, size_t)> output_func)
+{
+  // k-way merge of sorted runs, passing each element to output_func
+  // in sorted order with its run index and offset. ties are broken by
+  // run order. runs are read sequentially and unlinked once merged.
+
+  typedef std::pair<T, size_t> merge_entry;
+  auto merge_greater = [](const merge_entry& a, const merge_entry& b)
+  {
+    if(b.first < a.first)
+      {
+        return true;
+      }
+    if(a.first < b.first)
+      {
+        return false;
+      }
+    return b.second < a.second;
+  };
+  std::priority_queue<merge_entry, std::vector<merge_entry>, decltype(merge_greater)> merge_queue(merge_greater);
+
+  std::vector<size_t> run_offsets(runs.size(), 0);
+  for(size_t run_index = 0; run_index < runs.size(); ++run_index)
+    {
+      assert(runs[run_index].size() > 0);
+      merge_queue.emplace(runs[run_index][0], run_index);
+    }
+
+  while(!merge_queue.empty())
+    {
+      merge_entry next_entry = merge_queue.top();
+      merge_queue.pop();
+
+      size_t run_index = next_entry.second;
+      output_func(next_entry.first, run_index, run_offsets[run_index]);
+
+      size_t run_offset = ++run_offsets[run_index];
+      if(run_offset < runs[run_index].size())
+        {
+          merge_queue.emplace(runs[run_index][run_offset], run_index);
+        }
+      else
+        {
+          runs[run_index].unlink();
+        }
+    }
+
+  runs.clear();
+}
+
+template<class T>
+inline void merge_sorted_runs(std::vector<MemoryMap<T>>& runs, std::function<void(const T&)> output_func)
+{
+  merge_sorted_runs<T>(runs, [&](const T& next, size_t, size_t)
+  {
+    output_func(next);
+  });
+}
+
+#endif
@@ -0,0 +1,263 @@
+// SwapDFA.cpp
+
+#include "SwapDFA.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "BinaryDFA.h"
+#include "BoundedTasks.h"
+#include "MemoryMap.h"
+#include "Profile.h"
+#include "SortedRuns.h"
+#include "parallel.h"
+#include "utils.h"
+
+static std::atomic<int> next_workspace_id = 0;
+
+static dfa_shape_t get_swapped_shape(const dfa_shape_t& shape_in, int layer_in)
+{
+  assert(0 <= layer_in);
+  assert(layer_in + 1 < shape_in.size());
+
+  dfa_shape_t output(shape_in);
+  std::swap(output[layer_in], output[layer_in + 1]);
+  return output;
+}
+
+SwapDFA::SwapDFA(const DFA& dfa_in, int layer_in)
+  : DFA(get_swapped_shape(dfa_in.get_shape(), layer_in))
+{
+  Profile profile("SwapDFA");
+
+  dfa_in.mmap();
+
+  // intermediate files go in a workspace private to this build
+
+  std::string workspace = create_directory("scratch/temp/" + get_process_name() + "-swap-" + std::to_string(next_workspace_id++));
+  auto build_file_name = [&](std::string suffix)
+  {
+    return workspace + "/" + suffix;
+  };
+
+  int first_shape = dfa_in.get_layer_shape(layer_in);
+  int second_shape = dfa_in.get_layer_shape(layer_in + 1);
+  size_t first_size = dfa_in.get_layer_size(layer_in);
+  size_t columns_count = (first_size - 2) * size_t(second_shape);
+  assert(columns_count <= DFA_STATE_MAX);
+
+  // each input state at the first swapped layer and character of the
+  // second swapped layer gives one column of transitions for the new
+  // second layer. columns are populated in chunks of input states
+  // sized to the RAM budget, then hashed and sorted like BinaryDFA
+  // transitions. each chunk is written as a run of hashes and a run
+  // of the matching columns in the same order.
+
+  profile.tic("columns");
+
+  std::unique_ptr<MemoryReservation> ram_reservation = BinaryDFA::reserve_ram();
+
+  size_t chunk_state_bytes = size_t(second_shape) * size_t(first_shape + binary_dfa_hash_width) * sizeof(dfa_state_t);
+  size_t chunk_states = std::min(first_size - 2, std::max(ram_reservation->get_memory() / chunk_state_bytes, size_t(1)));
+  size_t chunk_columns_max = chunk_states * second_shape;
+
+  std::vector<dfa_state_t> chunk_columns(chunk_columns_max * first_shape);
+  std::vector<BinaryDFATransitionsHashPlusIndex> chunk_hashed(chunk_columns_max);
+  std::vector<size_t> chunk_iota(chunk_columns_max);
+  std::iota(chunk_iota.begin(), chunk_iota.end(), size_t(0));
+
+  std::vector<MemoryMap<BinaryDFATransitionsHashPlusIndex>> hashed_runs;
+  std::vector<MemoryMap<dfa_state_t>> columns_runs;
+  for(size_t chunk_start = 0; chunk_start < first_size - 2; chunk_start += chunk_states)
+    {
+      size_t chunk_size = std::min(chunk_start + chunk_states, first_size - 2) - chunk_start;
+      size_t chunk_columns_count = chunk_size * second_shape;
+
+      profile.tic("columns populate");
+
+      TRY_PARALLEL_3(std::for_each, chunk_iota.begin(), chunk_iota.begin() + chunk_size, [&](size_t i)
+      {
+	DFATransitionsReference first_transitions = dfa_in.get_transitions(layer_in, dfa_state_t(2 + chunk_start + i));
+	for(int c_first = 0; c_first < first_shape; ++c_first)
+	  {
+	    DFATransitionsReference second_transitions = dfa_in.get_transitions(layer_in + 1, first_transitions[c_first]);
+	    for(int c_second = 0; c_second < second_shape; ++c_second)
+	      {
+		chunk_columns[(i * second_shape + c_second) * first_shape + c_first] = second_transitions[c_second];
+	      }
+	  }
+      });
+
+      profile.tic("columns hash");
+
+      chunk_hashed.resize(chunk_columns_count);
+      TRY_PARALLEL_4(std::transform, chunk_iota.begin(), chunk_iota.begin() + chunk_columns_count, chunk_hashed.begin(), [&](size_t k)
+      {
+	return BinaryDFATransitionsHashPlusIndex::from_transitions(&(chunk_columns[k * first_shape]), first_shape, chunk_start * second_shape + k);
+      });
+
+      profile.tic("columns sort");
+
+      TRY_PARALLEL_2(std::sort, chunk_hashed.begin(), chunk_hashed.end());
+
+      profile.tic("columns write");
+
+      std::string run_suffix = "-run=" + std::to_string(hashed_runs.size());
+      hashed_runs.emplace_back(build_file_name("columns_hashed" + run_suffix), chunk_hashed);
+
+      MemoryMap<dfa_state_t>& columns_run = columns_runs.emplace_back(build_file_name("columns" + run_suffix), chunk_columns_count * first_shape);
+      TRY_PARALLEL_3(std::for_each, chunk_iota.begin(), chunk_iota.begin() + chunk_columns_count, [&](size_t k)
+      {
+	size_t column_offset = chunk_hashed[k].get_pair_rank() - chunk_start * second_shape;
+	std::copy_n(chunk_columns.begin() + column_offset * first_shape, first_shape, &(columns_run[k * first_shape]));
+      });
+    }
+
+  // release chunk memory before merging
+  chunk_columns = std::vector<dfa_state_t>();
+  chunk_hashed = std::vector<BinaryDFATransitionsHashPlusIndex>();
+  chunk_iota = std::vector<size_t>();
+
+  // merge the runs in column order, numbering distinct columns as new
+  // states. the columns of new states are appended in state order,
+  // and (column index, new state) pairs are buffered into runs sorted
+  // by column index.
+
+  profile.tic("columns dedupe");
+
+  auto get_constant = [&](const dfa_state_t *column)
+  {
+    dfa_state_t possible_constant = column[0];
+    if((possible_constant < 2) && std::all_of(column, column + first_shape, [=](dfa_state_t next_state) {return next_state == possible_constant;}))
+      {
+	return possible_constant;
+      }
+    return ~dfa_state_t(0);
+  };
+
+  MemoryMap<dfa_state_t> state_columns(build_file_name("state_columns"), columns_count * first_shape);
+
+  std::vector<MemoryMap<dfa_state_pair_t>> column_states_runs;
+  std::vector<dfa_state_pair_t> column_states_buffer;
+  column_states_buffer.reserve(std::min(columns_count, std::max(ram_reservation->get_memory() / sizeof(dfa_state_pair_t), size_t(1))));
+
+  auto write_column_states_run = [&]()
+  {
+    TRY_PARALLEL_2(std::sort, column_states_buffer.begin(), column_states_buffer.end());
+    column_states_runs.emplace_back(build_file_name("column_states-run=" + std::to_string(column_states_runs.size())), column_states_buffer);
+    column_states_buffer.clear();
+  };
+
+  dfa_state_t previous_state = 1; // first new state will be 2
+  {
+    size_t merged_count = 0;
+    BinaryDFATransitionsHashPlusIndex previous_hashed = {};
+    std::vector<dfa_state_t> previous_column(first_shape);
+
+    merge_sorted_runs<BinaryDFATransitionsHashPlusIndex>(hashed_runs, [&](const BinaryDFATransitionsHashPlusIndex& column_hashed, size_t run_index, size_t run_offset)
+    {
+      const dfa_state_t *column = &(columns_runs[run_index][run_offset * first_shape]);
+
+      dfa_state_t column_state = get_constant(column);
+      if(column_state >= 2)
+	{
+	  if((merged_count == 0) || (previous_hashed < column_hashed))
+	    {
+	      // first or different column from predecessor
+	      assert(previous_state + 1 > previous_state);
+	      ++previous_state;
+
+	      std::copy_n(column, first_shape, &(state_columns[size_t(previous_state - 2) * first_shape]));
+	    }
+	  else
+	    {
+	      // confirm hash match is not a collision
+	      assert(::memcmp(previous_column.data(), column, sizeof(dfa_state_t) * first_shape) == 0);
+	    }
+
+	  column_state = previous_state;
+	}
+
+      column_states_buffer.emplace_back(column_hashed.get_pair_rank(), column_state);
+      if(column_states_buffer.size() == column_states_buffer.capacity())
+	{
+	  write_column_states_run();
+	}
+
+      std::copy_n(column, first_shape, previous_column.begin());
+      previous_hashed = column_hashed;
+      ++merged_count;
+    });
+    assert(merged_count == columns_count);
+  }
+
+  if(column_states_buffer.size() > 0)
+    {
+      write_column_states_run();
+    }
+  column_states_buffer = std::vector<dfa_state_pair_t>();
+
+  for(MemoryMap<dfa_state_t>& columns_run : columns_runs)
+    {
+      columns_run.unlink();
+    }
+  columns_runs.clear();
+
+  // write swapped layers
+
+  profile.tic("build second");
+
+  build_layer(layer_in + 1, size_t(previous_state) + 1, [&](dfa_state_t state, dfa_state_t *transitions_out)
+  {
+    assert(state >= 2);
+    std::copy_n(state_columns.begin() + size_t(state - 2) * first_shape, first_shape, transitions_out);
+  });
+
+  state_columns.unlink();
+
+  profile.tic("column states");
+
+  // merge new states back into column order, which is the first
+  // layer's transitions in state order.
+
+  MemoryMap<dfa_state_t> column_states(build_file_name("column_states"), columns_count);
+  size_t column_index = 0;
+  merge_sorted_runs<dfa_state_pair_t>(column_states_runs, [&](const dfa_state_pair_t& column_and_state)
+  {
+    assert(column_and_state.get_left_state() == column_index);
+    column_states[column_index++] = column_and_state.get_right_state();
+  });
+  assert(column_index == columns_count);
+
+  profile.tic("build first");
+
+  build_layer(layer_in, first_size, [&](dfa_state_t state, dfa_state_t *transitions_out)
+  {
+    std::copy_n(column_states.begin() + (size_t(state) - 2) * second_shape, second_shape, transitions_out);
+  });
+
+  column_states.unlink();
+
+  remove_directory(workspace);
+
+  // other layers are unchanged, since the first swapped layer keeps
+  // the input state numbering.
+
+  profile.tic("share unchanged");
+
+  for(int layer = 0; layer < get_shape_size(); ++layer)
+    {
+      if((layer != layer_in) && (layer != layer_in + 1))
+	{
+	  copy_layer(layer, dfa_in);
+	}
+    }
+
+  set_initial_state(dfa_in.get_initial_state());
+}
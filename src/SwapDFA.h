@@ -0,0 +1,19 @@
+// SwapDFA.h
+
+#ifndef SWAP_DFA_H
+#define SWAP_DFA_H
+
+#include "DFA.h"
+
+// input DFA with two adjacent layers swapped. only the swapped layers
+// are rebuilt: the first keeps one state per input state, and the
+// second gets the deduped (first state, character) columns. the other
+// layers keep their state numbering, so they share the input's files.
+
+class SwapDFA : public DFA
+{
+ public:
+  SwapDFA(const DFA&, int);
+};
+
+#endif
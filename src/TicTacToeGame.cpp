@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "DFAUtil.h"
+#include "GameUtil.h"
 
 static dfa_shape_t get_shape(int n)
 {
@@ -72,6 +73,14 @@ shared_dfa_ptr TicTacToeGame::get_lost_condition(int side_to_move, int x_start,
   return condition;
 }
 
+std::vector<std::vector<int>> TicTacToeGame::get_symmetries() const
+{
+  return GameUtil::get_board_symmetries(n, n, [=, this](int x, int y)
+  {
+    return y * n + x;
+  });
+}
+
 MoveGraph TicTacToeGame::build_move_graph(int side_to_move) const
 {
   shared_dfa_ptr lost_positions = this->get_positions_lost(side_to_move);
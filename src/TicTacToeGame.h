@@ -4,6 +4,7 @@
 #define TICTACTOE_GAME_H
 
 #include <string>
+#include <vector>
 
 #include "Game.h"
 
@@ -29,6 +30,8 @@ private:
 
   virtual shared_dfa_ptr build_positions_lost(int) const;
 
+  virtual std::vector<std::vector<int>> get_symmetries() const;
+
   virtual std::string position_to_string(const DFAString&) const;
 };
 
@@ -3,7 +3,8 @@
 #include "UnionRestartDFA.h"
 
 UnionRestartDFA::UnionRestartDFA(const DFA& left_in,
-                                 const DFA& right_in)
-  : BinaryRestartDFA(left_in, right_in, union_function)
+                                 const DFA& right_in,
+                                 std::string workspace_in)
+  : BinaryRestartDFA(left_in, right_in, union_function, workspace_in)
 {
 }
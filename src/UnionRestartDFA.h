@@ -10,7 +10,7 @@ class UnionRestartDFA : public BinaryRestartDFA
 {
  public:
 
-  UnionRestartDFA(const DFA&, const DFA&);
+  UnionRestartDFA(const DFA&, const DFA&, std::string);
 };
 
 #endif
@@ -2,6 +2,7 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <string>
 
 #include "test_utils.h"
 
@@ -9,7 +10,7 @@ int main(int argc, char **argv)
 {
   if(argc < 2)
     {
-      std::cerr << "usage: test_forward GAME_NAME [depth]\n";
+      std::cerr << "usage: test_forward GAME_NAME [depth] [frontier]\n";
       return 1;
     }
 
@@ -17,6 +18,7 @@ int main(int argc, char **argv)
   Game *game = get_game(game_name);
 
   int ply_max = (argc >= 3) ? atoi(argv[2]) : 100;
+  bool frontier_mode = (argc >= 4) && (std::string(argv[3]) == "frontier");
 
   auto initial_positions = game->get_positions_initial();
   assert(initial_positions->size() == 1);
@@ -28,6 +30,29 @@ int main(int argc, char **argv)
       std::cout << game->position_to_string(*iter) << std::endl;
     }
 
+  if(frontier_mode)
+    {
+      // only expand positions not seen earlier, and stop at the
+      // fixpoint.
+      for(int ply = 0; ply <= ply_max; ++ply)
+	{
+	  shared_dfa_ptr frontier = game->get_positions_forward_frontier(ply);
+	  shared_dfa_ptr seen = game->get_positions_forward_seen(ply);
+	  std::cout << frontier->size() << " new positions after " << ply << " ply, " << seen->size() << " seen." << std::endl;
+	  if(frontier->is_constant(0))
+	    {
+	      for(int side_to_move = 0; side_to_move < 2; ++side_to_move)
+		{
+		  shared_dfa_ptr closure = game->get_positions_forward_closure(side_to_move);
+		  std::cout << closure->size() << " positions reachable with side " << side_to_move << " to move." << std::endl;
+		}
+	      break;
+	    }
+	}
+
+      return 0;
+    }
+
   for(int ply = 0; ply <= ply_max; ++ply)
     {
       shared_dfa_ptr positions = game->get_positions_forward(ply);
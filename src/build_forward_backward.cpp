@@ -122,9 +122,9 @@ int main(int argc, char **argv)
 	  ? game->get_positions_losing(side_to_move, backward_ply_max)
 	  : game->get_positions_lost(side_to_move);
 
-	shared_dfa_ptr could_lose = game->get_moves_backward(side_to_move, winning_by_ply[ply + 1]);
-	shared_dfa_ptr wont_lose = game->get_moves_backward(side_to_move, DFAUtil::get_inverse(winning_by_ply[ply + 1]));
-	shared_dfa_ptr will_lose = DFAUtil::get_difference(could_lose, wont_lose);
+	// has moves, and all of them lead to opponent wins
+	shared_dfa_ptr will_lose = DFAUtil::get_intersection(game->get_has_moves(side_to_move),
+							     game->get_moves_backward_universal(side_to_move, winning_by_ply[ply + 1]));
 
 	return DFAUtil::get_intersection(DFAUtil::get_union(backward_losing, will_lose),
 					 positions);
@@ -164,8 +164,7 @@ int main(int argc, char **argv)
       std::cout << summarize_result("unknown", unknown_size) << std::endl;
 
 #ifdef PARANOIA
-      shared_dfa_ptr winning_and_losing = DFAUtil::get_intersection(winning_by_ply[ply], losing_by_ply[ply]);
-      assert(winning_and_losing->is_constant(false));
+      assert(DFAUtil::is_disjoint(winning_by_ply[ply], losing_by_ply[ply]));
 #endif
     }
 
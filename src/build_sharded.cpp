@@ -0,0 +1,156 @@
+// build_sharded.cpp
+
+// runs forward or backward search with every move application split
+// into prefix shards (see ShardJobs.h). local worker processes are
+// started here, and more can be started on other machines sharing
+// scratch/ with "build_sharded worker".
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ShardJobs.h"
+#include "test_utils.h"
+
+static int run_worker(pid_t parent_pid)
+{
+  // work until killed, or until the parent exits if started locally
+
+  auto poll_delay = std::chrono::milliseconds(10);
+  while((parent_pid == 0) || (getppid() == parent_pid))
+    {
+      if(ShardJobs::work())
+	{
+	  poll_delay = std::chrono::milliseconds(10);
+	}
+      else
+	{
+	  std::this_thread::sleep_for(poll_delay);
+	  poll_delay = std::min(poll_delay * 2, std::chrono::milliseconds(1000));
+	}
+    }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if((argc >= 2) && (std::string(argv[1]) == "worker"))
+    {
+      return run_worker((argc >= 3) ? pid_t(atoi(argv[2])) : 0);
+    }
+
+  if(argc < 4)
+    {
+      std::cerr << "usage: build_sharded GAME_NAME forward|backward PLY_MAX [SHARDS] [PROCESSES]\n";
+      std::cerr << "       build_sharded worker\n";
+      return 1;
+    }
+
+  std::string game_name(argv[1]);
+  Game *game = get_game(game_name);
+
+  std::string direction(argv[2]);
+  if((direction != "forward") && (direction != "backward"))
+    {
+      std::cerr << "direction must be forward or backward\n";
+      return 1;
+    }
+
+  int ply_max = atoi(argv[3]);
+  int shards = (argc >= 5) ? atoi(argv[4]) : game->get_shape()[0];
+  int processes = (argc >= 6) ? atoi(argv[5]) : 1;
+
+  std::cout << "PLY MAX: " << ply_max << std::endl;
+  std::cout << "SHARDS: " << shards << std::endl;
+  std::cout << "PROCESSES: " << processes << std::endl;
+
+  // start local workers. they are reaped automatically, so claims of
+  // workers that die are seen as stale instead of held by zombies.
+
+  signal(SIGCHLD, SIG_IGN);
+
+  std::vector<pid_t> worker_pids;
+  for(int i = 1; i < processes; ++i)
+    {
+      pid_t worker_pid = fork();
+      if(worker_pid < 0)
+	{
+	  perror("fork");
+	  return 1;
+	}
+      else if(worker_pid == 0)
+	{
+	  std::string parent_pid = std::to_string(getppid());
+	  execlp(argv[0], argv[0], "worker", parent_pid.c_str(), (char *) 0);
+	  perror("execlp");
+	  _exit(1);
+	}
+
+      worker_pids.push_back(worker_pid);
+    }
+
+  game->set_moves_handler([&](const MoveGraph& move_graph, std::string move_graph_name, std::string name_prefix, shared_dfa_ptr positions)
+  {
+    return ShardJobs::run(move_graph, move_graph_name, name_prefix, positions, shards);
+  });
+
+  if(direction == "forward")
+    {
+      for(int ply = 0; ply <= ply_max; ++ply)
+	{
+	  shared_dfa_ptr positions = game->get_positions_forward(ply);
+	  std::cout << positions->size() << " positions after " << ply << " ply." << std::endl;
+	  if(positions->is_constant(0))
+	    {
+	      break;
+	    }
+	}
+    }
+  else
+    {
+      for(int ply = 0; ply <= ply_max; ++ply)
+	{
+	  bool finished = true;
+	  for(int side_to_move = 0; side_to_move < 2; ++side_to_move)
+	    {
+	      shared_dfa_ptr losing = game->get_positions_losing(side_to_move, ply);
+	      shared_dfa_ptr winning = game->get_positions_winning(side_to_move, ply);
+	      shared_dfa_ptr unknown = game->get_positions_unknown(side_to_move, ply);
+	      std::cout << "ply " << ply << " side " << side_to_move << ": " << winning->size() << " winning, " << losing->size() << " losing, " << unknown->size() << " unknown." << std::endl;
+
+	      if(!unknown->is_constant(0))
+		{
+		  finished = false;
+		}
+	    }
+
+	  if(finished)
+	    {
+	      break;
+	    }
+	}
+    }
+
+  // stop local workers
+
+  for(pid_t worker_pid : worker_pids)
+    {
+      kill(worker_pid, SIGTERM);
+    }
+  for(pid_t worker_pid : worker_pids)
+    {
+      // fails once the worker has been reaped
+      waitpid(worker_pid, 0, 0);
+    }
+
+  return 0;
+}
@@ -0,0 +1,48 @@
+// gc.cpp
+
+#include <iostream>
+#include <string>
+
+#include "DFAUtil.h"
+
+int main(int argc, char **argv)
+{
+  if(argc != 2)
+    {
+      std::cerr << "usage: " << argv[0] << " BUDGET_BYTES" << std::endl;
+      std::cerr << "  BUDGET_BYTES may have a K, M, G or T suffix. 0 removes every unnamed DFA" << std::endl;
+      std::cerr << "  not pinned by a running process or used within the lease timeout." << std::endl;
+      return 1;
+    }
+
+  std::string budget_arg(argv[1]);
+  size_t suffix_pos = 0;
+  size_t budget_bytes = std::stoull(budget_arg, &suffix_pos);
+
+  std::string suffix = budget_arg.substr(suffix_pos);
+  if(suffix == "T")
+    {
+      budget_bytes <<= 40;
+    }
+  else if(suffix == "G")
+    {
+      budget_bytes <<= 30;
+    }
+  else if(suffix == "M")
+    {
+      budget_bytes <<= 20;
+    }
+  else if(suffix == "K")
+    {
+      budget_bytes <<= 10;
+    }
+  else if(suffix != "")
+    {
+      std::cerr << "unrecognized suffix: " << suffix << std::endl;
+      return 1;
+    }
+
+  DFAUtil::collect_garbage(budget_bytes);
+
+  return 0;
+}
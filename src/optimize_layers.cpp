@@ -0,0 +1,205 @@
+// optimize_layers.cpp
+
+// searches layer orders in the spirit of BDD sifting. the samples are
+// the game's forward positions through the given ply, and each order
+// is scored by the total states of the samples in that order. each
+// layer in turn is moved through every position by adjacent layer
+// swaps and left at the best one, largest layers first, until a pass
+// finds no improvement.
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "DFAUtil.h"
+#include "SwapDFA.h"
+#include "test_utils.h"
+
+struct score_t
+{
+  size_t total_states;
+  std::vector<size_t> sample_states;
+};
+
+static score_t score_samples(const std::vector<shared_dfa_ptr>& samples_in)
+{
+  score_t output = {0, {}};
+  for(shared_dfa_ptr sample : samples_in)
+    {
+      output.sample_states.push_back(sample->states());
+      output.total_states += sample->states();
+    }
+  return output;
+}
+
+static std::vector<shared_dfa_ptr> swap_samples(const std::vector<shared_dfa_ptr>& samples_in, int layer)
+{
+  std::vector<shared_dfa_ptr> output;
+  for(shared_dfa_ptr sample : samples_in)
+    {
+      output.push_back(shared_dfa_ptr(new SwapDFA(*sample, layer)));
+    }
+  return output;
+}
+
+static void print_score(std::string label, const score_t& score_in)
+{
+  std::cout << label << ": " << score_in.total_states << " states (";
+  for(int ply = 0; ply < score_in.sample_states.size(); ++ply)
+    {
+      std::cout << ((ply > 0) ? ", " : "") << "ply " << ply << " = " << score_in.sample_states[ply];
+    }
+  std::cout << ")" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 3)
+    {
+      std::cerr << "usage: optimize_layers GAME_NAME PLY_MAX" << std::endl;
+      return 1;
+    }
+
+  std::string game_name(argv[1]);
+  Game *game = get_game(game_name);
+  int ndim = int(game->get_shape().size());
+
+  int ply_max = atoi(argv[2]);
+
+  std::vector<shared_dfa_ptr> samples;
+  for(int ply = 0; ply <= ply_max; ++ply)
+    {
+      samples.push_back(game->get_positions_forward(ply));
+    }
+
+  // sift. order[layer] = original layer now at layer.
+
+  std::vector<int> order(ndim);
+  std::iota(order.begin(), order.end(), 0);
+
+  score_t best = score_samples(samples);
+  print_score("initial", best);
+
+  for(int pass = 0; ; ++pass)
+    {
+      std::vector<size_t> layer_states(ndim, 0);
+      for(shared_dfa_ptr sample : samples)
+	{
+	  for(int layer = 0; layer < ndim; ++layer)
+	    {
+	      layer_states[order[layer]] += sample->get_layer_size(layer);
+	    }
+	}
+
+      std::vector<int> sift_layers(order);
+      std::stable_sort(sift_layers.begin(), sift_layers.end(), [&](int a, int b)
+      {
+	return layer_states[a] > layer_states[b];
+      });
+
+      bool improved = false;
+      for(int sift_layer : sift_layers)
+	{
+	  int position_old = int(std::find(order.begin(), order.end(), sift_layer) - order.begin());
+	  int position_best = position_old;
+	  std::vector<shared_dfa_ptr> samples_best = samples;
+
+	  auto check_candidate = [&](int position, const std::vector<shared_dfa_ptr>& candidate_samples)
+	  {
+	    score_t candidate = score_samples(candidate_samples);
+	    if(candidate.total_states < best.total_states)
+	      {
+		best = candidate;
+		position_best = position;
+		samples_best = candidate_samples;
+	      }
+	  };
+
+	  // toward the first layer
+
+	  std::vector<shared_dfa_ptr> candidate_samples = samples;
+	  for(int position = position_old - 1; position >= 0; --position)
+	    {
+	      candidate_samples = swap_samples(candidate_samples, position);
+	      check_candidate(position, candidate_samples);
+	    }
+
+	  // toward the last layer
+
+	  candidate_samples = samples;
+	  for(int position = position_old + 1; position < ndim; ++position)
+	    {
+	      candidate_samples = swap_samples(candidate_samples, position - 1);
+	      check_candidate(position, candidate_samples);
+	    }
+
+	  if(position_best != position_old)
+	    {
+	      samples = samples_best;
+	      order.erase(order.begin() + position_old);
+	      order.insert(order.begin() + position_best, sift_layer);
+	      improved = true;
+
+	      std::cout << "pass " << pass << ": layer " << sift_layer << " moved from " << position_old << " to " << position_best << " => " << best.total_states << " states" << std::endl;
+	    }
+	}
+
+      if(!improved)
+	{
+	  break;
+	}
+    }
+
+  print_score("best", best);
+
+  // new layer of each current layer
+
+  std::vector<int> layer_map(ndim);
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      layer_map[order[layer]] = layer;
+    }
+
+  std::string layers_string;
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      layers_string += std::format("{:s}{:d}", (layer > 0) ? "_" : "", layer_map[layer]);
+    }
+  std::cout << "layers=" << layers_string << std::endl;
+
+  // games with declared square to layer mappings can adopt the order
+  // by name.
+
+  if(game_name.starts_with("breakthrough_"))
+    {
+      size_t layers_start = game_name.find(",layers=");
+      std::string base_name = game_name.substr(0, layers_start);
+
+      std::vector<int> square_layers(ndim);
+      std::iota(square_layers.begin(), square_layers.end(), 0);
+      if(layers_start != std::string::npos)
+	{
+	  std::vector<int> declared_layers;
+	  std::string declared_string = game_name.substr(layers_start + 8);
+	  for(size_t start = 0; start <= declared_string.size(); )
+	    {
+	      size_t end = std::min(declared_string.find('_', start), declared_string.size());
+	      declared_layers.push_back(atoi(declared_string.substr(start, end - start).c_str()));
+	      start = end + 1;
+	    }
+	  square_layers = declared_layers;
+	}
+
+      std::cout << "game: " << base_name << ",layers=";
+      for(int square = 0; square < ndim; ++square)
+	{
+	  std::cout << ((square > 0) ? "_" : "") << layer_map[square_layers[square]];
+	}
+      std::cout << std::endl;
+    }
+
+  return 0;
+}
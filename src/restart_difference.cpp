@@ -9,9 +9,9 @@
 
 int main(int argc, char **argv)
 {
-  if(argc < 4)
+  if(argc < 5)
     {
-      std::cerr << "usage: restart_difference GAME_NAME LEFT_HASH RIGHT_HASH\n";
+      std::cerr << "usage: restart_difference GAME_NAME LEFT_HASH RIGHT_HASH WORKSPACE\n";
       return 1;
     }
 
@@ -34,7 +34,9 @@ int main(int argc, char **argv)
       return 1;
     }
 
-  DifferenceRestartDFA difference_dfa(*left, *right);
+  std::string workspace(argv[4]);
+
+  DifferenceRestartDFA difference_dfa(*left, *right, workspace);
   std::string difference_name = "difference_cache/" + left->get_hash() + "_" + right->get_hash();
   difference_dfa.save(difference_name);
 
@@ -9,9 +9,9 @@
 
 int main(int argc, char **argv)
 {
-  if(argc < 4)
+  if(argc < 5)
     {
-      std::cerr << "usage: restart_union GAME_NAME LEFT_HASH RIGHT_HASH\n";
+      std::cerr << "usage: restart_union GAME_NAME LEFT_HASH RIGHT_HASH WORKSPACE\n";
       return 1;
     }
 
@@ -34,7 +34,9 @@ int main(int argc, char **argv)
       return 1;
     }
 
-  UnionRestartDFA union_dfa(*left, *right);
+  std::string workspace(argv[4]);
+
+  UnionRestartDFA union_dfa(*left, *right, workspace);
   std::string union_name = "union_cache/" + left->get_hash() + "_" + right->get_hash();
   union_dfa.save(union_name);
 
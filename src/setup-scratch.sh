@@ -11,5 +11,17 @@ mkdir -p difference_cache
 mkdir -p intersection_cache
 mkdir -p inverse_cache
 mkdir -p move_nodes
+mkdir -p permute_cache
+mkdir -p pins
+mkdir -p relabel_cache
 mkdir -p temp
 mkdir -p union_cache
+
+# index of saved names, appended to by every save. scratch directories
+# from before the index get one listing their existing names.
+if [ ! -e name_index ]
+then
+    find . -path ./dfas_by_hash -prune -o -type l -printf '%l %P\n' \
+	| sed -n 's|^\(\.\./\)*dfas_by_hash/\([0-9a-f]\{64\}\) |\2 |p' > name_index.tmp
+    mv name_index.tmp name_index
+fi
@@ -0,0 +1,139 @@
+// test_build_lease.cpp
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "BuildLease.h"
+#include "DFAUtil.h"
+#include "utils.h"
+
+static const std::string test_directory = "scratch/test_build_lease";
+
+void write_lease(std::string path, std::string holder, time_t age)
+{
+  std::ofstream lease_file(path);
+  lease_file << holder << "\n";
+  lease_file.close();
+
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = time(0) - age;
+  times[0].tv_nsec = times[1].tv_nsec = 0;
+  utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+void check_acquire(std::string test_name, std::string path, bool expected)
+{
+  std::unique_ptr<BuildLease> lease = BuildLease::try_acquire(path);
+  std::cout << test_name << ": expected " << (expected ? "acquired" : "held") << ", actually " << (lease ? "acquired" : "held") << std::endl;
+  if(bool(lease) != expected)
+    {
+      throw std::logic_error(test_name + ": unexpected lease result");
+    }
+}
+
+void test_leases()
+{
+  std::string path = test_directory + "/lease." + std::to_string(getpid()) + ".lock";
+
+  // exclusive until released
+
+  {
+    std::unique_ptr<BuildLease> lease = BuildLease::try_acquire(path);
+    if(!lease)
+      {
+	throw std::logic_error("first lease not acquired");
+      }
+    check_acquire("held by this process", path, false);
+  }
+  check_acquire("released", path, true);
+
+  // leases of dead processes on this host are taken over
+
+  pid_t child_pid = fork();
+  if(child_pid == 0)
+    {
+      _exit(0);
+    }
+  waitpid(child_pid, 0, 0);
+
+  write_lease(path, get_hostname() + "," + std::to_string(child_pid), 0);
+  check_acquire("dead process", path, true);
+
+  // leases from other hosts expire without heartbeats
+
+  write_lease(path, "other.host,1", 0);
+  check_acquire("other host heartbeat", path, false);
+
+  write_lease(path, "other.host,1", BuildLease::get_timeout_seconds() + 10);
+  check_acquire("other host timeout", path, true);
+}
+
+void test_load_or_build()
+{
+  // a second process asking for the same name waits for the first
+  // build instead of duplicating it.
+
+  dfa_shape_t shape({3, 3, 3});
+  std::string name = "test_build_lease/load_or_build." + std::to_string(getpid());
+
+  pid_t child_pid = fork();
+  if(child_pid == 0)
+    {
+      DFAUtil::load_or_build(shape, name, [&]()
+      {
+	std::this_thread::sleep_for(std::chrono::seconds(2));
+	return DFAUtil::get_fixed(shape, 1, 2);
+      });
+      _exit(0);
+    }
+
+  // give the child time to claim the build
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+  shared_dfa_ptr loaded = DFAUtil::load_or_build(shape, name, [&]()
+  {
+    throw std::logic_error("load_or_build built a name claimed by another process");
+    return shared_dfa_ptr();
+  });
+
+  int child_status = 0;
+  waitpid(child_pid, &child_status, 0);
+  if(!WIFEXITED(child_status) || WEXITSTATUS(child_status))
+    {
+      throw std::logic_error("load_or_build child failed");
+    }
+
+  if(!DFAUtil::is_equal(loaded, DFAUtil::get_fixed(shape, 1, 2)))
+    {
+      throw std::logic_error("load_or_build loaded the wrong DFA");
+    }
+}
+
+int main()
+{
+  try
+    {
+      create_directory(test_directory);
+
+      test_leases();
+      test_load_or_build();
+    }
+  catch(const std::logic_error& e)
+    {
+      std::cerr << e.what() << std::endl;
+      std::cerr.flush();
+      return 1;
+    }
+
+  return 0;
+}
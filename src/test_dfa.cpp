@@ -1,13 +1,21 @@
 // test_union_dfa.cpp
 
+#include <fstream>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "AcceptDFA.h"
+#include "BinaryDFA.h"
+#include "BinaryDecision.h"
+#include "BinaryEstimate.h"
 #include "CountCharacterDFA.h"
 #include "CountDFA.h"
 #include "DFA.h"
+#include "DFAUtil.h"
+#include "DifferenceDFA.h"
 #include "IntersectionDFA.h"
 #include "InverseDFA.h"
 #include "RejectDFA.h"
@@ -42,6 +50,50 @@ void test_helper(std::string test_name, const DFA& test_dfa, size_t expected_boa
   std::cout.flush();
 }
 
+void test_decision(std::string test_name, const DFA& left, const DFA& right, const BinaryFunction& leaf_func, bool expected_any)
+{
+  BinaryDecision decision(left, right, leaf_func);
+  if(decision.accepts_any() != expected_any)
+    {
+      throw std::logic_error(test_name + ": decision test failed");
+    }
+
+  if(expected_any)
+    {
+      const DFAString& witness = *decision.get_witness();
+      if(!leaf_func(left.contains(witness), right.contains(witness)))
+	{
+	  throw std::logic_error(test_name + ": decision witness not accepted");
+	}
+    }
+
+  std::cout << get_parameter_string(left.get_shape()) << " " << test_name << ": decision passed" << std::endl;
+}
+
+void test_estimate(std::string test_name, const DFA& left, const DFA& right, const BinaryFunction& leaf_func, const DFA& product)
+{
+  // without sampling the estimate is the exact count of reachable
+  // pairs, which bounds the product's non-constant states. with
+  // sampling it must still respect the product bound.
+
+  BinaryEstimate exact(left, right, leaf_func, size_t(1) << 20);
+  BinaryEstimate sampled(left, right, leaf_func, 1);
+  for(int layer = 0; layer < left.get_shape_size(); ++layer)
+    {
+      if(exact.get_layer_pairs(layer) + 2 < double(product.get_layer_size(layer)))
+	{
+	  throw std::logic_error(test_name + ": estimate below product states");
+	}
+
+      if(sampled.get_layer_pairs(layer) > double(left.get_layer_size(layer)) * double(right.get_layer_size(layer)))
+	{
+	  throw std::logic_error(test_name + ": sampled estimate above product bound");
+	}
+    }
+
+  std::cout << get_parameter_string(left.get_shape()) << " " << test_name << ": estimate passed" << std::endl;
+}
+
 void test_intersection_pair(std::string test_name, const DFA& left, const DFA& right, size_t expected_boards)
 {
   std::cout << "checking intersection pair " << test_name << std::endl;
@@ -49,6 +101,12 @@ void test_intersection_pair(std::string test_name, const DFA& left, const DFA& r
 
   IntersectionDFA test_dfa(left, right);
   test_helper("intersection pair " + test_name, test_dfa, expected_boards);
+
+  test_decision("intersection pair " + test_name, left, right, intersection_function, expected_boards > 0);
+  test_estimate("intersection pair " + test_name, left, right, intersection_function, test_dfa);
+
+  DifferenceDFA difference_dfa(left, right);
+  test_decision("difference pair " + test_name, left, right, difference_function, difference_dfa.size() > 0);
 }
 
 void test_intersection_pair(std::string test_name, const DFA& left, const DFA& right, double expected_boards)
@@ -71,12 +129,140 @@ void test_inverse(std::string test_name, const DFA& dfa_in)
   InverseDFA test_dfa(dfa_in);
   test_helper("inverse " + test_name, test_dfa, expected_boards);
 
+  DFA double_inverse(test_dfa.get_shape(), test_dfa.save_complement());
+  test_helper("double inverse " + test_name, double_inverse, size_t(dfa_in.size()));
+  if(double_inverse.get_hash() != dfa_in.get_hash())
+    {
+      throw std::logic_error("double inverse " + test_name + ": hash mismatch");
+    }
+
+  test_dfa.save("test_inverse");
+  DFA load_inverse(dfa_in.get_shape(), "test_inverse");
+  test_helper("load inverse " + test_name, load_inverse, expected_boards);
+
   IntersectionDFA intersection_dfa(test_dfa, dfa_in);
   test_intersection_pair("inverse " + test_name, test_dfa, dfa_in, size_t(0));
 
   test_union_pair("inverse union " + test_name, test_dfa, dfa_in, accept_all_boards);
 }
 
+void test_permuted(std::string test_name, shared_dfa_ptr dfa_in)
+{
+  std::cout << "checking permuted " << test_name << std::endl;
+  std::cout.flush();
+
+  int ndim = dfa_in->get_shape_size();
+
+  std::vector<std::vector<int>> permutations;
+  for(int rotation = 1; rotation < ndim; ++rotation)
+    {
+      std::vector<int> permutation;
+      for(int layer = 0; layer < ndim; ++layer)
+	{
+	  permutation.push_back((layer + rotation) % ndim);
+	}
+      permutations.push_back(permutation);
+    }
+
+  std::vector<int> reversal;
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      reversal.push_back(ndim - 1 - layer);
+    }
+  permutations.push_back(reversal);
+
+  for(const std::vector<int>& permutation : permutations)
+    {
+      shared_dfa_ptr permuted = DFAUtil::get_permuted(dfa_in, permutation);
+      test_helper("permuted " + test_name, *permuted, size_t(dfa_in->size()));
+
+      // every input string lands on its permuted string
+      for(auto iter = dfa_in->cbegin(); iter < dfa_in->cend(); ++iter)
+	{
+	  DFAString string_in = *iter;
+	  std::vector<int> characters(ndim);
+	  for(int layer = 0; layer < ndim; ++layer)
+	    {
+	      characters[permutation[layer]] = string_in[layer];
+	    }
+	  if(!permuted->contains(DFAString(permuted->get_shape(), characters)))
+	    {
+	      throw std::logic_error("permuted " + test_name + ": missing permuted string");
+	    }
+	}
+
+      // and the inverse permutation restores the input
+      std::vector<int> inverse(ndim);
+      for(int layer = 0; layer < ndim; ++layer)
+	{
+	  inverse[permutation[layer]] = layer;
+	}
+      if(!DFAUtil::is_equal(DFAUtil::get_permuted(permuted, inverse), dfa_in))
+	{
+	  throw std::logic_error("permuted " + test_name + ": inverse permutation differs");
+	}
+    }
+}
+
+void test_relabeled(std::string test_name, shared_dfa_ptr dfa_in)
+{
+  std::cout << "checking relabeled " << test_name << std::endl;
+  std::cout.flush();
+
+  const dfa_shape_t& shape = dfa_in->get_shape();
+  int ndim = int(shape.size());
+
+  // characters reversed keep the state numbering, and halved
+  // characters merge states.
+
+  std::vector<std::vector<int>> reversed_maps;
+  std::vector<std::vector<int>> halved_maps;
+  for(int layer = 0; layer < ndim; ++layer)
+    {
+      std::vector<int> reversed_map;
+      std::vector<int> halved_map;
+      for(int c = 0; c < shape[layer]; ++c)
+	{
+	  reversed_map.push_back(shape[layer] - 1 - c);
+	  halved_map.push_back(c / 2);
+	}
+      reversed_maps.push_back(reversed_map);
+      halved_maps.push_back(halved_map);
+    }
+
+  for(const std::vector<std::vector<int>>& maps : {reversed_maps, halved_maps})
+    {
+      shared_dfa_ptr relabeled = DFAUtil::get_relabeled(dfa_in, maps);
+
+      // exactly the relabeled input strings
+      std::set<std::vector<int>> strings_expected;
+      for(auto iter = dfa_in->cbegin(); iter < dfa_in->cend(); ++iter)
+	{
+	  DFAString string_in = *iter;
+	  std::vector<int> characters(ndim);
+	  for(int layer = 0; layer < ndim; ++layer)
+	    {
+	      characters[layer] = maps[layer][string_in[layer]];
+	    }
+	  strings_expected.insert(characters);
+	}
+
+      test_helper("relabeled " + test_name, *relabeled, strings_expected.size());
+      for(const std::vector<int>& characters : strings_expected)
+	{
+	  if(!relabeled->contains(DFAString(relabeled->get_shape(), characters)))
+	    {
+	      throw std::logic_error("relabeled " + test_name + ": missing relabeled string");
+	    }
+	}
+    }
+
+  if(!DFAUtil::is_equal(DFAUtil::get_relabeled(DFAUtil::get_relabeled(dfa_in, reversed_maps), reversed_maps), dfa_in))
+    {
+      throw std::logic_error("relabeled " + test_name + ": reversing twice differs");
+    }
+}
+
 void test_union_pair(std::string test_name, const DFA& left, const DFA& right, size_t expected_boards)
 {
   std::cout << "checking union pair " << test_name << std::endl;
@@ -84,6 +270,7 @@ void test_union_pair(std::string test_name, const DFA& left, const DFA& right, s
 
   UnionDFA test_dfa(left, right);
   test_helper("union pair " + test_name, test_dfa, expected_boards);
+  test_estimate("union pair " + test_name, left, right, union_function, test_dfa);
 }
 
 void test_union_pair(std::string test_name, const DFA& left, const DFA& right, double expected_boards)
@@ -91,6 +278,49 @@ void test_union_pair(std::string test_name, const DFA& left, const DFA& right, d
   return test_union_pair(test_name, left, right, size_t(expected_boards));
 }
 
+size_t count_process_maps()
+{
+  // memory mappings of this process, or zero without /proc
+  std::ifstream maps("/proc/self/maps");
+  size_t output = 0;
+  std::string line;
+  while(std::getline(maps, line))
+    {
+      ++output;
+    }
+  return output;
+}
+
+void test_in_memory_maps(const dfa_shape_t& shape)
+{
+  // in-memory DFAs must not cost a mapping per layer, so building
+  // many of them, held or dropped, leaves the map count bounded.
+
+  size_t maps_before = count_process_maps();
+
+  std::vector<shared_dfa_ptr> held;
+  for(int i = 0; i < 256; ++i)
+    {
+      held.emplace_back(new AcceptDFA(shape));
+      held.emplace_back(new RejectDFA(shape));
+    }
+  size_t maps_held = count_process_maps();
+  held.clear();
+
+  for(int i = 0; i < 4096; ++i)
+    {
+      shared_dfa_ptr dropped(new AcceptDFA(shape));
+    }
+  size_t maps_after = count_process_maps();
+
+  if((maps_held > maps_before + 256) || (maps_after > maps_before + 256))
+    {
+      std::cerr << "maps before = " << maps_before << ", held = " << maps_held << ", after = " << maps_after << std::endl;
+      throw std::logic_error("in-memory DFAs: map count not bounded");
+    }
+  std::cout << get_parameter_string(shape) << " in-memory maps: passed" << std::endl;
+}
+
 void test_suite(const dfa_shape_t& shape)
 {
 
@@ -247,6 +477,66 @@ void test_suite(const dfa_shape_t& shape)
 	}
     }
   test_intersection_pair("one1 + count1", *one1, *count1, one1_count1_expected);
+
+  // permutation tests
+
+  test_permuted("count1", count1);
+  test_permuted("count2", count2);
+  test_permuted("one1", one1);
+  test_permuted("inverse one1", DFAUtil::get_inverse(one1));
+
+  test_relabeled("count1", count1);
+  test_relabeled("count2", count2);
+  test_relabeled("one1", one1);
+  test_relabeled("inverse one1", DFAUtil::get_inverse(one1));
+
+  // vector reduction tests, once with concurrent merges and once
+  // sequentially. both should land on the same DFA.
+
+  std::vector<shared_dfa_ptr> fixed_dfas;
+  size_t nonzero_expected = 1;
+  for(int layer = 0; layer < shape.size(); ++layer)
+    {
+      for(int c = 1; c < shape[layer]; ++c)
+	{
+	  fixed_dfas.push_back(DFAUtil::get_fixed(shape, layer, c));
+	}
+      nonzero_expected *= shape[layer];
+    }
+  nonzero_expected -= 1;
+
+  if(fixed_dfas.size() > 0)
+    {
+      size_t reduce_workers = DFAUtil::get_reduce_workers();
+      std::set<std::string> union_hashes;
+      for(size_t workers : {size_t(4), size_t(1)})
+	{
+	  DFAUtil::set_reduce_workers(workers);
+	  shared_dfa_ptr nonzero = DFAUtil::get_union_vector(shape, fixed_dfas);
+	  test_helper("nonzero workers=" + std::to_string(workers), *nonzero, nonzero_expected);
+	  union_hashes.insert(nonzero->get_hash());
+	}
+      DFAUtil::set_reduce_workers(reduce_workers);
+
+      if(union_hashes.size() != 1)
+	{
+	  throw std::logic_error("nonzero: concurrent and sequential reductions differ");
+	}
+    }
+
+  // duplicate and idempotent inputs with concurrent merges. most
+  // merges return a DFA that is already pending, which must not end
+  // the reduction while other merges are still running.
+
+  {
+    size_t reduce_workers = DFAUtil::get_reduce_workers();
+    DFAUtil::set_reduce_workers(4);
+    shared_dfa_ptr count1_copy(new CountDFA(shape, 1));
+    shared_dfa_ptr count2_copy(new CountDFA(shape, 2));
+    shared_dfa_ptr count12 = DFAUtil::get_union_vector(shape, {count1, count1_copy, count2, count2_copy, DFAUtil::get_union(count1, count2)});
+    DFAUtil::set_reduce_workers(reduce_workers);
+    test_helper("count1 or count2 duplicated", *count12, count1_expected + count2_expected);
+  }
 }
 
 int main()
@@ -258,6 +548,14 @@ int main()
       test_suite(dfa_shape_t({TEST3_DFA_SHAPE}));
       test_suite(dfa_shape_t({TEST4_DFA_SHAPE}));
       test_suite(dfa_shape_t({TEST5_DFA_SHAPE}));
+
+      // tiny RAM budget to force external sorted runs
+      size_t ram_budget = BinaryDFA::get_ram_budget();
+      BinaryDFA::set_ram_budget(64);
+      test_suite(dfa_shape_t({TEST5_DFA_SHAPE}));
+      BinaryDFA::set_ram_budget(ram_budget);
+
+      test_in_memory_maps(dfa_shape_t(64, 3));
     }
   catch(const std::logic_error& e)
     {
@@ -0,0 +1,177 @@
+// test_scratch_gc.cpp
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "BuildLease.h"
+#include "DFAUtil.h"
+#include "ScratchGC.h"
+#include "utils.h"
+
+static const std::string test_directory = "scratch/test_scratch_gc";
+
+// distinct fixed DFAs per layer and character, so each check below
+// gets DFAs no other check has saved.
+static const dfa_shape_t shape({2, 3, 4, 5});
+
+std::string save_unnamed(int layer, int c)
+{
+  shared_dfa_ptr dfa = DFAUtil::get_fixed(shape, layer, c);
+  dfa->save_by_hash();
+  return dfa->get_hash();
+}
+
+void set_last_access(std::string hash, time_t age)
+{
+  // collections treat DFAs used within the lease timeout as live, so
+  // the DFAs under test are aged past it.
+
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = time(0) - BuildLease::get_timeout_seconds() - age;
+  times[0].tv_nsec = times[1].tv_nsec = 0;
+  utimensat(AT_FDCWD, ("scratch/dfas_by_hash/" + hash).c_str(), times, 0);
+}
+
+void check_kept(std::string test_name, std::string hash, bool expected)
+{
+  struct stat stat_buffer;
+  bool kept = (stat(("scratch/dfas_by_hash/" + hash).c_str(), &stat_buffer) == 0);
+
+  std::cout << test_name << ": expected " << (expected ? "kept" : "evicted") << ", actually " << (kept ? "kept" : "evicted") << std::endl;
+  if(kept != expected)
+    {
+      throw std::logic_error(test_name + ": unexpected collection result");
+    }
+}
+
+size_t get_scratch_bytes()
+{
+  // a collection with an unlimited budget only scans
+  ScratchGC gc((std::unordered_set<std::string>()));
+  gc.collect(SIZE_MAX);
+  return gc.get_stats().bytes_total;
+}
+
+void test_live_set()
+{
+  // DFAs reachable from named links, complements of live DFAs and
+  // pins survive, everything else is evicted.
+
+  std::string named = save_unnamed(1, 0);
+  DFAUtil::get_fixed(shape, 1, 0)->save("test_scratch_gc/named");
+
+  std::string base = save_unnamed(1, 1);
+  std::string complement_name = DFAUtil::get_fixed(shape, 1, 1)->save_complement();
+  shared_dfa_ptr complement(new DFA(shape, complement_name));
+  complement->save("test_scratch_gc/complement");
+
+  std::string pinned = save_unnamed(1, 2);
+  std::string unreferenced = save_unnamed(2, 0);
+
+  for(std::string hash : {named, base, complement->get_hash(), pinned, unreferenced})
+    {
+      set_last_access(hash, 100);
+    }
+
+  ScratchGC gc(std::unordered_set<std::string>({pinned}));
+  gc.collect(0);
+
+  check_kept("named", named, true);
+  check_kept("complement", complement->get_hash(), true);
+  check_kept("complement base", base, true);
+  check_kept("pinned", pinned, true);
+  check_kept("unreferenced", unreferenced, false);
+}
+
+void test_lru()
+{
+  // evicts least recently used first, stopping once within budget
+
+  std::vector<std::string> hashes;
+  for(int c = 0; c < 4; ++c)
+    {
+      hashes.push_back(save_unnamed(3, c));
+      set_last_access(hashes.back(), 400 - 100 * c);
+    }
+
+  for(int i = 0; i < 2; ++i)
+    {
+      size_t budget_bytes = get_scratch_bytes() - 1;
+
+      ScratchGC gc((std::unordered_set<std::string>()));
+      gc.collect(budget_bytes);
+
+      if(gc.get_evicted_hashes() != std::vector<std::string>({hashes[i]}))
+	{
+	  throw std::logic_error("lru: expected only the least recently used DFA evicted");
+	}
+      if(gc.get_stats().bytes_total - gc.get_stats().bytes_evicted > budget_bytes)
+	{
+	  throw std::logic_error("lru: collection stopped above budget");
+	}
+    }
+
+  check_kept("lru oldest", hashes[0], false);
+  check_kept("lru second oldest", hashes[1], false);
+  check_kept("lru second newest", hashes[2], true);
+  check_kept("lru newest", hashes[3], true);
+}
+
+void test_referenced()
+{
+  // DFAs this process still holds are pinned through DFAUtil, and
+  // released once dropped.
+
+  std::string held_hash = save_unnamed(2, 1);
+  std::string dropped_hash = save_unnamed(2, 2);
+
+  shared_dfa_ptr held = DFAUtil::load_by_hash(shape, held_hash);
+  shared_dfa_ptr dropped = DFAUtil::load_by_hash(shape, dropped_hash);
+  if(!held || !dropped)
+    {
+      throw std::logic_error("referenced: saved DFAs did not load");
+    }
+  dropped.reset();
+
+  set_last_access(held_hash, 100);
+  set_last_access(dropped_hash, 100);
+
+  DFAUtil::collect_garbage(0);
+
+  check_kept("referenced", held_hash, true);
+  check_kept("dropped", dropped_hash, false);
+
+  if(!held->contains(DFAString(shape, {0, 0, 1, 0})) || held->contains(DFAString(shape, {0, 0, 0, 0})))
+    {
+      throw std::logic_error("referenced: held DFA changed by collection");
+    }
+}
+
+int main()
+{
+  try
+    {
+      create_directory(test_directory);
+
+      test_live_set();
+      test_lru();
+      test_referenced();
+    }
+  catch(const std::logic_error& e)
+    {
+      std::cerr << e.what() << std::endl;
+      std::cerr.flush();
+      return 1;
+    }
+
+  return 0;
+}
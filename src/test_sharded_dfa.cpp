@@ -0,0 +1,111 @@
+// test_sharded_dfa.cpp
+
+#include <iostream>
+#include <stdexcept>
+
+#include "DFAUtil.h"
+#include "ShardJobs.h"
+#include "ShardedDFA.h"
+#include "test_utils.h"
+
+void check_equal(std::string test_name, const ShardedDFA& sharded_in, shared_dfa_ptr expected_in)
+{
+  std::cout << test_name << ": expected " << expected_in->size() << " positions, actually " << sharded_in.size() << " positions" << std::endl;
+
+  for(int shard_index = 0; shard_index < sharded_in.get_shard_count(); ++shard_index)
+    {
+      const std::vector<int>& boundaries = sharded_in.get_boundaries();
+      shared_dfa_ptr range = ShardedDFA::get_range(sharded_in.get_shape(), boundaries[shard_index], boundaries[shard_index + 1]);
+      if(!DFAUtil::is_subset(sharded_in.get_shard(shard_index), range))
+	{
+	  throw std::logic_error(test_name + ": shard outside its range");
+	}
+    }
+
+  if(!DFAUtil::is_equal(sharded_in.to_dfa(), expected_in))
+    {
+      throw std::logic_error(test_name + ": sharded result differs");
+    }
+}
+
+void test_sharding(const Game& game_in, const std::vector<int>& boundaries_in)
+{
+  std::string test_name = game_in.get_name() + " shards=" + std::to_string(boundaries_in.size() - 1);
+  std::cout << "TESTING " << test_name << std::endl;
+
+  const dfa_shape_t& shape = game_in.get_shape();
+
+  shared_dfa_ptr ply_1 = game_in.get_positions_forward(1);
+  shared_dfa_ptr ply_3 = game_in.get_positions_forward(3);
+  shared_dfa_ptr has_moves = game_in.get_has_moves(1);
+
+  ShardedDFA sharded_1 = ShardedDFA::from_dfa(ply_1, boundaries_in);
+  ShardedDFA sharded_3 = ShardedDFA::from_dfa(ply_3, boundaries_in);
+  ShardedDFA sharded_has_moves = ShardedDFA::from_dfa(has_moves, boundaries_in);
+
+  check_equal(test_name + " round trip", sharded_1, ply_1);
+
+  // products
+
+  check_equal(test_name + " intersection", sharded_1.get_intersection(sharded_has_moves), DFAUtil::get_intersection(ply_1, has_moves));
+  check_equal(test_name + " union", sharded_1.get_union(sharded_3), DFAUtil::get_union(ply_1, ply_3));
+  check_equal(test_name + " difference", sharded_has_moves.get_difference(sharded_1), DFAUtil::get_difference(has_moves, ply_1));
+
+  // changes within and across shards
+
+  change_vector changes_inner(shape.size());
+  changes_inner[shape.size() - 1] = change_type(0, 1);
+  check_equal(test_name + " change inner", sharded_1.get_change(changes_inner), DFAUtil::get_change(ply_1, changes_inner));
+
+  change_vector changes_first(shape.size());
+  changes_first[0] = change_type(0, shape[0] - 1);
+  check_equal(test_name + " change first", sharded_1.get_change(changes_first), DFAUtil::get_change(ply_1, changes_first));
+
+  // moves may land in any shard
+
+  std::string name_prefix = game_in.get_name() + ",forward,side_to_move=1";
+  check_equal(test_name + " moves", sharded_1.get_moves(game_in.get_move_graph_forward(1), name_prefix), game_in.get_positions_forward(2));
+
+  // shard jobs give the same moves when worked on by this process alone
+
+  std::string move_graph_name = game_in.get_name() + "/move_graph,forward,side_to_move=1";
+  shared_dfa_ptr job_moves = ShardJobs::run(game_in.get_move_graph_forward(1), move_graph_name, name_prefix, ply_1, int(boundaries_in.size() - 1));
+  if(!DFAUtil::is_equal(job_moves, game_in.get_positions_forward(2)))
+    {
+      throw std::logic_error(test_name + ": shard job moves differ");
+    }
+
+  // saved shards load back, including after saving a different
+  // sharding under the same name.
+
+  std::string name = game_in.get_name() + "/test_sharded_dfa";
+  sharded_3.save(name);
+  std::optional<ShardedDFA> loaded = ShardedDFA::load(shape, name);
+  if(!loaded || (loaded->get_boundaries() != boundaries_in))
+    {
+      throw std::logic_error(test_name + ": load failed");
+    }
+  check_equal(test_name + " load", *loaded, ply_3);
+}
+
+int main()
+{
+  Game *game = get_game("tictactoe_3");
+  const dfa_shape_t& shape = game->get_shape();
+
+  for(int shard_count = 1; shard_count <= shape[0]; ++shard_count)
+    {
+      test_sharding(*game, ShardedDFA::get_even_boundaries(shape, shard_count));
+    }
+  test_sharding(*game, std::vector<int>({0, 0, 2, shape[0]}));
+
+  // run shards both sequentially and concurrently
+
+  for(size_t workers : {1, 2})
+    {
+      ShardedDFA::set_workers(workers);
+      test_sharding(*game, ShardedDFA::get_even_boundaries(shape, shape[0]));
+    }
+
+  return 0;
+}
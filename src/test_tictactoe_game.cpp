@@ -1,9 +1,15 @@
 // test_tictactoe_game.cpp
 
+#include <format>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <string>
 
+#include "DFAUtil.h"
 #include "TicTacToeGame.h"
 #include "test_utils.h"
+#include "utils.h"
 
 size_t choose(int n, int k)
 {
@@ -24,6 +30,71 @@ size_t choose(int n, int k)
   return output;
 }
 
+void test_move_graph_load(const TicTacToeGame& tictactoe, int n2)
+{
+  // saved graphs load back to the same moves, and records before the
+  // node or edge they belong to are rejected.
+
+  for(int side_to_move = 0; side_to_move < 2; ++side_to_move)
+    {
+      const MoveGraph& move_graph = tictactoe.get_move_graph_forward(side_to_move);
+      std::string move_graph_name = std::format("{:s}/test_move_graph,side_to_move={:d}", tictactoe.get_name(), side_to_move);
+      move_graph.save(move_graph_name);
+
+      std::optional<MoveGraph> loaded = MoveGraph::load(tictactoe.get_shape(), move_graph_name);
+      assert(loaded);
+      assert(loaded->size() == move_graph.size());
+
+      for(int ply = side_to_move; ply <= n2; ply += 2)
+	{
+	  shared_dfa_ptr positions = tictactoe.get_positions_forward(ply);
+	  std::string name_prefix = std::format("{:s},test_move_graph,side_to_move={:d}", tictactoe.get_name(), side_to_move);
+	  assert(loaded->get_moves(name_prefix + ",loaded", positions)->get_hash() ==
+		 move_graph.get_moves(name_prefix + ",saved", positions)->get_hash());
+	}
+    }
+
+  std::string header;
+  std::getline(std::ifstream("scratch/" + tictactoe.get_name() + "/test_move_graph,side_to_move=0/graph"), header);
+
+  for(std::string record : {"change 0 0 1", "pre 0", "post 0", "condition 0"})
+    {
+      std::string move_graph_name = tictactoe.get_name() + "/test_move_graph,malformed";
+      create_directory("scratch/" + move_graph_name);
+      std::ofstream("scratch/" + move_graph_name + "/graph") << header << "\n" << record << "\n";
+
+      assert(!MoveGraph::load(tictactoe.get_shape(), move_graph_name));
+    }
+}
+
+void test_move_graph_optimize(const TicTacToeGame& tictactoe, int n2)
+{
+  // optimized graphs give the same moves as the graphs the game built,
+  // both forward and reversed.
+
+  for(int side_to_move = 0; side_to_move < 2; ++side_to_move)
+    {
+      MoveGraph unoptimized_forward = tictactoe.get_move_graph_unoptimized(side_to_move);
+      MoveGraph unoptimized_backward = unoptimized_forward.reverse();
+
+      std::string name_prefix = std::format("{:s},test_unoptimized,side_to_move={:d}", tictactoe.get_name(), side_to_move);
+      for(int ply = 0; ply <= n2; ++ply)
+	{
+	  shared_dfa_ptr positions = tictactoe.get_positions_forward(ply);
+	  if(ply % 2 == side_to_move)
+	    {
+	      assert(unoptimized_forward.get_moves(name_prefix + ",forward", positions)->get_hash() ==
+		     tictactoe.get_moves_forward(side_to_move, positions)->get_hash());
+	    }
+	  else
+	    {
+	      assert(unoptimized_backward.get_moves(name_prefix + ",backward", positions)->get_hash() ==
+		     tictactoe.get_moves_backward(side_to_move, positions)->get_hash());
+	    }
+	}
+    }
+}
+
 int test(int n)
 {
   std::cout << "TESTING " << n << "x" << n << std::endl;
@@ -60,6 +131,80 @@ int test(int n)
 
   test_game(tictactoe, positions_expected, n2, initial_win_expected);
 
+  // positions at different plies differ in piece counts, so the
+  // frontiers match full forward search and the closures add up.
+
+  std::vector<double> closure_expected(2, 0.0);
+  for(int ply = 0; ; ++ply)
+    {
+      shared_dfa_ptr forward = tictactoe.get_positions_forward(ply);
+      shared_dfa_ptr frontier = tictactoe.get_positions_forward_frontier(ply);
+      assert(frontier->get_hash() == forward->get_hash());
+
+      closure_expected[ply % 2] += forward->size();
+      assert(tictactoe.get_positions_forward_seen(ply)->size() == closure_expected[ply % 2]);
+
+      if(frontier->is_constant(0))
+	{
+	  break;
+	}
+    }
+
+  for(int side_to_move = 0; side_to_move < 2; ++side_to_move)
+    {
+      assert(tictactoe.get_positions_forward_closure(side_to_move)->size() == closure_expected[side_to_move]);
+    }
+
+  // every move from the start leads to the first ply, and positions
+  // with moves never have all of them lead nowhere.
+
+  shared_dfa_ptr initial = tictactoe.get_positions_forward(0);
+  shared_dfa_ptr all_to_first = tictactoe.get_moves_backward_universal(0, tictactoe.get_positions_forward(1));
+  assert(DFAUtil::get_difference(initial, all_to_first)->is_constant(0));
+
+  for(int side_to_move = 0; side_to_move < 2; ++side_to_move)
+    {
+      shared_dfa_ptr all_to_none = tictactoe.get_moves_backward_universal(side_to_move, DFAUtil::get_reject(tictactoe.get_shape()));
+      assert(DFAUtil::get_intersection(tictactoe.get_has_moves(side_to_move), all_to_none)->is_constant(0));
+      assert(tictactoe.get_moves_backward_universal(side_to_move, DFAUtil::get_accept(tictactoe.get_shape()))->is_constant(1));
+    }
+
+  // symmetry reduced solving keeps the canonical representatives of
+  // the full sets.
+
+  for(int ply = 0; ply <= n2; ++ply)
+    {
+      shared_dfa_ptr forward = tictactoe.get_positions_forward(ply);
+      shared_dfa_ptr forward_canonical = tictactoe.get_positions_forward_canonical(ply);
+      assert(DFAUtil::is_subset(forward_canonical, forward));
+      assert(DFAUtil::is_equal(forward_canonical, tictactoe.get_positions_canonical(forward)));
+      assert(forward_canonical->size() * 8 >= forward->size());
+    }
+
+  if(n == 3)
+    {
+      // corner, edge and center, then the twelve distinct replies
+      assert(tictactoe.get_positions_forward_canonical(1)->size() == 3);
+      assert(tictactoe.get_positions_forward_canonical(2)->size() == 12);
+    }
+
+  test_move_graph_load(tictactoe, n2);
+  test_move_graph_optimize(tictactoe, n2);
+
+  for(int ply_max = 0; ply_max <= n2; ++ply_max)
+    {
+      for(int side_to_move = 0; side_to_move < 2; ++side_to_move)
+	{
+	  shared_dfa_ptr winning = tictactoe.get_positions_winning(side_to_move, ply_max);
+	  shared_dfa_ptr winning_canonical = tictactoe.get_positions_winning_canonical(side_to_move, ply_max);
+	  assert(DFAUtil::is_equal(winning_canonical, tictactoe.get_positions_canonical(winning)));
+
+	  shared_dfa_ptr losing = tictactoe.get_positions_losing(side_to_move, ply_max);
+	  shared_dfa_ptr losing_canonical = tictactoe.get_positions_losing_canonical(side_to_move, ply_max);
+	  assert(DFAUtil::is_equal(losing_canonical, tictactoe.get_positions_canonical(losing)));
+	}
+    }
+
   return 0;
 }
 
@@ -2,9 +2,11 @@
 
 #include "test_utils.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <iostream>
 #include <memory>
+#include <sstream>
 
 #include "AmazonsGame.h"
 #include "BreakthroughGame.h"
@@ -66,7 +68,38 @@ Game *get_game(std::string game_name)
 	{
 	  throw std::logic_error("get_name() failed parsing breakthrough game name");
 	}
-      output = new BreakthroughGame(width, height);
+
+      size_t layers_start = game_name.find(",layers=");
+      if(layers_start == std::string::npos)
+	{
+	  output = new BreakthroughGame(width, height);
+	}
+      else
+	{
+	  std::vector<int> square_layers;
+	  std::istringstream layers_stream(game_name.substr(layers_start + 8));
+	  std::string layer_string;
+	  while(std::getline(layers_stream, layer_string, '_'))
+	    {
+	      square_layers.push_back(atoi(layer_string.c_str()));
+	    }
+
+	  std::vector<int> sorted_layers(square_layers);
+	  std::sort(sorted_layers.begin(), sorted_layers.end());
+	  for(int layer = 0; layer < sorted_layers.size(); ++layer)
+	    {
+	      if(sorted_layers[layer] != layer)
+		{
+		  throw std::logic_error("get_name() breakthrough layers are not a permutation");
+		}
+	    }
+	  if(square_layers.size() != width * height)
+	    {
+	      throw std::logic_error("get_name() breakthrough layers do not match board size");
+	    }
+
+	  output = new BreakthroughLayeredGame(width, height, square_layers);
+	}
     }
   else if(game_name.starts_with("breakthroughcw_"))
     {
@@ -1,9 +1,17 @@
 // util.cpp
 
+#include <algorithm>
 #include <bit>
 #include <cassert>
+#include <cerrno>
 #include <climits>
+#include <cstdio>
+#include <dirent.h>
 #include <format>
+#include <signal.h>
+#include <stdexcept>
+#include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "utils.h"
@@ -28,6 +36,116 @@ std::string mask_to_square(BoardMask mask)
   return output;
 }
 
+std::string create_directory(std::string directory)
+{
+  mkdir(directory.c_str(), 0700);
+  return directory;
+}
+
+std::string get_hostname()
+{
+  static const std::string hostname = []()
+  {
+    char buffer[256] = {0};
+    if(gethostname(buffer, sizeof(buffer) - 1))
+      {
+	perror("gethostname");
+	throw std::runtime_error("gethostname failed");
+      }
+    return std::string(buffer);
+  }();
+
+  return hostname;
+}
+
+std::string get_process_name()
+{
+  // <hostname>,<pid> is unique among processes sharing scratch/ from
+  // several machines. hostnames never contain commas.
+
+  return get_hostname() + "," + std::to_string(getpid());
+}
+
+bool is_dead_process(std::string process_name)
+{
+  // only processes on this host can be checked, so processes named
+  // for other hosts are assumed alive.
+
+  size_t comma = process_name.find(',');
+  if((comma == std::string::npos) ||
+     (process_name.substr(0, comma) != get_hostname()) ||
+     (comma + 1 == process_name.size()) ||
+     !std::all_of(process_name.begin() + comma + 1, process_name.end(), [](char c) {return ('0' <= c) && (c <= '9');}))
+    {
+      return false;
+    }
+
+  pid_t pid = pid_t(std::stol(process_name.substr(comma + 1)));
+  return (pid != getpid()) && kill(pid, 0) && (errno == ESRCH);
+}
+
+std::vector<std::string> list_directory(std::string directory)
+{
+  // sorted entry names, without . and ..
+
+  std::vector<std::string> output;
+
+  DIR *dir = opendir(directory.c_str());
+  if(!dir)
+    {
+      return output;
+    }
+
+  for(struct dirent *dirent = readdir(dir);
+      dirent;
+      dirent = readdir(dir))
+    {
+      std::string entry_name(dirent->d_name);
+      if((entry_name != ".") && (entry_name != ".."))
+	{
+	  output.push_back(entry_name);
+	}
+    }
+
+  closedir(dir);
+
+  std::sort(output.begin(), output.end());
+  return output;
+}
+
+void remove_directory(std::string directory)
+{
+  DIR *dir = opendir(directory.c_str());
+  if(dir)
+    {
+      for(struct dirent *dirent = readdir(dir);
+	  dirent;
+	  dirent = readdir(dir))
+	{
+	  if(strncmp(dirent->d_name, ".", sizeof(dirent->d_name)) &&
+	     strncmp(dirent->d_name, "..", sizeof(dirent->d_name)))
+	    {
+	      std::string old_file_name = directory + "/" + dirent->d_name;
+	      int unlink_ret = unlink(old_file_name.c_str());
+	      if(unlink_ret)
+		{
+		  perror("remove_directory unlink");
+		  throw std::runtime_error("remove_directory unlink failed");
+		}
+	    }
+	}
+
+      closedir(dir);
+
+      int rmdir_ret = rmdir(directory.c_str());
+      if(rmdir_ret)
+	{
+	  perror("remove_directory rmdir");
+	  throw std::runtime_error("remove_directory rmdir failed");
+	}
+    }
+}
+
 uint64_t perft(const Board& board, int depth)
 {
   if(depth <= 0)
@@ -3,10 +3,20 @@
 #ifndef CHESS_H
 #define CHESS_H
 
+#include <string>
+#include <vector>
+
 #include "Board.h"
 
 // utility functions
 
+std::string create_directory(std::string directory);
+std::string get_hostname();
+std::string get_process_name();
+bool is_dead_process(std::string process_name);
+std::vector<std::string> list_directory(std::string directory);
+void remove_directory(std::string directory);
+
 uint64_t perft(const Board& board, int depth);
 
 template<class T>
@@ -79,7 +79,7 @@ bool validate_backward(const Game& game, int ply_max, int side_to_move, int max_
   std::cout << "# CHECK UNKNOWN" << std::endl;
 
   shared_dfa_ptr base_unknown = game.get_positions_unknown(side_to_move, ply_max - 1);
-  if(!validate_subset(curr_unknown, base_unknown, max_examples))
+  if(!validate_subset(curr_unknown, base_unknown))
     {
       std::cerr << "# UNKNOWN SUBSET CHECK FAILED" << std::endl;
       return false;
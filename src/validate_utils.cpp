@@ -3,20 +3,10 @@
 #include "validate_utils.h"
 
 #include <iostream>
+#include <optional>
 
 #include "DFAUtil.h"
 
-static void print_example(const Game& game, shared_dfa_ptr positions)
-{
-  for(auto iter = positions->cbegin();
-          iter < positions->cend();
-      ++iter)
-    {
-      std::cerr << game.position_to_string(*iter) << std::endl;
-      break;
-    }
-}
-
 template <class... Args>
 shared_dfa_ptr load_helper(const Game& game, const std::format_string<Args...>& name_format, Args&&... args)
 {
@@ -37,7 +27,7 @@ template shared_dfa_ptr load_helper(const Game& game, const std::format_string<i
 
 bool validate_disjoint(shared_dfa_ptr dfa_a, shared_dfa_ptr dfa_b)
 {
-  return DFAUtil::get_intersection(dfa_a, dfa_b)->is_constant(0);
+  return DFAUtil::is_disjoint(dfa_a, dfa_b);
 }
 
 bool validate_equal(const Game& game, std::string name_a, shared_dfa_ptr dfa_a, std::string name_b, shared_dfa_ptr dfa_b)
@@ -55,26 +45,21 @@ bool validate_equal(const Game& game, std::string name_a, shared_dfa_ptr dfa_a,
 
   // hashes may be different if states are in a different order...
 
-  shared_dfa_ptr dfa_a_minus_b = DFAUtil::get_difference(dfa_a, dfa_b);
-  if(!dfa_a_minus_b->is_constant(false))
+  std::optional<DFAString> a_minus_b_example = DFAUtil::find_difference(dfa_a, dfa_b);
+  if(a_minus_b_example)
     {
-      auto size_a_minus_b = dfa_a_minus_b->size();
-      std::cerr << "# " << name_a << " HAS " << size_a_minus_b << " EXTRA POSITIONS" << std::endl;
-      print_example(game, dfa_a_minus_b);
+      std::cerr << "# " << name_a << " HAS EXTRA POSITIONS" << std::endl;
+      std::cerr << game.position_to_string(*a_minus_b_example) << std::endl;
     }
 
-  shared_dfa_ptr dfa_b_minus_a = DFAUtil::get_difference(dfa_b, dfa_a);
-  if(!dfa_b_minus_a->is_constant(false))
+  std::optional<DFAString> b_minus_a_example = DFAUtil::find_difference(dfa_b, dfa_a);
+  if(b_minus_a_example)
     {
-      auto size_b_minus_a = dfa_b_minus_a->size();
-      std::cerr << "# " << name_b << " HAS " << size_b_minus_a << " EXTRA POSITIONS" << std::endl;
-      print_example(game, dfa_b_minus_a);
+      std::cerr << "# " << name_b << " HAS EXTRA POSITIONS" << std::endl;
+      std::cerr << game.position_to_string(*b_minus_a_example) << std::endl;
     }
 
-  return (dfa_a_minus_b->is_constant(false) &&
-          dfa_b_minus_a->is_constant(false));
-
-  return true;
+  return !a_minus_b_example && !b_minus_a_example;
 }
 
 bool validate_losing(const Game& game, int side_to_move, shared_dfa_ptr curr_losing, shared_dfa_ptr next_winning, shared_dfa_ptr base_losing, int max_examples)
@@ -170,7 +155,7 @@ bool validate_partition(shared_dfa_ptr target, std::vector<shared_dfa_ptr> parti
 
   for(const shared_dfa_ptr& p_s : partition)
     {
-      if(!validate_subset(p_s, target, max_examples))
+      if(!validate_subset(p_s, target))
         {
           std::cerr << "# PARTITION CHECKED FAILED: SUBSET CHECK FAILED" << std::endl;
           return false;
@@ -244,22 +229,9 @@ bool validate_result(const Game& game, int side_to_move, shared_dfa_ptr position
   return true;
 }
 
-bool validate_subset(shared_dfa_ptr dfa_a, shared_dfa_ptr dfa_b, int max_examples)
+bool validate_subset(shared_dfa_ptr dfa_a, shared_dfa_ptr dfa_b)
 {
-  int subset_examples = 0;
-  for(auto iter = dfa_a->cbegin();
-      (iter < dfa_a->cend()) && (subset_examples < max_examples);
-      ++iter, ++subset_examples)
-    {
-      DFAString position(*iter);
-
-      if(!dfa_b->contains(position))
-        {
-          return false;
-        }
-    }
-
-  return true;
+  return DFAUtil::is_subset(dfa_a, dfa_b);
 }
 
 bool validate_winning(const Game& game, int side_to_move, shared_dfa_ptr curr_winning, shared_dfa_ptr next_losing, shared_dfa_ptr base_winning, int max_examples)